@@ -0,0 +1,490 @@
+#define TRACE_NAME "SharedMemoryBackend"
+#include <fcntl.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "TRACE/tracemf.h"
+#include "artdaq-core/Core/SharedMemoryBackend.hh"
+#include "artdaq-core/Utilities/TimeUtils.hh"
+#ifndef SHM_DEST  // Lynn reports that this is missing on Mac OS X?!?
+#define SHM_DEST 01000
+#endif
+
+#define TLVL_OPEN 36
+#define TLVL_MAP 37
+#define TLVL_STAT 38
+
+namespace {
+/// Fault in the pages of part of a mapping
+void populateRange(uint8_t* base, size_t size, size_t page_size)
+{
+#ifdef MADV_POPULATE_WRITE
+	if (madvise(base, size, MADV_POPULATE_WRITE) == 0)
+	{
+		return;
+	}
+#endif
+	// Reading a page of a shared memory segment allocates and maps it; the contents are left untouched
+	volatile uint8_t sink = 0;
+	for (size_t offset = 0; offset < size; offset += page_size)
+	{
+		sink = sink + base[offset];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+}
+
+/// Round size up to a multiple of the huge page size, returns 0 if huge pages are not supported
+size_t hugePageRound(size_t size)
+{
+	auto huge_page_size = artdaq::SharedMemoryBackend::HugePageSize();
+	if (huge_page_size == 0) return 0;
+	return (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+}
+
+/**
+ * SysV shared memory (shmget/shmat), identified directly by the key
+ */
+class SysVBackend : public artdaq::SharedMemoryBackend
+{
+public:
+	bool Open(uint32_t key, size_t size) override
+	{
+		key_ = key;
+		id_ = shmget(key_, size, 0666);
+		return id_ != -1 && stat_();
+	}
+
+	bool Create(uint32_t key, size_t size, bool huge_pages) override
+	{
+		key_ = key;
+		huge_pages_ = false;
+		if (huge_pages)
+		{
+#ifdef SHM_HUGETLB
+			auto hugeSize = hugePageRound(size);
+			if (hugeSize > 0)
+			{
+				TLOG(TLVL_OPEN) << "Creating huge page shared memory segment with key " << std::hex << std::showbase << key_ << " and size " << std::dec << hugeSize;
+				id_ = shmget(key_, hugeSize, IPC_CREAT | SHM_HUGETLB | 0666);
+				if (id_ != -1)
+				{
+					huge_pages_ = true;
+					return stat_();
+				}
+				TLOG(TLVL_WARNING) << "Could not create shared memory segment with huge pages, errno=" << errno << " (" << strerror(errno) << ")"
+				                   << ". Check vm.nr_hugepages and vm.hugetlb_shm_group. Falling back to normal pages.";
+			}
+			else
+			{
+				TLOG(TLVL_WARNING) << "Huge pages are not supported on this system, using normal pages";
+			}
+#else
+			TLOG(TLVL_WARNING) << "SHM_HUGETLB is not supported on this platform, using normal pages";
+#endif
+		}
+		TLOG(TLVL_OPEN) << "Creating shared memory segment with key " << std::hex << std::showbase << key_ << " and size " << std::dec << size;
+		id_ = shmget(key_, size, IPC_CREAT | 0666);
+		return id_ != -1 && stat_();
+	}
+
+	void* Map(bool populate) override
+	{
+		auto ptr = shmat(id_, nullptr, 0);
+		if (ptr == reinterpret_cast<void*>(-1))  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,performance-no-int-to-ptr)
+		{
+			return nullptr;
+		}
+		if (populate)
+		{
+			Populate(ptr, size_);
+		}
+		return ptr;
+	}
+
+	void Unmap(void* ptr) override { shmdt(ptr); }
+
+	void Remove() override
+	{
+		if (id_ != -1)
+		{
+			shmctl(id_, IPC_RMID, nullptr);
+		}
+		id_ = -1;
+	}
+
+	void Close() override { id_ = -1; }
+
+	bool IsOpen() const override { return id_ != -1; }
+
+	std::string Describe() const override
+	{
+		std::ostringstream ostr;
+		ostr << "SysV shared memory segment with key " << std::hex << std::showbase << key_ << " (ID " << std::dec << id_ << ")";
+		return ostr.str();
+	}
+
+	std::string CleanupCommand() const override
+	{
+		std::ostringstream ostr;
+		ostr << "ipcrm -M " << std::hex << std::showbase << key_;
+		return ostr.str();
+	}
+
+	bool IsRemoved() const override
+	{
+		struct shmid_ds info;
+		if (id_ == -1 || shmctl(id_, IPC_STAT, &info) != 0)
+		{
+			TLOG(TLVL_STAT) << "Error accessing Shared Memory info: " << errno << " (" << strerror(errno) << ").";
+			return true;
+		}
+		return (info.shm_perm.mode & SHM_DEST) != 0;
+	}
+
+	int AttachCount() const override
+	{
+		struct shmid_ds info;
+		if (id_ == -1 || shmctl(id_, IPC_STAT, &info) != 0)
+		{
+			TLOG(TLVL_STAT) << "Error accessing Shared Memory info: " << errno << " (" << strerror(errno) << ").";
+			return 0;
+		}
+		return static_cast<int>(info.shm_nattch);
+	}
+
+private:
+	bool stat_()
+	{
+		struct shmid_ds info;
+		if (shmctl(id_, IPC_STAT, &info) != 0)
+		{
+			id_ = -1;
+			return false;
+		}
+		size_ = info.shm_segsz;
+		return true;
+	}
+
+	uint32_t key_{0};
+	int id_{-1};
+};
+
+/**
+ * Base for the backends which mmap a file descriptor
+ */
+class FdBackend : public artdaq::SharedMemoryBackend
+{
+public:
+	void* Map(bool populate) override
+	{
+		// Transparent huge pages must be requested before the pages are faulted in
+		bool thp = thp_requested_ && !huge_pages_;
+		auto flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+		if (populate && !thp) flags |= MAP_POPULATE;
+#endif
+		auto ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, flags, fd_, 0);
+		if (ptr == MAP_FAILED)  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast,performance-no-int-to-ptr)
+		{
+			return nullptr;
+		}
+#ifdef MADV_HUGEPAGE
+		if (thp)
+		{
+			if (madvise(ptr, size_, MADV_HUGEPAGE) == 0)
+			{
+				huge_pages_ = true;
+			}
+			else
+			{
+				TLOG(TLVL_WARNING) << "madvise(MADV_HUGEPAGE) failed, errno=" << errno << " (" << strerror(errno) << "), using normal pages";
+			}
+		}
+#endif
+#ifdef MAP_POPULATE
+		if (populate && thp)
+#else
+		if (populate)
+#endif
+		{
+			Populate(ptr, size_);
+		}
+		return ptr;
+	}
+
+	void Unmap(void* ptr) override { munmap(ptr, size_); }
+
+	void Close() override
+	{
+		if (fd_ != -1)
+		{
+			close(fd_);
+		}
+		fd_ = -1;
+	}
+
+	bool IsOpen() const override { return fd_ != -1; }
+
+protected:
+	/// Record the size of the open fd, and check that it is at least size bytes
+	bool stat_(size_t size)
+	{
+		struct stat info;
+		if (fstat(fd_, &info) != 0 || static_cast<size_t>(info.st_size) < size)
+		{
+			if (errno == 0) errno = EINVAL;
+			Close();
+			return false;
+		}
+		size_ = info.st_size;
+		return true;
+	}
+
+	/// Set the size of a newly created fd
+	bool truncate_(size_t size)
+	{
+		if (ftruncate(fd_, size) != 0)
+		{
+			Close();
+			return false;
+		}
+		size_ = size;
+		return true;
+	}
+
+	int fd_{-1};
+	bool thp_requested_{false};
+};
+
+/**
+ * POSIX shared memory (shm_open + mmap), named /artdaq-core-<key>
+ */
+class PosixShmBackend : public FdBackend
+{
+public:
+	bool Open(uint32_t key, size_t size) override
+	{
+		setName_(key);
+		errno = 0;
+		fd_ = shm_open(name_, O_RDWR, 0);
+		return fd_ != -1 && stat_(size);
+	}
+
+	bool Create(uint32_t key, size_t size, bool huge_pages) override
+	{
+		setName_(key);
+		huge_pages_ = false;
+		thp_requested_ = huge_pages;
+		TLOG(TLVL_OPEN) << "Creating POSIX shared memory object " << name_ << " with size " << size;
+		fd_ = shm_open(name_, O_CREAT | O_RDWR, 0666);
+		if (fd_ == -1) return false;
+		fchmod(fd_, 0666);  // shm_open applies the umask, SysV segments do not
+		return truncate_(size);
+	}
+
+	void Remove() override
+	{
+		shm_unlink(name_);
+		Close();
+	}
+
+	std::string Describe() const override { return std::string("POSIX shared memory object ") + name_; }
+
+	std::string CleanupCommand() const override { return std::string("rm /dev/shm") + name_; }
+
+private:
+	void setName_(uint32_t key) { snprintf(name_, sizeof(name_), "/artdaq-core-%#010x", key); }
+
+	char name_[32]{};
+};
+
+/**
+ * Anonymous memory file (memfd_create + mmap). The owner publishes its pid and fd number in a small POSIX
+ * shared memory "locator" object, and other processes open the file through /proc/<pid>/fd/<fd>.
+ */
+class MemfdBackend : public FdBackend
+{
+public:
+	bool Open(uint32_t key, size_t size) override
+	{
+		setName_(key);
+		errno = 0;
+		auto locator_fd = shm_open(locator_name_, O_RDONLY, 0);
+		if (locator_fd == -1) return false;
+		Locator locator;
+		auto bytes = pread(locator_fd, &locator, sizeof(locator), 0);
+		close(locator_fd);
+		if (bytes != static_cast<ssize_t>(sizeof(locator)))
+		{
+			errno = ENOENT;
+			return false;
+		}
+
+		// Make sure that the fd still refers to our memfd, and not to a file of a process which reused the pid
+		char path[64];
+		char target[128]{};
+		snprintf(path, sizeof(path), "/proc/%d/fd/%d", locator.pid, locator.fd);
+		if (readlink(path, target, sizeof(target) - 1) == -1 || strstr(target, locator_name_ + 1) == nullptr)
+		{
+			errno = ENOENT;
+			return false;
+		}
+		fd_ = open(path, O_RDWR | O_CLOEXEC);
+		return fd_ != -1 && stat_(size);
+	}
+
+	bool Create(uint32_t key, size_t size, bool huge_pages) override
+	{
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+		setName_(key);
+		huge_pages_ = false;
+		thp_requested_ = false;
+		if (huge_pages)
+		{
+			auto hugeSize = hugePageRound(size);
+			fd_ = hugeSize > 0 ? memfd_create(locator_name_ + 1, MFD_CLOEXEC | MFD_HUGETLB) : -1;
+			// Huge pages are reserved when the file is mapped, so check that now
+			if (fd_ != -1 && truncate_(hugeSize))
+			{
+				auto ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+				if (ptr != MAP_FAILED)  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast,performance-no-int-to-ptr)
+				{
+					munmap(ptr, size_);
+					huge_pages_ = true;
+				}
+				else
+				{
+					Close();
+				}
+			}
+			if (!huge_pages_)
+			{
+				TLOG(TLVL_WARNING) << "Could not create memfd with huge pages, errno=" << errno << " (" << strerror(errno) << ")"
+				                   << ". Check vm.nr_hugepages. Falling back to transparent huge pages.";
+				Close();
+				thp_requested_ = true;
+			}
+		}
+		if (fd_ == -1)
+		{
+			TLOG(TLVL_OPEN) << "Creating memfd " << (locator_name_ + 1) << " with size " << size;
+			fd_ = memfd_create(locator_name_ + 1, MFD_CLOEXEC);
+			if (fd_ == -1 || !truncate_(size)) return false;
+		}
+
+		Locator locator{getpid(), fd_};
+		auto locator_fd = shm_open(locator_name_, O_CREAT | O_TRUNC | O_RDWR, 0666);
+		if (locator_fd == -1)
+		{
+			Close();
+			return false;
+		}
+		fchmod(locator_fd, 0666);
+		auto bytes = pwrite(locator_fd, &locator, sizeof(locator), 0);
+		close(locator_fd);
+		if (bytes != static_cast<ssize_t>(sizeof(locator)))
+		{
+			shm_unlink(locator_name_);
+			Close();
+			return false;
+		}
+		return true;
+#else
+		(void)key;
+		(void)size;
+		(void)huge_pages;
+		errno = ENOSYS;
+		return false;
+#endif
+	}
+
+	void Remove() override
+	{
+		shm_unlink(locator_name_);
+		Close();
+	}
+
+	std::string Describe() const override { return std::string("memfd shared memory located by ") + locator_name_; }
+
+	std::string CleanupCommand() const override { return std::string("rm /dev/shm") + locator_name_; }
+
+private:
+	struct Locator
+	{
+		pid_t pid;
+		int fd;
+	};
+
+	void setName_(uint32_t key) { snprintf(locator_name_, sizeof(locator_name_), "/artdaq-core-memfd-%#010x", key); }
+
+	char locator_name_[40]{};
+};
+}  // namespace
+
+std::unique_ptr<artdaq::SharedMemoryBackend> artdaq::SharedMemoryBackend::Make(SharedMemoryBackendType type)
+{
+	switch (type)
+	{
+		case SharedMemoryBackendType::PosixShm:
+			return std::make_unique<PosixShmBackend>();
+		case SharedMemoryBackendType::Memfd:
+			return std::make_unique<MemfdBackend>();
+		case SharedMemoryBackendType::SysV:
+		default:
+			return std::make_unique<SysVBackend>();
+	}
+}
+
+double artdaq::SharedMemoryBackend::Populate(void* ptr, size_t size, size_t threads)
+{
+	auto start = std::chrono::steady_clock::now();
+	auto base = static_cast<uint8_t*>(ptr);
+	auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	if (threads == 0)
+	{
+		threads = std::min<size_t>(std::thread::hardware_concurrency(), size / populate_bytes_per_thread);
+	}
+	threads = std::max<size_t>(threads, 1);
+
+	// Each thread takes a whole number of pages, since madvise needs page-aligned addresses
+	auto pages = (size + page_size - 1) / page_size;
+	auto chunk = (pages + threads - 1) / threads * page_size;
+	std::vector<std::thread> workers;
+	for (size_t offset = chunk; offset < size; offset += chunk)
+	{
+		workers.emplace_back(populateRange, base + offset, std::min(chunk, size - offset), page_size);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+	populateRange(base, std::min(chunk, size), page_size);
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	auto elapsed = TimeUtils::GetElapsedTime(start);
+	TLOG(TLVL_MAP) << "Prefaulted " << size << " bytes with " << workers.size() + 1 << " thread(s) in " << elapsed << " s";
+	return elapsed;
+}
+
+size_t artdaq::SharedMemoryBackend::HugePageSize()
+{
+	std::ifstream meminfo("/proc/meminfo");
+	std::string line;
+	while (std::getline(meminfo, line))
+	{
+		size_t kb = 0;
+		if (sscanf(line.c_str(), "Hugepagesize: %zu kB", &kb) == 1)  // NOLINT(cert-err34-c)
+		{
+			return kb * 1024;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef artdaq_core_Core_SharedMemoryBackend_hh
+#define artdaq_core_Core_SharedMemoryBackend_hh 1
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace artdaq {
+/**
+ * \brief The operating-system mechanism used to create and map a Shared Memory segment.
+ * Every process attaching to a segment must use the same backend type.
+ */
+enum class SharedMemoryBackendType
+{
+	SysV,      ///< shmget/shmat, identified by the key (default)
+	PosixShm,  ///< shm_open + mmap, named /dev/shm/artdaq-core-<key>; not subject to the shmmax limit
+	Memfd      ///< memfd_create + mmap, published through a small POSIX shm locator and /proc/<pid>/fd; requires permission to open the owner's fds
+};
+
+/**
+ * \brief Interface to a Shared Memory segment provider. A SharedMemoryBackend holds at most one segment,
+ * which is first opened (or created), then mapped. Remove, Unmap and Close only make system calls, so they
+ * may be used from a signal handler.
+ */
+class SharedMemoryBackend
+{
+public:
+	/**
+	 * \brief Create a SharedMemoryBackend of the given type
+	 * \param type Which backend to create
+	 * \return Pointer to the new backend
+	 */
+	static std::unique_ptr<SharedMemoryBackend> Make(SharedMemoryBackendType type);
+
+	/**
+	 * \brief SharedMemoryBackend Destructor. Does not unmap or remove the segment.
+	 */
+	virtual ~SharedMemoryBackend() = default;
+
+	/**
+	 * \brief Open an existing segment
+	 * \param key Key identifying the segment
+	 * \param size Minimum size of the segment
+	 * \return Whether the segment was opened (errno is set on failure)
+	 */
+	virtual bool Open(uint32_t key, size_t size) = 0;
+
+	/**
+	 * \brief Create a new segment
+	 * \param key Key identifying the segment
+	 * \param size Size of the segment. It is rounded up to a multiple of the huge page size if huge pages are used
+	 * \param huge_pages Try to back the segment with huge pages, falling back to normal pages if they are not available
+	 * \return Whether the segment was created (errno is set on failure)
+	 */
+	virtual bool Create(uint32_t key, size_t size, bool huge_pages) = 0;
+
+	/**
+	 * \brief Map the whole segment into this process
+	 * \param populate Fault in every page while mapping
+	 * \return Address of the mapping, or nullptr on failure
+	 */
+	virtual void* Map(bool populate) = 0;
+
+	/**
+	 * \brief Unmap a mapping returned by Map
+	 * \param ptr Address of the mapping
+	 */
+	virtual void Unmap(void* ptr) = 0;
+
+	/**
+	 * \brief Remove the segment's name, so that no new process can open it. Existing mappings remain valid.
+	 */
+	virtual void Remove() = 0;
+
+	/**
+	 * \brief Release the handle to the segment. Existing mappings remain valid.
+	 */
+	virtual void Close() = 0;
+
+	/**
+	 * \brief Whether a segment is currently open
+	 * \return True if Open or Create succeeded, and neither Remove nor Close has been called since
+	 */
+	virtual bool IsOpen() const = 0;
+
+	/**
+	 * \brief Describe the open segment, for log messages
+	 * \return Human-readable identification of the segment
+	 */
+	virtual std::string Describe() const = 0;
+
+	/**
+	 * \brief Command which removes a stale segment left behind by a crashed owner
+	 * \return Shell command line
+	 */
+	virtual std::string CleanupCommand() const = 0;
+
+	/**
+	 * \brief Whether the operating system reports the segment as marked for removal, by its owner or externally
+	 * \return True if the segment is being destroyed; backends which cannot tell return false
+	 */
+	virtual bool IsRemoved() const { return false; }
+
+	/**
+	 * \brief Number of processes attached to the segment, as counted by the operating system. Unlike a count kept in
+	 * the segment, this also drops when an attached process crashes.
+	 * \return Attach count, or -1 if the backend cannot tell
+	 */
+	virtual int AttachCount() const { return -1; }
+
+	/**
+	 * \brief Size of the open segment
+	 * \return Size in bytes
+	 */
+	size_t Size() const { return size_; }
+
+	/**
+	 * \brief Whether Create obtained huge pages
+	 * \return True if the segment created by this backend is backed by huge pages
+	 */
+	bool UsesHugePages() const { return huge_pages_; }
+
+	/**
+	 * \brief Fault in every page of a mapping, without changing its contents
+	 * \param ptr Address of the mapping
+	 * \param size Size of the mapping
+	 * \param threads Number of threads faulting in pages in parallel; 0 uses one per populate_bytes_per_thread, up to the number of cores
+	 * \return Time taken, in seconds
+	 */
+	static double Populate(void* ptr, size_t size, size_t threads = 1);
+
+	static constexpr size_t populate_bytes_per_thread = 256 * 1024 * 1024;  ///< Mapping size per thread when Populate chooses the thread count
+
+	/**
+	 * \brief Get the default huge page size of the system
+	 * \return Huge page size in bytes, from /proc/meminfo, or 0 if huge pages are not supported
+	 */
+	static size_t HugePageSize();
+
+protected:
+	size_t size_{0};          ///< Size of the open segment
+	bool huge_pages_{false};  ///< Whether the segment was created with huge pages
+};
+}  // namespace artdaq
+
+#endif  // artdaq_core_Core_SharedMemoryBackend_hh
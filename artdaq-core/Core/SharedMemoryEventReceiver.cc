@@ -2,25 +2,75 @@
 #include "artdaq-core/Core/SharedMemoryEventReceiver.hh"
 
 #include <sys/time.h>
+#include <algorithm>
+#include <cstring>
 #include "artdaq-core/Data/Fragment.hh"
+#include "artdaq-core/Data/detail/RawEventDirectory.hh"
 #define TRACE_NAME "SharedMemoryEventReceiver"
 #include "TRACE/tracemf.h"
 
-artdaq::SharedMemoryEventReceiver::SharedMemoryEventReceiver(uint32_t shm_key, uint32_t broadcast_shm_key)
-    : current_read_buffer_(-1)
-    , initialized_(false)
-    , current_header_(nullptr)
-    , current_data_source_(nullptr)
+artdaq::SharedMemoryEventReceiver::SharedMemoryEventReceiver(uint32_t shm_key, uint32_t broadcast_shm_key, size_t lookahead)
+    : initialized_(false)
+    , type_filter_(false)
+    , filtered_events_(0)
+    , lookahead_(lookahead)
     , data_(shm_key)
     , broadcasts_(broadcast_shm_key)
 {
-	TLOG(TLVL_DEBUG + 33) << "SharedMemoryEventReceiver CONSTRUCTOR";
+	TLOG(TLVL_DEBUG + 33) << "SharedMemoryEventReceiver CONSTRUCTOR lookahead=" << lookahead_;
 }
 
 bool artdaq::SharedMemoryEventReceiver::ReadyForRead(bool broadcast, size_t timeout_us)
+{
+	return readyForRead_(state_, broadcast, timeout_us);
+}
+
+artdaq::detail::RawEventHeader* artdaq::SharedMemoryEventReceiver::ReadHeader(bool& err)
+{
+	return readHeader_(state_, err);
+}
+
+std::set<artdaq::Fragment::type_t> artdaq::SharedMemoryEventReceiver::GetFragmentTypes(bool& err)
+{
+	return getFragmentTypes_(state_, err);
+}
+
+std::unique_ptr<artdaq::Fragments> artdaq::SharedMemoryEventReceiver::GetFragmentsByType(bool& err, Fragment::type_t type)
+{
+	return getFragmentsByType_(state_, err, type);
+}
+
+artdaq::FragmentViews artdaq::SharedMemoryEventReceiver::GetFragmentViewsByType(bool& err, Fragment::type_t type)
+{
+	return getFragmentViewsByType_(state_, err, type);
+}
+
+void artdaq::SharedMemoryEventReceiver::ReleaseBuffer()
+{
+	releaseBuffer_(state_);
+}
+
+void artdaq::SharedMemoryEventReceiver::SetFragmentTypeInterest(std::set<Fragment::type_t> const& types)
+{
+	type_interest_.reset();
+	for (auto type : types)
+	{
+		type_interest_.set(type);
+	}
+	type_filter_ = !types.empty();
+	TLOG(TLVL_DEBUG + 33) << "SetFragmentTypeInterest: " << types.size() << " types of interest";
+}
+
+std::unique_ptr<artdaq::SharedMemoryEventReceiver::Cursor> artdaq::SharedMemoryEventReceiver::MakeCursor()
+{
+	return std::make_unique<Cursor>(*this);
+}
+
+bool artdaq::SharedMemoryEventReceiver::readyForRead_(ReadState& state, bool broadcast, size_t timeout_us)
 {
 	TLOG(TLVL_DEBUG + 33) << "ReadyForRead BEGIN timeout_us=" << timeout_us;
-	if (current_read_buffer_ != -1 && (current_data_source_ != nullptr) && (current_header_ != nullptr))
+	touchPendingBuffers_();
+	if (state.current_read_buffer != -1 && (state.current_data_source != nullptr) && (state.current_header != nullptr))
 	{
 		TLOG(TLVL_DEBUG + 33) << "ReadyForRead Returning true because already reading buffer";
 		return true;
@@ -29,46 +79,82 @@ bool artdaq::SharedMemoryEventReceiver::ReadyForRead(bool broadcast, size_t time
 	bool first = true;
 	auto start_time = TimeUtils::gettimeofday_us();
 	uint64_t time_diff = 0;
-	uint64_t max_sleep = 5000000;  // 5 seconds
-	int buf = -1;
 	while (first || time_diff < timeout_us)
 	{
+		// Sample the notification counts before looking, so that a buffer made ready after the checks ends the wait immediately
+		std::vector<SharedMemoryManager*> segments{&broadcasts_};
+		std::vector<uint32_t> notify_counts{broadcasts_.GetReadNotifyCount()};
+		if (!broadcast)
+		{
+			segments.push_back(&data_);
+			notify_counts.push_back(data_.GetReadNotifyCount());
+		}
+
+		// Other Cursors may claim a buffer between the ready check and the claim, so fall through to the next source when that happens
+		int buf = -1;
 		if (broadcasts_.ReadyForRead())
 		{
 			buf = broadcasts_.GetBufferForReading();
-			current_data_source_ = &broadcasts_;
+			state.current_data_source = &broadcasts_;
+		}
+		if (buf == -1 && !broadcast && lookahead_ > 0)
+		{
+			buf = nextPendingBuffer_();
+			state.current_data_source = &data_;
+		}
+		if (buf == -1 && !broadcast && data_.ReadyForRead())
+		{
+			buf = claimDataBuffer_();
+			state.current_data_source = &data_;
 		}
-		else if (!broadcast && data_.ReadyForRead())
+		if (buf == -1 && !first)
 		{
-			buf = data_.GetBufferForReading();
-			current_data_source_ = &data_;
+			// Sleep until either segment is notified, then check both again (broadcasts first)
+			auto ready = SharedMemoryManager::WaitForReadable(segments, notify_counts, timeout_us - time_diff);
+			TLOG(TLVL_DEBUG + 33) << "ReadyForRead: WaitForReadable returned " << ready;
 		}
-		if (buf != -1 && (current_data_source_ != nullptr))
+		if (buf != -1 && (state.current_data_source != nullptr))
 		{
-			current_read_buffer_ = buf;
-			current_data_source_->ResetReadPos(buf);
-			current_header_ = reinterpret_cast<detail::RawEventHeader*>(current_data_source_->GetReadPos(buf));  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
-			TLOG(TLVL_DEBUG + 33) << "ReadyForRead Found buffer, returning true. event hdr sequence_id=" << current_header_->sequence_id;
+			state.current_read_buffer = buf;
+			state.current_data_source->ResetReadPos(buf);
+			state.current_header = reinterpret_cast<detail::RawEventHeader*>(state.current_data_source->GetReadPos(buf));  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+			TLOG(TLVL_DEBUG + 33) << "ReadyForRead Found buffer, returning true. event hdr sequence_id=" << state.current_header->sequence_id;
+
+			// Drop data events which contain none of the Fragment types of interest, using the writer's type mask if it published one
+			auto filter = type_filter_ && state.current_data_source == &data_;
+			if (filter && !data_.BufferHasAnyType(buf, type_interest_))
+			{
+				TLOG(TLVL_DEBUG + 33) << "ReadyForRead: Buffer " << buf << " has no Fragment types of interest, releasing it";
+				++filtered_events_;
+				releaseBuffer_(state);
+				continue;
+			}
+			buildFragmentIndex_(state);
+			if (filter && !indexHasInterest_(state))
+			{
+				TLOG(TLVL_DEBUG + 33) << "ReadyForRead: Event in buffer " << buf << " has no Fragments of interest, releasing it";
+				++filtered_events_;
+				releaseBuffer_(state);
+				continue;
+			}
 
 			// Ignore any Init fragments after the first
-			if (current_data_source_ == &broadcasts_)
+			if (state.current_data_source == &broadcasts_)
 			{
 				bool err;
-				auto types = GetFragmentTypes(err);
-				if (!err && (types.count(Fragment::type_t(Fragment::InitFragmentType)) != 0u) && initialized_)
+				auto types = getFragmentTypes_(state, err);
+				if (!err && (types.count(Fragment::type_t(Fragment::InitFragmentType)) != 0u) && initialized_.exchange(true))
 				{
-					ReleaseBuffer();
+					releaseBuffer_(state);
 					continue;
 				}
-				if (!err && (types.count(Fragment::type_t(Fragment::InitFragmentType)) != 0u))
-				{
-					initialized_ = true;
-				}
 			}
 
+			// Claim the following events now, so that the next call does not have to search for them
+			fillLookahead_();
 			return true;
 		}
-		current_data_source_ = nullptr;
+		state.current_data_source = nullptr;
 		first = false;
 
 		if (broadcasts_.IsEndOfData() || data_.IsEndOfData())
@@ -78,104 +164,263 @@ bool artdaq::SharedMemoryEventReceiver::ReadyForRead(bool broadcast, size_t time
 		}
 
 		time_diff = TimeUtils::gettimeofday_us() - start_time;
-		auto sleep_time = time_diff;
-		if (sleep_time < 10000) sleep_time = 10000;
-		if (sleep_time > max_sleep) sleep_time = max_sleep;
-		usleep(sleep_time);
 	}
 	TLOG(TLVL_DEBUG + 33) << "ReadyForRead returning false";
 	return false;
 }
 
-artdaq::detail::RawEventHeader* artdaq::SharedMemoryEventReceiver::ReadHeader(bool& err)
+artdaq::detail::RawEventHeader* artdaq::SharedMemoryEventReceiver::readHeader_(ReadState& state, bool& err)
 {
 	TLOG(TLVL_DEBUG + 33) << "ReadHeader BEGIN";
-	if (current_read_buffer_ != -1 && (current_data_source_ != nullptr))
+	if (state.current_read_buffer != -1 && (state.current_data_source != nullptr))
 	{
-		err = !current_data_source_->CheckBuffer(current_read_buffer_, SharedMemoryManager::BufferSemaphoreFlags::Reading);
+		err = !state.current_data_source->CheckBuffer(state.current_read_buffer, SharedMemoryManager::BufferSemaphoreFlags::Reading);
 		if (err)
 		{
 			TLOG(TLVL_WARNING) << "Buffer was in incorrect state, resetting";
-			current_data_source_ = nullptr;
-			current_read_buffer_ = -1;
-			current_header_ = nullptr;
+			resetReadState_(state);
 			return nullptr;
 		}
 	}
 	TLOG(TLVL_DEBUG + 33) << "Already have buffer, returning stored header";
-	return current_header_;
+	return state.current_header;
 }
 
-std::set<artdaq::Fragment::type_t> artdaq::SharedMemoryEventReceiver::GetFragmentTypes(bool& err)
+std::set<artdaq::Fragment::type_t> artdaq::SharedMemoryEventReceiver::getFragmentTypes_(ReadState& state, bool& err)
 {
-	if (current_read_buffer_ == -1 || (current_header_ == nullptr) || (current_data_source_ == nullptr))
+	if (state.current_read_buffer == -1 || (state.current_header == nullptr) || (state.current_data_source == nullptr))
 	{
 		throw cet::exception("AccessViolation") << "Cannot call GetFragmentTypes when not currently reading a buffer! Call ReadHeader() first!";  // NOLINT(cert-err60-cpp)
 	}
 
-	err = !current_data_source_->CheckBuffer(current_read_buffer_, SharedMemoryManager::BufferSemaphoreFlags::Reading);
+	err = !state.current_data_source->CheckBuffer(state.current_read_buffer, SharedMemoryManager::BufferSemaphoreFlags::Reading) || !state.fragment_index_complete;
 	if (err)
 	{
 		return std::set<Fragment::type_t>();
 	}
 
-	current_data_source_->ResetReadPos(current_read_buffer_);
-	current_data_source_->IncrementReadPos(current_read_buffer_, sizeof(detail::RawEventHeader));
 	auto output = std::set<Fragment::type_t>();
+	for (auto const& entry : state.fragment_index)
+	{
+		output.insert(entry.type);
+	}
 
-	while (current_data_source_->MoreDataInBuffer(current_read_buffer_))
+	return output;
+}
+
+std::unique_ptr<artdaq::Fragments> artdaq::SharedMemoryEventReceiver::getFragmentsByType_(ReadState& state, bool& err, Fragment::type_t type)
+{
+	if ((state.current_data_source == nullptr) || (state.current_header == nullptr) || state.current_read_buffer == -1)
 	{
-		err = !current_data_source_->CheckBuffer(current_read_buffer_, SharedMemoryManager::BufferSemaphoreFlags::Reading);
-		if (err)
+		throw cet::exception("AccessViolation") << "Cannot call GetFragmentsByType when not currently reading a buffer! Call ReadHeader() first!";  // NOLINT(cert-err60-cpp)
+	}
+	err = !state.current_data_source->CheckBuffer(state.current_read_buffer, SharedMemoryManager::BufferSemaphoreFlags::Reading) || !state.fragment_index_complete;
+	if (err)
+	{
+		return nullptr;
+	}
+
+	auto buffer_start = static_cast<uint8_t*>(state.current_data_source->GetBufferStart(state.current_read_buffer));
+	std::unique_ptr<Fragments> output(new Fragments());
+
+	for (auto const& entry : state.fragment_index)
+	{
+		if (entry.type == type || type == Fragment::InvalidFragmentType)
 		{
-			return std::set<Fragment::type_t>();
+			output->emplace_back(entry.word_count - detail::RawFragmentHeader::num_words());
+			memcpy(output->back().headerAddress(), buffer_start + entry.offset, entry.word_count * sizeof(RawDataType));  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+			output->back().autoResize();
 		}
-		auto fragHdr = reinterpret_cast<artdaq::detail::RawFragmentHeader*>(current_data_source_->GetReadPos(current_read_buffer_));  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
-		output.insert(fragHdr->type);
-		current_data_source_->IncrementReadPos(current_read_buffer_, fragHdr->word_count * sizeof(RawDataType));
 	}
 
 	return output;
 }
 
-std::unique_ptr<artdaq::Fragments> artdaq::SharedMemoryEventReceiver::GetFragmentsByType(bool& err, Fragment::type_t type)
+artdaq::FragmentViews artdaq::SharedMemoryEventReceiver::getFragmentViewsByType_(ReadState& state, bool& err, Fragment::type_t type)
 {
-	if ((current_data_source_ == nullptr) || (current_header_ == nullptr) || current_read_buffer_ == -1)
+	if ((state.current_data_source == nullptr) || (state.current_header == nullptr) || state.current_read_buffer == -1)
 	{
-		throw cet::exception("AccessViolation") << "Cannot call GetFragmentsByType when not currently reading a buffer! Call ReadHeader() first!";  // NOLINT(cert-err60-cpp)
+		throw cet::exception("AccessViolation") << "Cannot call GetFragmentViewsByType when not currently reading a buffer! Call ReadHeader() first!";  // NOLINT(cert-err60-cpp)
 	}
-	err = !current_data_source_->CheckBuffer(current_read_buffer_, SharedMemoryManager::BufferSemaphoreFlags::Reading);
+	err = !state.current_data_source->CheckBuffer(state.current_read_buffer, SharedMemoryManager::BufferSemaphoreFlags::Reading) || !state.fragment_index_complete;
 	if (err)
 	{
-		return nullptr;
+		return FragmentViews();
 	}
 
-	current_data_source_->ResetReadPos(current_read_buffer_);
-	current_data_source_->IncrementReadPos(current_read_buffer_, sizeof(detail::RawEventHeader));
+	auto buffer_start = static_cast<uint8_t*>(state.current_data_source->GetBufferStart(state.current_read_buffer));
+	FragmentViews output;
 
-	std::unique_ptr<Fragments> output(new Fragments());
+	for (auto const& entry : state.fragment_index)
+	{
+		if (entry.type == type || type == Fragment::InvalidFragmentType)
+		{
+			output.emplace_back(reinterpret_cast<RawDataType const*>(buffer_start + entry.offset), &state.buffer_generation);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		}
+	}
+
+	return output;
+}
 
-	while (current_data_source_->MoreDataInBuffer(current_read_buffer_))
+void artdaq::SharedMemoryEventReceiver::buildFragmentIndex_(ReadState& state)
+{
+	// The buffer is owned by this reader until ReleaseBuffer, so walk it once in place, without the per-call locking of the read position accessors
+	state.fragment_index.clear();
+	state.fragment_index_complete = true;
+
+	auto buffer_start = static_cast<uint8_t*>(state.current_data_source->GetBufferStart(state.current_read_buffer));
+	size_t end = state.current_data_source->BufferDataSize(state.current_read_buffer);
+	size_t offset = sizeof(detail::RawEventHeader);
+
+	if (state.current_header->version == detail::RawEventHeader::DIRECTORY_VERSION && offset + sizeof(detail::RawEventDirectory) <= end)
 	{
-		err = !current_data_source_->CheckBuffer(current_read_buffer_, SharedMemoryManager::BufferSemaphoreFlags::Reading);
-		if (err)
+		// The producer listed the Fragments, so they can be indexed without touching their headers
+		auto dir = reinterpret_cast<detail::RawEventDirectory const*>(buffer_start + offset);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		offset += dir->sizeBytes();
+		if (dir->fragment_count > dir->capacity || offset > end)
 		{
-			return nullptr;
+			TLOG(TLVL_WARNING) << "Fragment directory in buffer " << state.current_read_buffer << " is invalid (capacity " << dir->capacity << ", count " << dir->fragment_count << ", data size " << end << "), ignoring the event";
+			state.fragment_index_complete = false;
+			return;
 		}
-		auto fragHdr = reinterpret_cast<artdaq::detail::RawFragmentHeader*>(current_data_source_->GetReadPos(current_read_buffer_));  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
-		if (fragHdr->type == type || type == Fragment::InvalidFragmentType)
+		auto fragments_start = offset;
+		for (uint32_t ii = 0; ii < dir->fragment_count; ++ii)
 		{
-			output->emplace_back(fragHdr->word_count - detail::RawFragmentHeader::num_words());
-			current_data_source_->Read(current_read_buffer_, output->back().headerAddress(), fragHdr->word_count * sizeof(RawDataType));
-			output->back().autoResize();
+			auto const& dir_entry = dir->entries()[ii];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+			size_t entry_offset = dir_entry.offset_words * sizeof(RawDataType);
+			size_t entry_end = entry_offset + dir_entry.word_count * sizeof(RawDataType);
+			if (entry_offset < fragments_start || dir_entry.word_count < detail::RawFragmentHeader::num_words() || entry_end > end)
+			{
+				TLOG(TLVL_WARNING) << "Fragment directory entry " << ii << " in buffer " << state.current_read_buffer << " (offset " << entry_offset << ", " << dir_entry.word_count << " words) is outside the event data (size " << end << "), ignoring the rest of the event";
+				state.fragment_index_complete = false;
+				return;
+			}
+			FragmentIndexEntry entry;
+			entry.offset = entry_offset;
+			entry.type = dir_entry.type;
+			entry.fragment_id = dir_entry.fragment_id;
+			entry.sequence_id = state.current_header->sequence_id;
+			entry.word_count = dir_entry.word_count;
+			state.fragment_index.push_back(entry);
+			offset = std::max(offset, entry_end);
 		}
-		else
+	}
+
+	// Walk the headers of any Fragments not listed in a directory
+	while (offset + sizeof(detail::RawFragmentHeader) <= end)
+	{
+		auto fragHdr = reinterpret_cast<artdaq::detail::RawFragmentHeader*>(buffer_start + offset);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		size_t size = fragHdr->word_count * sizeof(RawDataType);
+		if (fragHdr->word_count < detail::RawFragmentHeader::num_words() || offset + size > end)
 		{
-			current_data_source_->IncrementReadPos(current_read_buffer_, fragHdr->word_count * sizeof(RawDataType));
+			TLOG(TLVL_WARNING) << "Fragment of size " << fragHdr->word_count << " words at offset " << offset << " overruns buffer " << state.current_read_buffer << " (data size " << end << "), ignoring the rest of the event";
+			state.fragment_index_complete = false;
+			break;
 		}
+		FragmentIndexEntry entry;
+		entry.offset = offset;
+		entry.type = fragHdr->type;
+		entry.fragment_id = fragHdr->fragment_id;
+		entry.sequence_id = fragHdr->sequence_id;
+		entry.word_count = fragHdr->word_count;
+		state.fragment_index.push_back(entry);
+		offset += size;
 	}
+	TLOG(TLVL_DEBUG + 33) << "Indexed " << state.fragment_index.size() << " Fragments in buffer " << state.current_read_buffer;
+}
 
-	return output;
+bool artdaq::SharedMemoryEventReceiver::indexHasInterest_(ReadState const& state) const
+{
+	return std::any_of(state.fragment_index.begin(), state.fragment_index.end(), [&](FragmentIndexEntry const& entry) { return type_interest_[entry.type]; });
+}
+
+void artdaq::SharedMemoryEventReceiver::resetReadState_(ReadState& state)
+{
+	++state.buffer_generation;
+	state.fragment_index.clear();
+	state.fragment_index_complete = false;
+	state.current_read_buffer = -1;
+	state.current_header = nullptr;
+	state.current_data_source = nullptr;
+}
+
+int artdaq::SharedMemoryEventReceiver::claimDataBuffer_()
+{
+	auto buf = data_.GetBufferForReading();
+	if (buf == -1 || lookahead_ == 0) return buf;
+
+	// If the buffer is also in the lookahead queue, that claim was lost to the buffer timeout and this one replaces it.
+	// The manager ID is the same, so CheckBuffer alone cannot tell the two claims apart.
+	std::lock_guard<std::mutex> lk(lookahead_mutex_);
+	auto stale = std::find_if(pending_buffers_.begin(), pending_buffers_.end(), [buf](std::pair<int, size_t> const& pending) { return pending.first == buf; });
+	if (stale != pending_buffers_.end())
+	{
+		TLOG(TLVL_WARNING) << "Lookahead buffer " << buf << " was reset and claimed again, dropping its old entry";
+		pending_buffers_.erase(stale);
+	}
+	return buf;
+}
+
+int artdaq::SharedMemoryEventReceiver::nextPendingBuffer_()
+{
+	std::lock_guard<std::mutex> lk(lookahead_mutex_);
+	while (!pending_buffers_.empty())
+	{
+		auto buf = pending_buffers_.front().first;
+		auto sequence_id = pending_buffers_.front().second;
+		pending_buffers_.pop_front();
+
+		// A claimed buffer may have been taken back if it was held past the buffer timeout, and then reused
+		if (data_.CheckBuffer(buf, SharedMemoryManager::BufferSemaphoreFlags::Reading) && data_.GetBufferSequenceID(buf) == sequence_id)
+		{
+			TLOG(TLVL_DEBUG + 33) << "nextPendingBuffer_: Using lookahead buffer " << buf << ", " << pending_buffers_.size() << " remaining";
+			return buf;
+		}
+		TLOG(TLVL_WARNING) << "Lookahead buffer " << buf << " is no longer owned by this reader, skipping it";
+	}
+	return -1;
+}
+
+void artdaq::SharedMemoryEventReceiver::fillLookahead_()
+{
+	if (lookahead_ == 0) return;
+	while (GetLookaheadCount() < lookahead_ && data_.ReadyForRead())
+	{
+		auto buf = claimDataBuffer_();
+		if (buf == -1)
+		{
+			break;
+		}
+		{
+			std::lock_guard<std::mutex> lk(lookahead_mutex_);
+			pending_buffers_.emplace_back(buf, data_.GetBufferSequenceID(buf));
+		}
+		prefetchEvent_(buf);
+	}
+}
+
+void artdaq::SharedMemoryEventReceiver::touchPendingBuffers_()
+{
+	// Claimed buffers wait in the lookahead queue while earlier events are processed, so keep them from timing out
+	if (lookahead_ == 0) return;
+	std::lock_guard<std::mutex> lk(lookahead_mutex_);
+	for (auto const& pending : pending_buffers_)
+	{
+		data_.TouchBuffer(pending.first);
+	}
+}
+
+void artdaq::SharedMemoryEventReceiver::prefetchEvent_(int buffer)
+{
+	// Pull the RawEventHeader and the start of the Fragment directory (or first Fragment headers) into cache while the current event is processed
+	constexpr size_t cache_line_size = 64;
+	constexpr size_t prefetch_bytes = 4 * cache_line_size;
+	auto start = static_cast<uint8_t const*>(data_.GetBufferStart(buffer));
+	auto size = std::min(data_.BufferDataSize(buffer), prefetch_bytes);
+	for (size_t offset = 0; offset < size; offset += cache_line_size)
+	{
+		__builtin_prefetch(start + offset);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
 }
 
 std::string artdaq::SharedMemoryEventReceiver::printBuffers_(SharedMemoryManager* data_source)
@@ -187,7 +432,7 @@ std::string artdaq::SharedMemoryEventReceiver::printBuffers_(SharedMemoryManager
 
 		void* data_ptr = data_source->GetBufferStart(ii);
 		void* end_ptr = static_cast<uint8_t*>(data_ptr) + data_source->BufferDataSize(ii);
-		data_ptr = static_cast<uint8_t*>(data_ptr) + sizeof(detail::RawEventHeader);
+		data_ptr = static_cast<uint8_t*>(data_ptr) + detail::RawEventDirectory::FragmentsOffset(data_ptr);
 		TLOG_DEBUG(33) << "Buffer " << ii << ": data_ptr: " << data_ptr << ", end_ptr: " << end_ptr;
 
 		while (data_ptr < end_ptr)
@@ -224,14 +469,14 @@ std::string artdaq::SharedMemoryEventReceiver::toString()
 	return ostr.str();
 }
 
-void artdaq::SharedMemoryEventReceiver::ReleaseBuffer()
+void artdaq::SharedMemoryEventReceiver::releaseBuffer_(ReadState& state)
 {
 	TLOG(TLVL_DEBUG + 33) << "ReleaseBuffer BEGIN";
 	try
 	{
-		if (current_data_source_ != nullptr)
+		if (state.current_data_source != nullptr)
 		{
-			current_data_source_->MarkBufferEmpty(current_read_buffer_, false, false);
+			state.current_data_source->MarkBufferEmpty(state.current_read_buffer, false, false);
 		}
 	}
 	catch (cet::exception const& e)
@@ -242,8 +487,6 @@ void artdaq::SharedMemoryEventReceiver::ReleaseBuffer()
 	{
 		TLOG(TLVL_ERROR) << "An unknown exception occured while trying to release the buffer";
 	}
-	current_read_buffer_ = -1;
-	current_header_ = nullptr;
-	current_data_source_ = nullptr;
+	resetReadState_(state);
 	TLOG(TLVL_DEBUG + 33) << "ReleaseBuffer END";
 }
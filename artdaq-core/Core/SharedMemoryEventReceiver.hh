@@ -1,25 +1,39 @@
 #ifndef artdaq_core_Core_SharedMemoryEventReceiver_hh
 #define artdaq_core_Core_SharedMemoryEventReceiver_hh 1
 
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <utility>
+#include <vector>
 
 #include "artdaq-core/Core/SharedMemoryManager.hh"
 #include "artdaq-core/Data/Fragment.hh"
+#include "artdaq-core/Data/FragmentView.hh"
 #include "artdaq-core/Data/RawEvent.hh"
 
 namespace artdaq {
 /**
  * \brief SharedMemoryEventReceiver can receive events (as written by SharedMemoryEventManager) from Shared Memory
+ *
+ * The reading methods of SharedMemoryEventReceiver itself use a single current buffer, and must be called from one thread.
+ * To consume events on several threads through one attachment, give each thread its own Cursor (see MakeCursor).
  */
 class SharedMemoryEventReceiver
 {
 public:
+	class Cursor;
+
 	/**
 	 * \brief Connect to a Shared Memory segment using the given parameters
 	 * \param shm_key Key of the Shared Memory segment
 	 * \param broadcast_shm_key Key of the broadcast Shared Memory segment
+	 * \param lookahead (Default 0) Number of Full data buffers to claim ahead of the one being read. Claimed buffers
+	 * are not available to other readers of the segment, so this should be small when several readers share it
 	 */
-	SharedMemoryEventReceiver(uint32_t shm_key, uint32_t broadcast_shm_key);
+	SharedMemoryEventReceiver(uint32_t shm_key, uint32_t broadcast_shm_key, size_t lookahead = 0);
 	/**
 	 * \brief SharedMemoryEventReceiver Destructor
 	 */
@@ -55,6 +69,16 @@ public:
 	 */
 	std::unique_ptr<Fragments> GetFragmentsByType(bool& err, Fragment::type_t type);
 
+	/**
+	 * \brief Get read-only views of the Fragments of a given type in the event, without copying them out of Shared Memory
+	 * \param err Flag used to indicate if an error has occurred
+	 * \param type Type of Fragments to get. (Use InvalidFragmentType to get all Fragments)
+	 * \return FragmentViews pointing into the current read buffer. They are valid until ReleaseBuffer is called
+	 * (and must not outlive the SharedMemoryEventReceiver); debug builds throw if a stale view is used.
+	 * Use FragmentView::toFragment to keep a Fragment past ReleaseBuffer.
+	 */
+	FragmentViews GetFragmentViewsByType(bool& err, Fragment::type_t type);
+
 	/**
 	 * \brief Write out information about the Shared Memory to a string
 	 * \return String containing information about the current Shared Memory buffers
@@ -88,7 +112,40 @@ public:
 	 * \brief Get the count of available buffers, both broadcasts and data
 	 * \return The sum of the available data buffer count and the available broadcast buffer count
 	 */
-	int ReadReadyCount() { return data_.ReadReadyCount() + broadcasts_.ReadReadyCount(); }
+	int ReadReadyCount() { return data_.ReadReadyCount() + broadcasts_.ReadReadyCount() + static_cast<int>(GetLookaheadCount()); }
+
+	/**
+	 * \brief Get the number of data buffers claimed ahead of the ones being read
+	 * \return The number of buffers in the lookahead queue
+	 */
+	size_t GetLookaheadCount() const
+	{
+		std::lock_guard<std::mutex> lk(lookahead_mutex_);
+		return pending_buffers_.size();
+	}
+
+	/**
+	 * \brief Only hand out data events which contain at least one Fragment of the given types; other data events are
+	 * released without being returned by ReadyForRead. Broadcast events are always handed out. Events whose writer
+	 * published its Fragment types (see SharedMemoryManager::AddBufferType) are rejected without reading them.
+	 * Must be called before reading starts, as it is not synchronized with Cursors.
+	 * \param types Fragment types of interest. An empty set (the default) accepts all events
+	 */
+	void SetFragmentTypeInterest(std::set<Fragment::type_t> const& types);
+
+	/**
+	 * \brief Get the number of data events which were released because they contained none of the Fragment types of interest
+	 * \return The number of filtered events
+	 */
+	size_t GetFilteredEventCount() const { return filtered_events_.load(); }
+
+	/**
+	 * \brief Create an independent reading position on this receiver, for use by one worker thread.
+	 * Cursors on the same receiver may be used concurrently; they share the attachments to the data and broadcast
+	 * segments (and so the manager ID) and the lookahead queue, and each holds at most one buffer at a time.
+	 * \return The new Cursor, which must not outlive the receiver. Destroying it releases its buffer
+	 */
+	std::unique_ptr<Cursor> MakeCursor();
 
 	/**
 	 * \brief Get the size of the data buffer
@@ -102,15 +159,130 @@ private:
 	SharedMemoryEventReceiver& operator=(SharedMemoryEventReceiver const&) = delete;
 	SharedMemoryEventReceiver& operator=(SharedMemoryEventReceiver&&) = delete;
 
+	/**
+	 * \brief Location and identity of one Fragment in the current read buffer
+	 */
+	struct FragmentIndexEntry
+	{
+		size_t offset;                        ///< Byte offset of the RawFragmentHeader from the start of the buffer
+		Fragment::type_t type;                ///< Type of the Fragment
+		Fragment::fragment_id_t fragment_id;  ///< Fragment ID of the Fragment
+		Fragment::sequence_id_t sequence_id;  ///< Sequence ID of the Fragment
+		size_t word_count;                    ///< Size of the Fragment, in RawDataType words
+	};
+
+	/**
+	 * \brief The buffer a reader (the receiver itself, or a Cursor) is working on
+	 */
+	struct ReadState
+	{
+		int current_read_buffer{-1};                     ///< Buffer being read, or -1
+		detail::RawEventHeader* current_header{nullptr};  ///< Event header in the current buffer
+		SharedMemoryManager* current_data_source{nullptr};  ///< Segment the current buffer belongs to
+		uint64_t buffer_generation{0};                    ///< Incremented whenever the current buffer is given up, invalidating FragmentViews into it
+		std::vector<FragmentIndexEntry> fragment_index;   ///< Built once per acquired buffer, answers all type queries
+		bool fragment_index_complete{false};              ///< False if the buffer contained a malformed Fragment, which ends the index
+	};
+
 	std::string printBuffers_(SharedMemoryManager* data_source);
+	bool readyForRead_(ReadState& state, bool broadcast, size_t timeout_us);
+	detail::RawEventHeader* readHeader_(ReadState& state, bool& err);
+	std::set<Fragment::type_t> getFragmentTypes_(ReadState& state, bool& err);
+	std::unique_ptr<Fragments> getFragmentsByType_(ReadState& state, bool& err, Fragment::type_t type);
+	FragmentViews getFragmentViewsByType_(ReadState& state, bool& err, Fragment::type_t type);
+	void releaseBuffer_(ReadState& state);
+	void buildFragmentIndex_(ReadState& state);
+	bool indexHasInterest_(ReadState const& state) const;
+	void resetReadState_(ReadState& state);
+	int claimDataBuffer_();
+	int nextPendingBuffer_();
+	void fillLookahead_();
+	void touchPendingBuffers_();
+	void prefetchEvent_(int buffer);
 
-	int current_read_buffer_;
-	bool initialized_;
-	detail::RawEventHeader* current_header_;
-	SharedMemoryManager* current_data_source_;
+	ReadState state_;
+	std::atomic<bool> initialized_;
+	bool type_filter_;
+	SharedMemoryManager::BufferTypeMask type_interest_;
+	std::atomic<size_t> filtered_events_;
+	size_t lookahead_;
+	mutable std::mutex lookahead_mutex_;
+	std::deque<std::pair<int, size_t>> pending_buffers_;  // Data buffers claimed for reading (oldest first) which have not been handed out yet, with their sequence IDs
 	SharedMemoryManager data_;
 	SharedMemoryManager broadcasts_;
 };
+
+/**
+ * \brief An independent reading position on a SharedMemoryEventReceiver, used by one thread.
+ * Its methods behave like the SharedMemoryEventReceiver methods of the same names.
+ */
+class SharedMemoryEventReceiver::Cursor
+{
+public:
+	/**
+	 * \brief Create a Cursor on the given receiver (see SharedMemoryEventReceiver::MakeCursor)
+	 * \param receiver The receiver to read from
+	 */
+	explicit Cursor(SharedMemoryEventReceiver& receiver)
+	    : receiver_(receiver) {}
+
+	/**
+	 * \brief Cursor Destructor. Releases the buffer being read, if any
+	 */
+	~Cursor() { ReleaseBuffer(); }
+
+	/**
+	 * \brief Determine whether an event is available for reading by this Cursor
+	 * \param broadcast (Default false) Whether to wait for a broadcast buffer only
+	 * \param timeout_us (Default 1000000) Time to wait for buffer to become available.
+	 * \return Whether an event is available for reading
+	 */
+	bool ReadyForRead(bool broadcast = false, size_t timeout_us = 1000000) { return receiver_.readyForRead_(state_, broadcast, timeout_us); }
+
+	/**
+	 * \brief Get the Event header
+	 * \param err Flag used to indicate if an error has occurred
+	 * \return Pointer to RawEventHeader from buffer
+	 */
+	detail::RawEventHeader* ReadHeader(bool& err) { return receiver_.readHeader_(state_, err); }
+
+	/**
+	 * \brief Get a set of Fragment Types present in the event
+	 * \param err Flag used to indicate if an error has occurred
+	 * \return std::set of Fragment::type_t of all Fragment types in the event
+	 */
+	std::set<Fragment::type_t> GetFragmentTypes(bool& err) { return receiver_.getFragmentTypes_(state_, err); }
+
+	/**
+	 * \brief Get a pointer to the Fragments of a given type in the event
+	 * \param err Flag used to indicate if an error has occurred
+	 * \param type Type of Fragments to get. (Use InvalidFragmentType to get all Fragments)
+	 * \return std::unique_ptr to a Fragments object containing returned Fragment objects
+	 */
+	std::unique_ptr<Fragments> GetFragmentsByType(bool& err, Fragment::type_t type) { return receiver_.getFragmentsByType_(state_, err, type); }
+
+	/**
+	 * \brief Get read-only views of the Fragments of a given type in the event
+	 * \param err Flag used to indicate if an error has occurred
+	 * \param type Type of Fragments to get. (Use InvalidFragmentType to get all Fragments)
+	 * \return FragmentViews pointing into the buffer. They are valid until ReleaseBuffer is called, and must not outlive the Cursor
+	 */
+	FragmentViews GetFragmentViewsByType(bool& err, Fragment::type_t type) { return receiver_.getFragmentViewsByType_(state_, err, type); }
+
+	/**
+	 * \brief Release the buffer being read by this Cursor to the Empty state
+	 */
+	void ReleaseBuffer() { receiver_.releaseBuffer_(state_); }
+
+private:
+	Cursor(Cursor const&) = delete;
+	Cursor(Cursor&&) = delete;
+	Cursor& operator=(Cursor const&) = delete;
+	Cursor& operator=(Cursor&&) = delete;
+
+	SharedMemoryEventReceiver& receiver_;
+	ReadState state_;
+};
 }  // namespace artdaq
 
 #endif /* artdaq_core_Core_SharedMemoryEventReceiver_hh */
@@ -3,8 +3,8 @@
 #include "artdaq-core/Core/SharedMemoryFragmentManager.hh"
 #include "TRACE/tracemf.h"
 
-artdaq::SharedMemoryFragmentManager::SharedMemoryFragmentManager(uint32_t shm_key, size_t buffer_count, size_t max_buffer_size, size_t buffer_timeout_us)
-    : SharedMemoryManager(shm_key, buffer_count, max_buffer_size, buffer_timeout_us)
+artdaq::SharedMemoryFragmentManager::SharedMemoryFragmentManager(uint32_t shm_key, size_t buffer_count, size_t max_buffer_size, size_t buffer_timeout_us, SharedMemoryOptions const& options)
+    : SharedMemoryManager(shm_key, buffer_count, max_buffer_size, buffer_timeout_us, true, options)
     , active_buffer_(-1)
 {
 }
@@ -35,30 +35,27 @@ int artdaq::SharedMemoryFragmentManager::WriteFragment(Fragment&& fragment, bool
 	}
 
 	auto waitStart = std::chrono::steady_clock::now();
-	while (!ReadyForWrite(overwrite) && TimeUtils::GetElapsedTimeMicroseconds(waitStart) < 1000)
+	while (!ReadyForWrite(overwrite))
 	{
-		// BURN THAT CPU!
-	}
-	if (!ReadyForWrite(overwrite))
-	{
-		int64_t loopCount = 0;
-		size_t sleepTime = 1000;  // microseconds
-		int64_t nloops = (timeout_us - 1000) / sleepTime;
+		// Timeout only applies in overwrite mode; otherwise wake periodically to check for end-of-data
+		size_t wait_us = 1000000;
+		if (overwrite && timeout_us > 0)
+		{
+			auto elapsed = TimeUtils::GetElapsedTimeMicroseconds(waitStart);
+			if (elapsed >= timeout_us) break;
+			wait_us = timeout_us - elapsed;
+		}
 
-		while (!ReadyForWrite(overwrite) && (!overwrite || timeout_us == 0 || loopCount < nloops))
+		active_buffer_ = WaitForBufferForWriting(wait_us, overwrite);
+		if (active_buffer_ == -1 && (!IsValid() || IsEndOfData()))
 		{
-			if (!IsValid() || IsEndOfData())
+			TLOG(TLVL_WARNING) << "WriteFragment: Shared memory is not connected! Attempting reconnect...";
+			auto sts = Attach(timeout_us);
+			if (!sts)
 			{
-				TLOG(TLVL_WARNING) << "WriteFragment: Shared memory is not connected! Attempting reconnect...";
-				auto sts = Attach(timeout_us);
-				if (!sts)
-				{
-					return -1;
-				}
-				TLOG(TLVL_INFO) << "WriteFragment: Shared memory was successfully reconnected";
+				return -1;
 			}
-			usleep(sleepTime);
-			++loopCount;
+			TLOG(TLVL_INFO) << "WriteFragment: Shared memory was successfully reconnected";
 		}
 	}
 	if (!ReadyForWrite(overwrite))
@@ -75,12 +72,14 @@ int artdaq::SharedMemoryFragmentManager::WriteFragment(Fragment&& fragment, bool
 	if (sts == fragSize)
 	{
 		TLOG(TLVL_DEBUG + 41) << "Done sending Fragment with seqID=" << fragment.sequenceID() << " using buffer " << active_buffer_;
+		AddBufferType(active_buffer_, fragment.type());
 		MarkBufferFull(active_buffer_);
 		active_buffer_ = -1;
 		return 0;
 	}
-	active_buffer_ = -1;
 	TLOG(TLVL_ERROR) << "Unexpected status from SharedMemory Write call!";
+	MarkBufferEmpty(active_buffer_, true);  // Give the buffer back instead of leaving it in the Writing state
+	active_buffer_ = -1;
 	return -2;
 }
 
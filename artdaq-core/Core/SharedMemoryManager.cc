@@ -1,12 +1,25 @@
 #define TRACE_NAME "SharedMemoryManager"
-#include <sys/ipc.h>
-#include <sys/shm.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <list>
 #include <unordered_map>
-#ifndef SHM_DEST  // Lynn reports that this is missing on Mac OS X?!?
-#define SHM_DEST 01000
-#endif
 #include <csignal>
 #include "TRACE/tracemf.h"
 #include "artdaq-core/Core/SharedMemoryManager.hh"
@@ -27,12 +40,26 @@
 #define TLVL_WRITE 53
 #define TLVL_READ 54
 #define TLVL_CHKBUFFER 55
+#define TLVL_REAPER 56
+
+// ready_magic is written last by the owner, once the segment is initialized. Segments created with the original
+// packed layout carry SHM_LEGACY_READY_MAGIC at byte offset SHM_LEGACY_READY_MAGIC_OFFSET instead; the current
+// layout never stores that value there, so such segments can be told apart and rejected.
+// SHM_LAYOUT_VERSION must be bumped with every change to ShmStruct or ShmBuffer. Version 2 (the cache-line-aligned
+// layout) was not bumped when the placement options, the attach count and end-of-data flag, and the coarse touch clock
+// were added, so segments of those versions also carry their header and record sizes since version 12.
+static constexpr unsigned SHM_READY_MAGIC = 0xCAFE2222;
+static constexpr uint32_t SHM_LAYOUT_VERSION = 13;
+static constexpr unsigned SHM_LEGACY_READY_MAGIC = 0xCAFE1111;
+static constexpr size_t SHM_LEGACY_READY_MAGIC_OFFSET = 68;
 
 static std::list<artdaq::SharedMemoryManager const*> instances = std::list<artdaq::SharedMemoryManager const*>();
 
 static std::unordered_map<int, struct sigaction> old_actions = std::unordered_map<int, struct sigaction>();
 static bool sighandler_init = false;
 static std::mutex sighandler_mutex;
+static volatile sig_atomic_t in_signal_handler = 0;  // Detach must not block or notify while the signal handler runs
+static thread_local artdaq::SharedMemoryManager const* reaper_of = nullptr;  // Manager whose reaper runs on this thread, if any
 
 static void signal_handler(int signum)
 {
@@ -43,6 +70,7 @@ static void signal_handler(int signum)
 	TRACE_STREAMER(TLVL_ERROR, TLOG2("SharedMemoryManager", 0), 0)
 #endif
 	    << "A signal of type " << signum << " was caught by SharedMemoryManager. Detaching all Shared Memory segments, then proceeding with default handlers!";
+	in_signal_handler = 1;
 	for (auto ii : instances)
 	{
 		if (ii != nullptr)
@@ -54,6 +82,7 @@ static void signal_handler(int signum)
 		}
 		ii = nullptr;
 	}
+	in_signal_handler = 0;
 
 	sigset_t set;
 	pthread_sigmask(SIG_UNBLOCK, nullptr, &set);
@@ -68,17 +97,126 @@ static void signal_handler(int signum)
 	sigaction(signum, &old_actions[signum], nullptr);
 }
 
-artdaq::SharedMemoryManager::SharedMemoryManager(uint32_t shm_key, size_t buffer_count, size_t buffer_size, uint64_t buffer_timeout_us, bool destructive_read_mode)
-    : shm_segment_id_(-1)
-    , shm_ptr_(nullptr)
+// Copy with non-temporal stores, so that a large payload does not evict the writer's working set from its cache.
+// The reader is usually another process on another core, which would not hit in this core's cache anyway.
+static void stream_copy(void* dest, void const* src, size_t size)
+{
+#ifdef __SSE2__
+	auto d = static_cast<uint8_t*>(dest);
+	auto s = static_cast<uint8_t const*>(src);
+	size_t head = (16 - reinterpret_cast<uintptr_t>(d) % 16) % 16;  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	if (head > size) head = size;
+	memcpy(d, s, head);
+	d += head;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	s += head;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	size -= head;
+
+	for (; size >= 64; size -= 64, d += 64, s += 64)  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	{
+		auto in = reinterpret_cast<__m128i const*>(s);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+		auto out = reinterpret_cast<__m128i*>(d);       // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+		auto a = _mm_loadu_si128(in);
+		auto b = _mm_loadu_si128(in + 1);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		auto c = _mm_loadu_si128(in + 2);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		auto e = _mm_loadu_si128(in + 3);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		_mm_stream_si128(out, a);
+		_mm_stream_si128(out + 1, b);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		_mm_stream_si128(out + 2, c);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		_mm_stream_si128(out + 3, e);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+	memcpy(d, s, size);
+	_mm_sfence();  // Order the streaming stores before the buffer is marked Full
+#else
+	memcpy(dest, src, size);
+#endif
+}
+
+// Start time of a process (field 22 of /proc/<pid>/stat, in clock ticks since boot), which together with the PID
+// identifies the process even if the PID is later reused. 0 if it cannot be read.
+static uint64_t process_start_time(pid_t pid)
+{
+	char path[32];
+	snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	char line[1024];
+	auto length = read(fd, line, sizeof(line) - 1);
+	close(fd);
+	if (length <= 0)
+	{
+		return 0;
+	}
+	line[length] = '\0';
+	// The command name (field 2) may contain spaces, so count fields from the closing parenthesis
+	char* field = strrchr(line, ')');
+	if (field == nullptr)
+	{
+		return 0;
+	}
+	for (int ii = 2; ii < 22; ++ii)
+	{
+		field = strchr(field + 1, ' ');
+		if (field == nullptr)
+		{
+			return 0;
+		}
+	}
+	return strtoull(field + 1, nullptr, 10);
+}
+
+artdaq::SharedMemoryManager::SharedMemoryManager(uint32_t shm_key, size_t buffer_count, size_t buffer_size, uint64_t buffer_timeout_us, bool destructive_read_mode, SharedMemoryOptions const& options)
+    : shm_ptr_(nullptr)
     , shm_key_(shm_key)
     , manager_id_(-1)
     , last_seen_id_(0)
+    , requested_options_(options)
 {
 	requested_shm_parameters_.buffer_count = buffer_count;
 	requested_shm_parameters_.buffer_size = buffer_size;
 	requested_shm_parameters_.buffer_timeout_us = buffer_timeout_us;
 	requested_shm_parameters_.destructive_read_mode = destructive_read_mode;
+	requested_shm_parameters_.dispatch_lanes = destructive_read_mode ? std::min(options.dispatch_lanes, max_dispatch_lanes) : 0;
+	if (options.dispatch_lanes > 0 && !destructive_read_mode)
+	{
+		TLOG(TLVL_WARNING) << "Dispatch tickets are not supported in broadcast mode, every reader sees every buffer";
+	}
+	else if (options.dispatch_lanes > max_dispatch_lanes)
+	{
+		TLOG(TLVL_WARNING) << "Requested " << options.dispatch_lanes << " dispatch lanes, using the maximum of " << max_dispatch_lanes;
+	}
+	requested_shm_parameters_.queue_capacity = options.use_index_queues && destructive_read_mode && requested_shm_parameters_.dispatch_lanes == 0 ? queueCapacity_(buffer_count) : 0;
+	if (options.use_index_queues && !destructive_read_mode)
+	{
+		TLOG(TLVL_WARNING) << "Index queues are not supported in broadcast mode, buffers will be found by scanning";
+	}
+	else if (options.use_index_queues && requested_shm_parameters_.dispatch_lanes > 0)
+	{
+		TLOG(TLVL_WARNING) << "Index queues cannot be combined with dispatch tickets, buffers will be found by scanning";
+	}
+	requested_shm_parameters_.destination_queues = requested_shm_parameters_.queue_capacity > 0 ? std::min(options.destination_queues, max_destination_queues) : 0;
+	if (options.destination_queues > 0 && requested_shm_parameters_.queue_capacity == 0)
+	{
+		TLOG(TLVL_WARNING) << "Destination queues require index queues, buffers sent to a destination will be found by scanning";
+	}
+	else if (options.destination_queues > max_destination_queues)
+	{
+		TLOG(TLVL_WARNING) << "Requested " << options.destination_queues << " destination queues, using the maximum of " << max_destination_queues;
+	}
+	requested_shm_parameters_.reader_cursors = options.reader_cursors && !destructive_read_mode;
+	requested_shm_parameters_.max_cursor_lag = requested_shm_parameters_.reader_cursors ? options.max_cursor_lag : 0;
+	if (options.reader_cursors && destructive_read_mode)
+	{
+		TLOG(TLVL_WARNING) << "Reader cursors only apply to broadcast mode, ignoring them";
+	}
+	size_t min_arena_size = sizeof(ShmArenaRecord) + cacheLineRound_(buffer_size);
+	if (options.arena_size > 0 && options.arena_size < min_arena_size)
+	{
+		TLOG(TLVL_WARNING) << "Arena size " << options.arena_size << " cannot hold a buffer of " << buffer_size << " bytes, increasing it to " << min_arena_size;
+		requested_options_.arena_size = min_arena_size;
+	}
 
 	instances.push_back(this);
 	Attach();
@@ -163,13 +301,22 @@ bool artdaq::SharedMemoryManager::Attach(size_t timeout_usec)
 	size_t timeout_us = timeout_usec > 0 ? timeout_usec : 1000000;
 	auto start_time = std::chrono::steady_clock::now();
 	last_seen_id_ = 0;
-	size_t shmSize = requested_shm_parameters_.buffer_count * (requested_shm_parameters_.buffer_size + sizeof(ShmBuffer)) + sizeof(ShmStruct);
+	size_t shmSize = headerSize_(requested_shm_parameters_.buffer_count, requested_shm_parameters_.queue_capacity, requested_shm_parameters_.destination_queues) + dataSize_(requested_shm_parameters_.buffer_count, requested_shm_parameters_.buffer_size, requested_options_.arena_size);
 
 	auto available = GetAvailableRAM();
 
-	TLOG(TLVL_INFO) << "Requested shared memory size " << PrintBytes(shmSize)
-	                << " (" << requested_shm_parameters_.buffer_count << " buffers * " << PrintBytes(requested_shm_parameters_.buffer_size) << ")"
-	                << ", available RAM " << PrintBytes(available);
+	if (requested_options_.arena_size > 0)
+	{
+		TLOG(TLVL_INFO) << "Requested shared memory size " << PrintBytes(shmSize)
+		                << " (" << requested_shm_parameters_.buffer_count << " buffers sharing a " << PrintBytes(requested_options_.arena_size) << " arena)"
+		                << ", available RAM " << PrintBytes(available);
+	}
+	else
+	{
+		TLOG(TLVL_INFO) << "Requested shared memory size " << PrintBytes(shmSize)
+		                << " (" << requested_shm_parameters_.buffer_count << " buffers * " << PrintBytes(requested_shm_parameters_.buffer_size) << ")"
+		                << ", available RAM " << PrintBytes(available);
+	}
 	if (shmSize > 0.8 * available)
 	{
 		TLOG(TLVL_WARNING) << "Requested shared memory size is greater than 80% of available RAM! Allocation of shared memory will likely fail!";
@@ -182,53 +329,78 @@ bool artdaq::SharedMemoryManager::Attach(size_t timeout_usec)
 		manager_id_ = 0;
 	}
 
-	shm_segment_id_ = shmget(shm_key_, shmSize, 0666);
-	if (shm_segment_id_ == -1)
+	if (!backend_)
+	{
+		backend_ = SharedMemoryBackend::Make(requested_options_.backend);
+	}
+
+	bool created = false;
+	bool opened = backend_->Open(shm_key_, shmSize);
+	if (!opened)
 	{
 		if (manager_id_ == 0)
 		{
-			TLOG(TLVL_ATTACH) << "Creating shared memory segment with key " << std::hex << std::showbase << shm_key_ << " and size " << std::dec << shmSize;
-			shm_segment_id_ = shmget(shm_key_, shmSize, IPC_CREAT | 0666);
+			opened = created = backend_->Create(shm_key_, shmSize, requested_options_.huge_pages);
 
-			if (shm_segment_id_ == -1)
+			if (!created)
 			{
 				TLOG(TLVL_ERROR) << "Error creating shared memory segment with key " << std::hex << std::showbase << shm_key_ << ", errno=" << std::dec << errno << " (" << strerror(errno) << ")";
 			}
 		}
 		else
 		{
-			while (shm_segment_id_ == -1 && TimeUtils::GetElapsedTimeMicroseconds(start_time) < timeout_us)
+			while (!opened && TimeUtils::GetElapsedTimeMicroseconds(start_time) < timeout_us)
 			{
-				shm_segment_id_ = shmget(shm_key_, shmSize, 0666);
+				opened = backend_->Open(shm_key_, shmSize);
 			}
 		}
 	}
-	TLOG(TLVL_ATTACH) << "shm_key == " << std::hex << std::showbase << shm_key_ << ", shm_segment_id == " << std::dec << shm_segment_id_;
+	TLOG(TLVL_ATTACH) << "shm_key == " << std::hex << std::showbase << shm_key_ << ", opened == " << std::boolalpha << opened;
 
-	if (shm_segment_id_ > -1)
+	if (opened)
 	{
+		size_t segmentSize = backend_->Size();
 		TLOG(TLVL_ATTACH)
-		    << "Attached to shared memory segment with ID = " << shm_segment_id_
-		    << " and size " << shmSize
+		    << "Attached to " << backend_->Describe()
+		    << " and size " << segmentSize
 		    << " bytes";
-		shm_ptr_ = static_cast<ShmStruct*>(shmat(shm_segment_id_, nullptr, 0));
+		// The owner binds the segment to its NUMA node before prefaulting it
+		shm_ptr_ = static_cast<ShmStruct*>(backend_->Map(false));
 		TLOG(TLVL_ATTACH)
 		    << "Attached to shared memory segment at address "
 		    << std::hex << std::showbase << static_cast<void*>(shm_ptr_) << std::dec;
-		if ((shm_ptr_ != nullptr) && shm_ptr_ != reinterpret_cast<void*>(-1))  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+		if (shm_ptr_ != nullptr)
 		{
+			if (requested_options_.prefault && (manager_id_ != 0 || requested_options_.numa_node < 0))
+			{
+				prefault_(segmentSize);
+			}
 			if (manager_id_ == 0)
 			{
-				if (shm_ptr_->ready_magic == 0xCAFE1111)
+				bool initialized = shm_ptr_->ready_magic == SHM_READY_MAGIC;
+				bool bound = requested_options_.numa_node >= 0 && bindToNumaNode_(segmentSize, requested_options_.numa_node);
+
+				if (initialized || hasLegacyLayout_())
 				{
 					TLOG(TLVL_WARNING) << "Owner encountered already-initialized Shared Memory! "
-					                   << "Once the system is shut down, you can use one of the following commands "
-					                   << "to clean up this shared memory: 'ipcrm -M " << std::hex << std::showbase << shm_key_
-					                   << "' or 'ipcrm -m " << std::dec << shm_segment_id_ << "'.";
+					                   << "Once the system is shut down, you can use the following command "
+					                   << "to clean up this shared memory: '" << backend_->CleanupCommand() << "'.";
 					// exit(-2);
 				}
+				if (hasLegacyLayout_())
+				{
+					TLOG(TLVL_WARNING) << "Owner is re-initializing a Shared Memory segment created with the old layout";
+					shm_ptr_->writer_count = 0;
+					shm_ptr_->reader_count = 0;
+				}
 				TLOG(TLVL_ATTACH) << "Owner initializing Shared Memory";
+				shm_ptr_->ready_magic = 0;
+				shm_ptr_->layout_version = SHM_LAYOUT_VERSION;
+				shm_ptr_->header_size = sizeof(ShmStruct);
+				shm_ptr_->record_size = sizeof(ShmBuffer);
 				shm_ptr_->next_id = 1;
+				shm_ptr_->attached_count = 0;
+				shm_ptr_->end_of_data = false;
 				shm_ptr_->next_sequence_id = 0;
 				shm_ptr_->reader_pos = 0;
 				shm_ptr_->writer_pos = 0;
@@ -236,6 +408,60 @@ bool artdaq::SharedMemoryManager::Attach(size_t timeout_usec)
 				shm_ptr_->buffer_count = requested_shm_parameters_.buffer_count;
 				shm_ptr_->buffer_timeout_us = requested_shm_parameters_.buffer_timeout_us;
 				shm_ptr_->destructive_read_mode = requested_shm_parameters_.destructive_read_mode;
+				shm_ptr_->queue_capacity = requested_shm_parameters_.queue_capacity;
+				shm_ptr_->destination_queues = requested_shm_parameters_.destination_queues;
+				shm_ptr_->huge_pages = created ? backend_->UsesHugePages() : initialized && shm_ptr_->huge_pages;
+				shm_ptr_->prefault = requested_options_.prefault;
+				shm_ptr_->coarse_touch_clock = requested_options_.touch_clock == SharedMemoryTouchClock::Coarse;
+				shm_ptr_->numa_node = bound ? requested_options_.numa_node : -1;
+				shm_ptr_->reaper_interval_us = shm_ptr_->buffer_timeout_us > 0 ? requested_options_.reaper_interval_us : 0;
+				shm_ptr_->reaper_heartbeat_us = 0;
+				shm_ptr_->reap_count = 0;
+				shm_ptr_->recycle_count = 0;
+				shm_ptr_->arena_size = cacheLineRound_(requested_options_.arena_size);
+				if (shm_ptr_->arena_size > 0)
+				{
+					pthread_mutexattr_t attr;
+					pthread_mutexattr_init(&attr);
+					pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+					pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+					pthread_mutex_init(&shm_ptr_->arena_mutex, &attr);
+					pthread_mutexattr_destroy(&attr);
+					shm_ptr_->arena_head = 0;
+					shm_ptr_->arena_tail = 0;
+				}
+				shm_ptr_->dispatch_lanes = requested_shm_parameters_.dispatch_lanes;
+				shm_ptr_->next_ticket = 0;
+				for (auto& lane : shm_ptr_->lanes)
+				{
+					lane.owner = -1;
+					lane.dispatched = 0;
+					lane.consumed = 0;
+				}
+				shm_ptr_->reader_cursors = requested_shm_parameters_.reader_cursors;
+				shm_ptr_->max_cursor_lag = requested_shm_parameters_.max_cursor_lag;
+				for (auto& cursor : shm_ptr_->cursors)
+				{
+					cursor.owner = -1;
+					cursor.dropped = false;
+					cursor.position = 0;
+					cursor.drops = 0;
+				}
+				for (auto& record : shm_ptr_->managers)
+				{
+					record.pid = 0;
+					record.dead = false;
+					record.reader = false;
+					record.writer = false;
+					record.start_time = 0;
+					record.checked_us = 0;
+				}
+				memset(static_cast<void*>(&shm_ptr_->telemetry), 0, sizeof(shm_ptr_->telemetry));
+				memset(static_cast<void*>(shm_ptr_->manager_telemetry), 0, sizeof(shm_ptr_->manager_telemetry));
+				shm_ptr_->read_futex = 0;
+				shm_ptr_->write_futex = 0;
+				shm_ptr_->read_waiters = 0;
+				shm_ptr_->write_waiters = 0;
 
 				buffer_ptrs_ = std::vector<ShmBuffer*>(shm_ptr_->buffer_count);
 				for (int ii = 0; ii < static_cast<int>(requested_shm_parameters_.buffer_count); ++ii)
@@ -249,15 +475,85 @@ bool artdaq::SharedMemoryManager::Attach(size_t timeout_usec)
 					getBufferInfo_(ii)->readPos = 0;
 					getBufferInfo_(ii)->sem = BufferSemaphoreFlags::Empty;
 					getBufferInfo_(ii)->sem_id = -1;
-					getBufferInfo_(ii)->last_touch_time = TimeUtils::gettimeofday_us();
+					getBufferInfo_(ii)->last_touch_time = touchTime_();
+					getBufferInfo_(ii)->queued = false;
+					getBufferInfo_(ii)->full_destination = -1;
+					memset(getBufferInfo_(ii)->type_mask, 0, sizeof(getBufferInfo_(ii)->type_mask));
+					getBufferInfo_(ii)->ticket = 0;
+					getBufferInfo_(ii)->state_time = 0;
+					getBufferInfo_(ii)->data_offset = 0;
+					getBufferInfo_(ii)->data_capacity = 0;
+				}
+				for (auto& count : shm_ptr_->state_count)
+				{
+					count = 0;
+				}
+				for (auto& count : shm_ptr_->full_count)
+				{
+					count = 0;
+				}
+				shm_ptr_->state_count[static_cast<int>(BufferSemaphoreFlags::Empty)] = shm_ptr_->buffer_count;
+
+				if (shm_ptr_->queue_capacity > 0)
+				{
+					TLOG(TLVL_ATTACH) << "Owner initializing index queues with capacity " << shm_ptr_->queue_capacity;
+					std::vector<ShmIndexQueue*> queues{&shm_ptr_->empty_queue, &shm_ptr_->full_queue};
+					for (size_t destination = 0; destination < shm_ptr_->destination_queues; ++destination)
+					{
+						queues.push_back(&shm_ptr_->destination_queue[destination]);
+					}
+					for (auto queue : queues)
+					{
+						queue->enqueue_pos = 0;
+						queue->dequeue_pos = 0;
+						auto cells = queueCells_(queue);
+						for (size_t ii = 0; ii < shm_ptr_->queue_capacity; ++ii)
+						{
+							cells[ii].sequence = ii;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+						}
+					}
+					for (int ii = 0; ii < shm_ptr_->buffer_count; ++ii)
+					{
+						queueBuffer_(ii);
+					}
+				}
+
+				if (shm_ptr_->prefault && requested_options_.numa_node >= 0)
+				{
+					prefault_(segmentSize);
 				}
 
-				shm_ptr_->ready_magic = 0xCAFE1111;
+				shm_ptr_->ready_magic = SHM_READY_MAGIC;
+				startReaper_();
 			}
 			else
 			{
 				TLOG(TLVL_ATTACH) << "Waiting for owner to initalize Shared Memory";
-				while (shm_ptr_->ready_magic != 0xCAFE1111) { usleep(1000); }
+				while (shm_ptr_->ready_magic != SHM_READY_MAGIC)
+				{
+					if (hasLegacyLayout_())
+					{
+						TLOG(TLVL_ERROR) << "Shared memory segment with key " << std::hex << std::showbase << shm_key_
+						                 << " was created with an older, incompatible layout. Please restart all processes using it, or remove it with '"
+						                 << backend_->CleanupCommand() << "'.";
+						backend_->Unmap(shm_ptr_);
+						backend_->Close();
+						shm_ptr_ = nullptr;
+						return false;
+					}
+					usleep(1000);
+				}
+				if (!layoutMatches_(shm_ptr_))
+				{
+					TLOG(TLVL_ERROR) << "Shared memory segment with key " << std::hex << std::showbase << shm_key_
+					                 << " has layout version " << std::dec << shm_ptr_->layout_version << " (header " << shm_ptr_->header_size << " bytes, records " << shm_ptr_->record_size
+					                 << " bytes), expected " << SHM_LAYOUT_VERSION << " (" << sizeof(ShmStruct) << ", " << sizeof(ShmBuffer)
+					                 << "). All processes attached to a segment must use the same artdaq-core version.";
+					backend_->Unmap(shm_ptr_);
+					backend_->Close();
+					shm_ptr_ = nullptr;
+					return false;
+				}
 				TLOG(TLVL_ATTACH) << "Getting ID from Shared Memory";
 				GetNewId();
 				shm_ptr_->lowest_seq_id_read = 0;
@@ -269,10 +565,23 @@ bool artdaq::SharedMemoryManager::Attach(size_t timeout_usec)
 				{
 					buffer_ptrs_[ii] = reinterpret_cast<ShmBuffer*>(reinterpret_cast<uint8_t*>(shm_ptr_ + 1) + ii * sizeof(ShmBuffer));  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
 				}
+
+				if (shm_ptr_->prefault && !requested_options_.prefault)
+				{
+					prefault_(segmentSize);
+				}
 			}
 
 			// last_seen_id_ = shm_ptr_->next_sequence_id;
 			buffer_mutexes_ = std::vector<std::mutex>(shm_ptr_->buffer_count);
+			write_reservations_ = std::vector<size_t>(shm_ptr_->buffer_count, 0);
+			touch_clock_slack_us_ = shm_ptr_->coarse_touch_clock ? TimeUtils::gettimeofday_coarse_resolution_us() : 0;
+			if (requested_options_.lock_memory)
+			{
+				lockMemory_(segmentSize);
+			}
+			shm_ptr_->attached_count++;
+			recordManager_();
 
 			TLOG(TLVL_ATTACH) << "Initialization Complete: "
 			                  << "key: " << std::hex << std::showbase << shm_key_
@@ -282,8 +591,9 @@ bool artdaq::SharedMemoryManager::Attach(size_t timeout_usec)
 			return true;
 		}
 
-		TLOG(TLVL_ERROR) << "Failed to attach to shared memory segment "
-		                 << shm_segment_id_;
+		TLOG(TLVL_ERROR) << "Failed to attach to " << backend_->Describe()
+		                 << ", errno=" << errno << " (" << strerror(errno) << ")";
+		backend_->Close();
 		return false;
 	}
 
@@ -291,20 +601,83 @@ bool artdaq::SharedMemoryManager::Attach(size_t timeout_usec)
 	                 << ", errno=" << std::dec << errno << " (" << strerror(errno) << ")"
 	                 << ".  Please check "
 	                 << "if a stale shared memory segment needs to "
-	                 << "be cleaned up. (ipcs, ipcrm -m <segId>)";
+	                 << "be cleaned up. (" << backend_->CleanupCommand() << ")";
+	return false;
+}
+
+bool artdaq::SharedMemoryManager::bindToNumaNode_(size_t size, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	// Use the raw system call, so that libnuma is not required
+	constexpr size_t bits = 8 * sizeof(unsigned long);
+	std::vector<unsigned long> mask(node / bits + 1, 0);
+	mask[node / bits] |= 1UL << (node % bits);
+	if (syscall(SYS_mbind, shm_ptr_, size, MPOL_BIND, mask.data(), mask.size() * bits + 1, MPOL_MF_MOVE) != 0)
+	{
+		TLOG(TLVL_WARNING) << "Could not bind shared memory segment with key " << std::hex << std::showbase << shm_key_
+		                   << " to NUMA node " << std::dec << node << ", errno=" << errno << " (" << strerror(errno) << ")";
+		return false;
+	}
+	TLOG(TLVL_ATTACH) << "Bound shared memory segment to NUMA node " << node;
+	return true;
+#else
+	TLOG(TLVL_WARNING) << "NUMA binding is not supported on this platform, ignoring numa_node=" << node;
 	return false;
+#endif
+}
+
+void artdaq::SharedMemoryManager::prefault_(size_t size)
+{
+	prefault_seconds_ = SharedMemoryBackend::Populate(shm_ptr_, size, requested_options_.prefault_threads);
+	TLOG(TLVL_INFO) << "Prefaulted " << size << " bytes of shared memory segment with key " << std::hex << std::showbase << shm_key_
+	                << std::dec << " in " << prefault_seconds_ << " s";
+}
+
+void artdaq::SharedMemoryManager::lockMemory_(size_t size)
+{
+	auto start = std::chrono::steady_clock::now();
+	if (mlock(shm_ptr_, size) != 0)
+	{
+		TLOG(TLVL_WARNING) << "Could not lock " << size << " bytes of shared memory segment with key " << std::hex << std::showbase << shm_key_
+		                   << std::dec << " into memory, errno=" << errno << " (" << strerror(errno) << "). Check RLIMIT_MEMLOCK (ulimit -l); continuing unlocked.";
+		return;
+	}
+	memory_locked_ = true;
+	lock_seconds_ = TimeUtils::GetElapsedTime(start);
+	TLOG(TLVL_INFO) << "Locked " << size << " bytes of shared memory segment with key " << std::hex << std::showbase << shm_key_
+	                << std::dec << " into memory in " << lock_seconds_ << " s";
+}
+
+bool artdaq::SharedMemoryManager::hasLegacyLayout_() const
+{
+	// The old magic location overlaps reader_count, which can never legitimately hold that value
+	static_assert(offsetof(ShmStruct, reader_count) == SHM_LEGACY_READY_MAGIC_OFFSET, "Legacy ready_magic offset must overlap reader_count");
+	return *reinterpret_cast<unsigned const*>(reinterpret_cast<uint8_t const*>(shm_ptr_) + SHM_LEGACY_READY_MAGIC_OFFSET) == SHM_LEGACY_READY_MAGIC;  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+}
+
+bool artdaq::SharedMemoryManager::layoutMatches_(ShmStruct const* shm)
+{
+	// The sizes catch a layout change made without bumping the version
+	return shm->layout_version == SHM_LAYOUT_VERSION && shm->header_size == sizeof(ShmStruct) && shm->record_size == sizeof(ShmBuffer);
 }
 
 int artdaq::SharedMemoryManager::GetBufferForReading()
 {
 	TLOG(TLVL_GETBUFFER) << "GetBufferForReading BEGIN";
 
-	if (!registered_reader_)
+	registerReader_();
+	rejoinCursor_();
+
+	if (UsesIndexQueues())
 	{
-		shm_ptr_->reader_count++;
-		registered_reader_ = true;
+		auto buffer = getQueuedBufferForReading_(touchTime_());
+		if (buffer == -1) countFailedAcquisition_(false);
+		return buffer;
 	}
 
+	auto now = touchTime_();  // One clock read per operation
+	auto reap_inline = !reaperActive_(now);
+	if (reap_inline) probeManagers_(now);
 	std::lock_guard<std::mutex> lk(search_mutex_);
 	// TraceLock lk(search_mutex_, 11, "GetBufferForReadingSearch");
 	auto rp = shm_ptr_->reader_pos.load();
@@ -318,13 +691,14 @@ int artdaq::SharedMemoryManager::GetBufferForReading()
 		int buffer_num = -1;
 		ShmBuffer* buffer_ptr = nullptr;
 		uint64_t seqID = -1;
+		uint64_t busy_seqID = -1;  // Oldest unseen buffer another broadcast reader is reading
 
 		for (auto ii = 0; ii < shm_ptr_->buffer_count; ++ii)
 		{
 			auto buffer = (ii + rp) % shm_ptr_->buffer_count;
 
 			TLOG(TLVL_GETBUFFER + 1) << "GetBufferForReading Checking if buffer " << buffer << " is stale. Shm destructive_read_mode=" << shm_ptr_->destructive_read_mode;
-			ResetBuffer(buffer);
+			if (reap_inline) resetBuffer_(buffer, now);
 
 			auto buf = getBufferInfo_(buffer);
 			if (buf == nullptr)
@@ -337,15 +711,18 @@ int artdaq::SharedMemoryManager::GetBufferForReading()
 
 			TLOG(TLVL_GETBUFFER + 1) << "GetBufferForReading: Buffer " << buffer << ": sem=" << FlagToString(sem)
 			                         << " (expected " << FlagToString(BufferSemaphoreFlags::Full) << "), sem_id=" << sem_id << ", seq_id=" << buf->sequence_id << " )";
-			if (sem == BufferSemaphoreFlags::Full && (sem_id == -1 || sem_id == manager_id_) && (shm_ptr_->destructive_read_mode || buf->sequence_id > last_seen_id_))
+			if (shm_ptr_->reader_cursors && sem == BufferSemaphoreFlags::Reading && sem_id != manager_id_ && buf->sequence_id > last_seen_id_)
+			{
+				busy_seqID = std::min(busy_seqID, buf->sequence_id.load());
+			}
+			if (sem == BufferSemaphoreFlags::Full && (sem_id == -1 || sem_id == manager_id_) && (shm_ptr_->destructive_read_mode || buf->sequence_id > last_seen_id_) && inDispatchLane_(buf))
 			{
 				if (buf->sequence_id < seqID)
 				{
 					buffer_ptr = buf;
 					seqID = buf->sequence_id;
 					buffer_num = buffer;
-					touchBuffer_(buf);
-					if (seqID == last_seen_id_ + shm_ptr_->reader_count)
+					if (shm_ptr_->dispatch_lanes == 0 && seqID == last_seen_id_ + shm_ptr_->reader_count)
 					{
 						break;
 					}
@@ -360,9 +737,17 @@ int artdaq::SharedMemoryManager::GetBufferForReading()
 			seqID = buffer_ptr->sequence_id.load();
 		}
 
+		if (buffer_ptr != nullptr && busy_seqID < seqID)
+		{
+			// With reader cursors every reader sees every buffer, so wait rather than step over one
+			TLOG(TLVL_GETBUFFER + 2) << "GetBufferForReading: Sequence ID " << busy_seqID << " is being read by another reader, not skipping it";
+			break;
+		}
+
 		TLOG(TLVL_GETBUFFER + 2) << "GetBufferForReading: Mode: " << std::boolalpha << shm_ptr_->destructive_read_mode << ", seqID: " << seqID << ", last_seen_id_: " << last_seen_id_ << ", reader_count: " << shm_ptr_->reader_count;
 
 		if (shm_ptr_->destructive_read_mode && last_seen_id_ > 0    // Round-robin enabled
+		    && shm_ptr_->dispatch_lanes == 0                        // Dispatch tickets already decide which reader gets the buffer
 		    && shm_ptr_->reader_count > 1                           // Don't skip buffers if there is only one reader
 		    && seqID != last_seen_id_ + shm_ptr_->reader_count      // SeqID is not "next" SeqID
 		    && seqID > last_seen_id_ - shm_ptr_->reader_count       // SeqID is not "left behind" (from at least previous RR)
@@ -381,36 +766,10 @@ int artdaq::SharedMemoryManager::GetBufferForReading()
 		if (buffer_num >= 0)
 		{
 			TLOG(TLVL_GETBUFFER) << "GetBufferForReading Found buffer " << buffer_num;
-			touchBuffer_(buffer_ptr);
-			if (!buffer_ptr->sem_id.compare_exchange_strong(sem_id, manager_id_))
-			{
-				continue;
-			}
-			if (!buffer_ptr->sem.compare_exchange_strong(sem, BufferSemaphoreFlags::Reading))
-			{
-				continue;
-			}
-			if (!checkBuffer_(buffer_ptr, BufferSemaphoreFlags::Reading, false))
-			{
-				TLOG(TLVL_GETBUFFER) << "GetBufferForReading: Failed to acquire buffer " << buffer_num << " (someone else changed manager ID while I was changing sem)";
-				continue;
-			}
-			buffer_ptr->readPos = 0;
-			touchBuffer_(buffer_ptr);
-			if (!checkBuffer_(buffer_ptr, BufferSemaphoreFlags::Reading, false))
+			if (!claimBufferForReading_(buffer_num, buffer_ptr, sem, sem_id, now))
 			{
-				TLOG(TLVL_GETBUFFER) << "GetBufferForReading: Failed to acquire buffer " << buffer_num << " (someone else changed manager ID while I was touching buffer SHOULD NOT HAPPEN!)";
 				continue;
 			}
-			if (shm_ptr_->destructive_read_mode && shm_ptr_->lowest_seq_id_read == last_seen_id_)
-			{
-				shm_ptr_->lowest_seq_id_read = seqID;
-			}
-			last_seen_id_ = seqID;
-			if (shm_ptr_->destructive_read_mode)
-			{
-				shm_ptr_->reader_pos = (buffer_num + 1) % shm_ptr_->buffer_count;
-			}
 
 			TLOG(TLVL_GETBUFFER) << "GetBufferForReading returning " << buffer_num;
 			return buffer_num;
@@ -419,6 +778,7 @@ int artdaq::SharedMemoryManager::GetBufferForReading()
 	}
 
 	TLOG(TLVL_GETBUFFER) << "GetBufferForReading returning -1 because no buffers are ready";
+	countFailedAcquisition_(false);
 	return -1;
 }
 
@@ -426,59 +786,56 @@ int artdaq::SharedMemoryManager::GetBufferForWriting(bool overwrite)
 {
 	TLOG(TLVL_GETBUFFER + 1) << "GetBufferForWriting BEGIN, overwrite=" << (overwrite ? "true" : "false");
 
-	if (!registered_writer_)
+	registerWriter_();
+
+	if (UsesIndexQueues())
 	{
-		shm_ptr_->writer_count++;
-		registered_writer_ = true;
+		// Overwriting is not supported with index queues, see SharedMemoryOptions::use_index_queues
+		auto buffer = getQueuedBufferForWriting_(touchTime_());
+		if (buffer == -1) countFailedAcquisition_(true);
+		return buffer;
 	}
 
+	auto now = touchTime_();  // One clock read per operation
+	auto reap_inline = !reaperActive_(now);
+	if (reap_inline) probeManagers_(now);
 	std::lock_guard<std::mutex> lk(search_mutex_);
 	// TraceLock lk(search_mutex_, 12, "GetBufferForWritingSearch");
 	auto wp = shm_ptr_->writer_pos.load();
 
 	TLOG(TLVL_GETBUFFER) << "GetBufferForWriting lock acquired, scanning " << shm_ptr_->buffer_count << " buffers";
 
-	// First, only look for "Empty" buffers
-	for (auto ii = 0; ii < shm_ptr_->buffer_count; ++ii)
+	// First, only look for "Empty" buffers. Dropping a lagging reader cursor may recycle some, in which case look again
+	for (int pass = 0; pass < 2; ++pass)
 	{
-		auto buffer = (ii + wp) % shm_ptr_->buffer_count;
-
-		ResetBuffer(buffer);
-
-		auto buf = getBufferInfo_(buffer);
-		if (buf == nullptr)
+		for (auto ii = 0; ii < shm_ptr_->buffer_count; ++ii)
 		{
-			continue;
-		}
+			auto buffer = (ii + wp) % shm_ptr_->buffer_count;
 
-		auto sem = buf->sem.load();
-		auto sem_id = buf->sem_id.load();
+			if (reap_inline) resetBuffer_(buffer, now);
 
-		if (sem == BufferSemaphoreFlags::Empty && sem_id == -1)
-		{
-			touchBuffer_(buf);
-			if (!buf->sem_id.compare_exchange_strong(sem_id, manager_id_))
-			{
-				continue;
-			}
-			if (!buf->sem.compare_exchange_strong(sem, BufferSemaphoreFlags::Writing))
-			{
-				continue;
-			}
-			if (!checkBuffer_(buf, BufferSemaphoreFlags::Writing, false))
+			auto buf = getBufferInfo_(buffer);
+			if (buf == nullptr)
 			{
 				continue;
 			}
-			shm_ptr_->writer_pos = (buffer + 1) % shm_ptr_->buffer_count;
-			buf->sequence_id = ++shm_ptr_->next_sequence_id;
-			buf->writePos = 0;
-			if (!checkBuffer_(buf, BufferSemaphoreFlags::Writing, false))
+
+			auto sem = buf->sem.load();
+			auto sem_id = buf->sem_id.load();
+
+			if (sem == BufferSemaphoreFlags::Empty && sem_id == -1)
 			{
-				continue;
+				if (!claimBufferForWriting_(buffer, buf, sem, sem_id, now))
+				{
+					continue;
+				}
+				TLOG(TLVL_GETBUFFER + 1) << "GetBufferForWriting returning empty buffer " << buffer;
+				return buffer;
 			}
-			touchBuffer_(buf);
-			TLOG(TLVL_GETBUFFER + 1) << "GetBufferForWriting returning empty buffer " << buffer;
-			return buffer;
+		}
+		if (!dropLaggingCursor_())
+		{
+			break;
 		}
 	}
 
@@ -489,7 +846,7 @@ int artdaq::SharedMemoryManager::GetBufferForWriting(bool overwrite)
 		{
 			auto buffer = (ii + wp) % shm_ptr_->buffer_count;
 
-			ResetBuffer(buffer);
+			if (reap_inline) resetBuffer_(buffer, now);
 
 			auto buf = getBufferInfo_(buffer);
 			if (buf == nullptr)
@@ -502,27 +859,10 @@ int artdaq::SharedMemoryManager::GetBufferForWriting(bool overwrite)
 
 			if (sem == BufferSemaphoreFlags::Full && sem_id == -1)
 			{
-				touchBuffer_(buf);
-				if (!buf->sem_id.compare_exchange_strong(sem_id, manager_id_))
-				{
-					continue;
-				}
-				if (!buf->sem.compare_exchange_strong(sem, BufferSemaphoreFlags::Writing))
-				{
-					continue;
-				}
-				if (!checkBuffer_(buf, BufferSemaphoreFlags::Writing, false))
-				{
-					continue;
-				}
-				shm_ptr_->writer_pos = (buffer + 1) % shm_ptr_->buffer_count;
-				buf->sequence_id = ++shm_ptr_->next_sequence_id;
-				buf->writePos = 0;
-				if (!checkBuffer_(buf, BufferSemaphoreFlags::Writing, false))
+				if (!claimBufferForWriting_(buffer, buf, sem, sem_id, now))
 				{
 					continue;
 				}
-				touchBuffer_(buf);
 				TLOG(TLVL_GETBUFFER + 1) << "GetBufferForWriting returning full buffer (overwrite mode) " << buffer;
 				return buffer;
 			}
@@ -533,7 +873,7 @@ int artdaq::SharedMemoryManager::GetBufferForWriting(bool overwrite)
 		{
 			auto buffer = (ii + wp) % shm_ptr_->buffer_count;
 
-			ResetBuffer(buffer);
+			if (reap_inline) resetBuffer_(buffer, now);
 
 			auto buf = getBufferInfo_(buffer);
 			if (buf == nullptr)
@@ -546,117 +886,477 @@ int artdaq::SharedMemoryManager::GetBufferForWriting(bool overwrite)
 
 			if (sem == BufferSemaphoreFlags::Reading)
 			{
-				touchBuffer_(buf);
-				if (!buf->sem_id.compare_exchange_strong(sem_id, manager_id_))
+				if (!claimBufferForWriting_(buffer, buf, sem, sem_id, now))
 				{
 					continue;
 				}
-				if (!buf->sem.compare_exchange_strong(sem, BufferSemaphoreFlags::Writing))
-				{
-					continue;
-				}
-				if (!checkBuffer_(buf, BufferSemaphoreFlags::Writing, false))
-				{
-					continue;
-				}
-				shm_ptr_->writer_pos = (buffer + 1) % shm_ptr_->buffer_count;
-				buf->sequence_id = ++shm_ptr_->next_sequence_id;
-				buf->writePos = 0;
-				if (!checkBuffer_(buf, BufferSemaphoreFlags::Writing, false))
-				{
-					continue;
-				}
-				touchBuffer_(buf);
 				TLOG(TLVL_GETBUFFER + 1) << "GetBufferForWriting clobbering reader on buffer " << buffer << " (overwrite mode)";
 				return buffer;
 			}
 		}
 	}
 	TLOG(TLVL_GETBUFFER + 1) << "GetBufferForWriting Returning -1 because no buffers are ready";
+	countFailedAcquisition_(true);
 	return -1;
 }
 
-size_t artdaq::SharedMemoryManager::ReadReadyCount()
+std::vector<int> artdaq::SharedMemoryManager::GetBuffersForReading(size_t max_n)
 {
-	if (!IsValid())
+	TLOG(TLVL_GETBUFFER) << "GetBuffersForReading BEGIN, max_n=" << max_n;
+	std::vector<int> buffers;
+
+	registerReader_();
+	rejoinCursor_();
+
+	if (UsesIndexQueues())
 	{
-		return 0;
+		auto now = touchTime_();  // One clock read per operation
+		while (buffers.size() < max_n)
+		{
+			auto buffer = getQueuedBufferForReading_(now);
+			if (buffer == -1) break;
+			buffers.push_back(buffer);
+		}
+		TLOG(TLVL_GETBUFFER) << "GetBuffersForReading returning " << buffers.size() << " queued buffers";
+		if (buffers.empty()) countFailedAcquisition_(false);
+		return buffers;
 	}
-	TLOG(TLVL_READREADY) << std::hex << std::showbase << shm_key_ << " ReadReadyCount BEGIN" << std::dec;
-	std::unique_lock<std::mutex> lk(search_mutex_);
-	TLOG(TLVL_READREADY) << "ReadReadyCount lock acquired, scanning " << shm_ptr_->buffer_count << " buffers";
-	// TraceLock lk(search_mutex_, 14, "ReadReadyCountSearch");
-	size_t count = 0;
+
+	auto now = touchTime_();  // One clock read per operation
+	auto reap_inline = !reaperActive_(now);
+	if (reap_inline) probeManagers_(now);
+	std::lock_guard<std::mutex> lk(search_mutex_);
+	auto rp = shm_ptr_->reader_pos.load();
+
+	// Collect every readable buffer in one pass, then claim them in sequence ID order
+	std::vector<std::pair<size_t, int>> candidates;
+	uint64_t busy_seqID = -1;  // Oldest unseen buffer another broadcast reader is reading, see GetBufferForReading
 	for (auto ii = 0; ii < shm_ptr_->buffer_count; ++ii)
 	{
-#ifndef __OPTIMIZE__
-		TLOG(TLVL_READREADY + 1) << std::hex << std::showbase << shm_key_ << std::dec << " ReadReadyCount: Checking if buffer " << ii << " is stale.";
-#endif
-		ResetBuffer(ii);
-		auto buf = getBufferInfo_(ii);
+		auto buffer = (ii + rp) % shm_ptr_->buffer_count;
+		if (reap_inline) resetBuffer_(buffer, now);
+
+		auto buf = getBufferInfo_(buffer);
 		if (buf == nullptr)
 		{
 			continue;
 		}
 
-#ifndef __OPTIMIZE__
-		TLOG(TLVL_READREADY + 2) << std::hex << std::showbase << shm_key_ << std::dec << " ReadReadyCount: Buffer " << ii << ": sem=" << FlagToString(buf->sem) << " (expected " << FlagToString(BufferSemaphoreFlags::Full) << "), sem_id=" << buf->sem_id << " )";
-#endif
-		if (buf->sem == BufferSemaphoreFlags::Full && (buf->sem_id == -1 || buf->sem_id == manager_id_) && (shm_ptr_->destructive_read_mode || buf->sequence_id > last_seen_id_))
+		auto sem_id = buf->sem_id.load();
+		auto seqID = buf->sequence_id.load();
+		if (buf->sem == BufferSemaphoreFlags::Full && (sem_id == -1 || sem_id == manager_id_) && (shm_ptr_->destructive_read_mode || seqID > last_seen_id_) && inDispatchLane_(buf))
 		{
-#ifndef __OPTIMIZE__
-			TLOG(TLVL_READREADY + 3) << std::hex << std::showbase << shm_key_ << std::dec << " ReadReadyCount: Buffer " << ii << " is either unowned or owned by this manager, and is marked full.";
-#endif
-			touchBuffer_(buf);
-			++count;
+			candidates.emplace_back(seqID, buffer);
+		}
+		else if (shm_ptr_->reader_cursors && buf->sem == BufferSemaphoreFlags::Reading && sem_id != manager_id_ && seqID > last_seen_id_)
+		{
+			busy_seqID = std::min(busy_seqID, seqID);
 		}
 	}
-	return count;
-}
+	std::sort(candidates.begin(), candidates.end());
 
-size_t artdaq::SharedMemoryManager::WriteReadyCount(bool overwrite)
-{
-	if (!IsValid())
-	{
-		return 0;
-	}
-	TLOG(TLVL_WRITEREADY) << std::hex << std::showbase << shm_key_ << " WriteReadyCount BEGIN" << std::dec;
-	std::unique_lock<std::mutex> lk(search_mutex_);
-	// TraceLock lk(search_mutex_, 15, "WriteReadyCountSearch");
-	TLOG(TLVL_WRITEREADY) << "WriteReadyCount(" << overwrite << ") lock acquired, scanning " << shm_ptr_->buffer_count << " buffers";
-	size_t count = 0;
-	for (auto ii = 0; ii < shm_ptr_->buffer_count; ++ii)
+	for (auto const& candidate : candidates)
 	{
-		// ELF, 3/19/2019: This TRACE call is a major performance hit with many buffers
-#ifndef __OPTIMIZE__
-		TLOG(TLVL_WRITEREADY + 1) << std::hex << std::showbase << shm_key_ << std::dec << " WriteReadyCount: Checking if buffer " << ii << " is stale.";
-#endif
-		ResetBuffer(ii);
-		auto buf = getBufferInfo_(ii);
-		if (buf == nullptr)
+		if (buffers.size() >= max_n || candidate.first > busy_seqID) break;
+
+		auto buf = getBufferInfo_(candidate.second);
+		auto sem = BufferSemaphoreFlags::Full;
+		int16_t sem_id = buf->sem_id.load();
+		if (buf->sequence_id == candidate.first && (sem_id == -1 || sem_id == manager_id_) && claimBufferForReading_(candidate.second, buf, sem, sem_id, now))
 		{
-			continue;
+			buffers.push_back(candidate.second);
 		}
-		if ((buf->sem == BufferSemaphoreFlags::Empty && buf->sem_id == -1) || (overwrite && buf->sem != BufferSemaphoreFlags::Writing))
+		else if (!shm_ptr_->destructive_read_mode)
 		{
-#ifndef __OPTIMIZE__
-			TLOG(TLVL_WRITEREADY + 1) << std::hex << std::showbase << shm_key_ << std::dec << " WriteReadyCount: Buffer " << ii << " is either empty or is available for overwrite.";
-#endif
-			++count;
+			// Broadcast readers must not skip over a buffer they have not seen
+			break;
 		}
 	}
-	return count;
+
+	TLOG(TLVL_GETBUFFER) << "GetBuffersForReading returning " << buffers.size() << " buffers";
+	if (buffers.empty()) countFailedAcquisition_(false);
+	return buffers;
 }
 
-bool artdaq::SharedMemoryManager::ReadyForRead()
+std::vector<int> artdaq::SharedMemoryManager::GetBuffersForWriting(size_t n, bool overwrite)
 {
-	if (!IsValid())
+	TLOG(TLVL_GETBUFFER + 1) << "GetBuffersForWriting BEGIN, n=" << n << ", overwrite=" << (overwrite ? "true" : "false");
+	std::vector<int> buffers;
+
+	registerWriter_();
+
+	if (UsesIndexQueues())
 	{
-		return false;
+		auto now = touchTime_();  // One clock read per operation
+		while (buffers.size() < n)
+		{
+			auto buffer = getQueuedBufferForWriting_(now);
+			if (buffer == -1) break;
+			buffers.push_back(buffer);
+		}
+		TLOG(TLVL_GETBUFFER + 1) << "GetBuffersForWriting returning " << buffers.size() << " queued buffers";
+		if (buffers.empty()) countFailedAcquisition_(true);
+		return buffers;
 	}
-	TLOG(TLVL_READREADY) << std::hex << std::showbase << shm_key_ << " ReadyForRead BEGIN" << std::dec;
-	std::unique_lock<std::mutex> lk(search_mutex_);
-	// TraceLock lk(search_mutex_, 14, "ReadyForReadSearch");
+
+	auto now = touchTime_();  // One clock read per operation
+	auto reap_inline = !reaperActive_(now);
+	if (reap_inline) probeManagers_(now);
+	std::lock_guard<std::mutex> lk(search_mutex_);
+	auto wp = shm_ptr_->writer_pos.load();
+
+	// Same preference order as GetBufferForWriting: Empty buffers, then (when overwriting) Full, then Reading
+	std::vector<BufferSemaphoreFlags> passes{BufferSemaphoreFlags::Empty};
+	if (overwrite)
+	{
+		passes.push_back(BufferSemaphoreFlags::Full);
+		passes.push_back(BufferSemaphoreFlags::Reading);
+	}
+	for (size_t pass = 0; pass < passes.size(); ++pass)
+	{
+		auto wanted = passes[pass];
+		for (auto ii = 0; ii < shm_ptr_->buffer_count && buffers.size() < n; ++ii)
+		{
+			auto buffer = (ii + wp) % shm_ptr_->buffer_count;
+			if (reap_inline) resetBuffer_(buffer, now);
+
+			auto buf = getBufferInfo_(buffer);
+			if (buf == nullptr)
+			{
+				continue;
+			}
+
+			auto sem = buf->sem.load();
+			auto sem_id = buf->sem_id.load();
+			if (sem == wanted && (sem_id == -1 || wanted == BufferSemaphoreFlags::Reading) && claimBufferForWriting_(buffer, buf, sem, sem_id, now))
+			{
+				buffers.push_back(buffer);
+			}
+		}
+		if (pass == 0 && buffers.size() < n && dropLaggingCursor_())
+		{
+			// Dropping a lagging reader cursor recycled some buffers, look for Empty ones again
+			passes.insert(passes.begin() + 1, BufferSemaphoreFlags::Empty);
+		}
+	}
+
+	TLOG(TLVL_GETBUFFER + 1) << "GetBuffersForWriting returning " << buffers.size() << " buffers";
+	if (buffers.empty()) countFailedAcquisition_(true);
+	return buffers;
+}
+
+bool artdaq::SharedMemoryManager::claimBufferForReading_(int buffer, ShmBuffer* buf, BufferSemaphoreFlags sem, int16_t sem_id, uint64_t now)
+{
+	touchBuffer_(buf, now);
+	if (!buf->sem_id.compare_exchange_strong(sem_id, manager_id_))
+	{
+		return false;
+	}
+	if (!casBufferState_(buf, sem, BufferSemaphoreFlags::Reading, now))
+	{
+		return false;
+	}
+	if (!checkBuffer_(buf, BufferSemaphoreFlags::Reading, false))
+	{
+		TLOG(TLVL_GETBUFFER) << "GetBufferForReading: Failed to acquire buffer " << buffer << " (someone else changed manager ID while I was changing sem)";
+		return false;
+	}
+	buf->readPos = 0;
+	if (sem_id == -1 && dispatch_lane_ >= 0)
+	{
+		shm_ptr_->lanes[dispatch_lane_].consumed++;
+	}
+
+	auto seqID = buf->sequence_id.load();
+	if (shm_ptr_->destructive_read_mode && shm_ptr_->lowest_seq_id_read == last_seen_id_)
+	{
+		shm_ptr_->lowest_seq_id_read = seqID;
+	}
+	last_seen_id_ = seqID;
+	if (shm_ptr_->destructive_read_mode)
+	{
+		shm_ptr_->reader_pos = (buffer + 1) % shm_ptr_->buffer_count;
+	}
+	return true;
+}
+
+bool artdaq::SharedMemoryManager::claimBufferForWriting_(int buffer, ShmBuffer* buf, BufferSemaphoreFlags sem, int16_t sem_id, uint64_t now)
+{
+	touchBuffer_(buf, now);
+	if (!buf->sem_id.compare_exchange_strong(sem_id, manager_id_))
+	{
+		return false;
+	}
+	if (!casBufferState_(buf, sem, BufferSemaphoreFlags::Writing, now))
+	{
+		return false;
+	}
+	if (!checkBuffer_(buf, BufferSemaphoreFlags::Writing, false))
+	{
+		return false;
+	}
+	shm_ptr_->writer_pos = (buffer + 1) % shm_ptr_->buffer_count;
+	buf->sequence_id = ++shm_ptr_->next_sequence_id;
+	buf->writePos = 0;
+	write_reservations_[buffer] = 0;  // A reservation made before the buffer was last released is void
+	memset(buf->type_mask, 0, sizeof(buf->type_mask));
+	return checkBuffer_(buf, BufferSemaphoreFlags::Writing, false);
+}
+
+int artdaq::SharedMemoryManager::WaitForBufferForReading(size_t timeout_us)
+{
+	TLOG(TLVL_GETBUFFER) << "WaitForBufferForReading BEGIN, timeout_us=" << timeout_us;
+	auto start_time = std::chrono::steady_clock::now();
+	while (IsValid())
+	{
+		// Sample the futex before searching, so that a buffer released after the search wakes us immediately
+		auto last_value = shm_ptr_->read_futex.load();
+		auto buffer = GetBufferForReading();
+		if (buffer != -1)
+		{
+			return buffer;
+		}
+
+		auto elapsed = TimeUtils::GetElapsedTimeMicroseconds(start_time);
+		if (elapsed >= timeout_us || IsEndOfData())
+		{
+			break;
+		}
+		waitForChange_(&shm_ptr_->read_futex, &shm_ptr_->read_waiters, last_value, timeout_us - elapsed);
+	}
+	TLOG(TLVL_GETBUFFER) << "WaitForBufferForReading returning -1 after " << TimeUtils::GetElapsedTimeMicroseconds(start_time) << " us";
+	return -1;
+}
+
+int artdaq::SharedMemoryManager::WaitForBufferForWriting(size_t timeout_us, bool overwrite)
+{
+	TLOG(TLVL_GETBUFFER + 1) << "WaitForBufferForWriting BEGIN, timeout_us=" << timeout_us << ", overwrite=" << std::boolalpha << overwrite;
+	auto start_time = std::chrono::steady_clock::now();
+	while (IsValid())
+	{
+		auto last_value = shm_ptr_->write_futex.load();
+		auto buffer = GetBufferForWriting(overwrite);
+		if (buffer != -1)
+		{
+			return buffer;
+		}
+
+		auto elapsed = TimeUtils::GetElapsedTimeMicroseconds(start_time);
+		if (elapsed >= timeout_us || IsEndOfData())
+		{
+			break;
+		}
+		waitForChange_(&shm_ptr_->write_futex, &shm_ptr_->write_waiters, last_value, timeout_us - elapsed);
+	}
+	TLOG(TLVL_GETBUFFER + 1) << "WaitForBufferForWriting returning -1 after " << TimeUtils::GetElapsedTimeMicroseconds(start_time) << " us";
+	return -1;
+}
+
+int artdaq::SharedMemoryManager::WaitForReadable(std::vector<SharedMemoryManager*> const& segments, std::vector<uint32_t> const& last_counts, size_t timeout_us)
+{
+	auto changed = [&]() {
+		for (size_t ii = 0; ii < segments.size() && ii < last_counts.size(); ++ii)
+		{
+			if (segments[ii]->IsValid() && segments[ii]->GetReadNotifyCount() != last_counts[ii]) return static_cast<int>(ii);
+		}
+		return -1;
+	};
+
+	auto start_time = std::chrono::steady_clock::now();
+	auto index = changed();
+	if (index != -1 || timeout_us == 0) return index;
+
+#if defined(__linux__) && defined(SYS_futex_waitv) && defined(FUTEX_WAITV_MAX)
+	static std::atomic<bool> waitv_supported{true};
+	if (waitv_supported.load())
+	{
+		std::vector<struct futex_waitv> waiters;
+		std::vector<std::atomic<int>*> waiter_counts;
+		for (size_t ii = 0; ii < segments.size() && ii < last_counts.size() && waiters.size() < FUTEX_WAITV_MAX; ++ii)
+		{
+			if (!segments[ii]->IsValid()) continue;
+			struct futex_waitv waiter;
+			memset(&waiter, 0, sizeof(waiter));
+			waiter.uaddr = reinterpret_cast<uintptr_t>(&segments[ii]->shm_ptr_->read_futex);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+			waiter.val = last_counts[ii];
+			waiter.flags = FUTEX_32;  // Not FUTEX_PRIVATE_FLAG: the futex words are shared between processes
+			waiters.push_back(waiter);
+			waiter_counts.push_back(&segments[ii]->shm_ptr_->read_waiters);
+		}
+		if (waiters.empty()) return -1;
+
+		// futex_waitv takes an absolute timeout
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout_us / 1000000;
+		deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec += 1;
+			deadline.tv_nsec -= 1000000000;
+		}
+
+		for (auto count : waiter_counts) count->fetch_add(1);
+		auto sts = syscall(SYS_futex_waitv, waiters.data(), waiters.size(), 0, &deadline, CLOCK_MONOTONIC);
+		auto err = errno;
+		for (auto count : waiter_counts) count->fetch_sub(1);
+
+		if (sts >= 0 || err == EAGAIN || err == ETIMEDOUT || err == EINTR)
+		{
+			return changed();
+		}
+		if (err == ENOSYS)
+		{
+			TLOG(TLVL_GETBUFFER) << "futex_waitv is not supported by this kernel, falling back to waiting on one segment at a time";
+			waitv_supported = false;
+		}
+		else
+		{
+			TLOG(TLVL_WARNING) << "futex_waitv returned error " << err << " (" << strerror(err) << ")";
+		}
+	}
+#endif
+
+	// Sleep on the first attached segment's futex, waking periodically to check the others
+	size_t first = 0;
+	while (first < segments.size() && first < last_counts.size() && !segments[first]->IsValid()) ++first;
+	if (first >= segments.size() || first >= last_counts.size()) return -1;
+
+	size_t slice_us = segments.size() > 1 ? 1000 : timeout_us;
+	while (true)
+	{
+		auto elapsed = TimeUtils::GetElapsedTimeMicroseconds(start_time);
+		if (elapsed >= timeout_us) return -1;
+		auto segment = segments[first];
+		segment->waitForChange_(&segment->shm_ptr_->read_futex, &segment->shm_ptr_->read_waiters, last_counts[first], std::min(slice_us, timeout_us - elapsed));
+		index = changed();
+		if (index != -1) return index;
+	}
+}
+
+size_t artdaq::SharedMemoryManager::ReadReadyCount()
+{
+	if (!IsValid())
+	{
+		return 0;
+	}
+	TLOG(TLVL_READREADY) << std::hex << std::showbase << shm_key_ << " ReadReadyCount BEGIN" << std::dec;
+	if (shm_ptr_->destructive_read_mode && shm_ptr_->dispatch_lanes == 0 && manager_id_ < max_counted_destinations_)
+	{
+		// Buffers for any reader, plus buffers sent to this manager
+		auto count = shm_ptr_->full_count[fullSlot_(-1)].load();
+		if (manager_id_ >= 0)
+		{
+			count += shm_ptr_->full_count[fullSlot_(manager_id_)].load();
+		}
+		return count > 0 ? count : 0;
+	}
+	// Broadcast readers only count buffers newer than the last one they read, and dispatch readers only the ones in their lane, which needs the scan
+	auto now = touchTime_();  // One clock read per operation
+	auto reap_inline = !reaperActive_(now);
+	if (reap_inline) probeManagers_(now);
+	std::unique_lock<std::mutex> lk(search_mutex_);
+	TLOG(TLVL_READREADY) << "ReadReadyCount lock acquired, scanning " << shm_ptr_->buffer_count << " buffers";
+	// TraceLock lk(search_mutex_, 14, "ReadReadyCountSearch");
+	size_t count = 0;
+	for (auto ii = 0; ii < shm_ptr_->buffer_count; ++ii)
+	{
+#ifndef __OPTIMIZE__
+		TLOG(TLVL_READREADY + 1) << std::hex << std::showbase << shm_key_ << std::dec << " ReadReadyCount: Checking if buffer " << ii << " is stale.";
+#endif
+		if (reap_inline) resetBuffer_(ii, now);
+		auto buf = getBufferInfo_(ii);
+		if (buf == nullptr)
+		{
+			continue;
+		}
+
+#ifndef __OPTIMIZE__
+		TLOG(TLVL_READREADY + 2) << std::hex << std::showbase << shm_key_ << std::dec << " ReadReadyCount: Buffer " << ii << ": sem=" << FlagToString(buf->sem) << " (expected " << FlagToString(BufferSemaphoreFlags::Full) << "), sem_id=" << buf->sem_id << " )";
+#endif
+		if (buf->sem == BufferSemaphoreFlags::Full && (buf->sem_id == -1 || buf->sem_id == manager_id_) && (shm_ptr_->destructive_read_mode || buf->sequence_id > last_seen_id_) && inDispatchLane_(buf))
+		{
+#ifndef __OPTIMIZE__
+			TLOG(TLVL_READREADY + 3) << std::hex << std::showbase << shm_key_ << std::dec << " ReadReadyCount: Buffer " << ii << " is either unowned or owned by this manager, and is marked full.";
+#endif
+			touchBuffer_(buf, now);
+			++count;
+		}
+	}
+	return count;
+}
+
+size_t artdaq::SharedMemoryManager::WriteReadyCount(bool overwrite)
+{
+	if (!IsValid())
+	{
+		return 0;
+	}
+	TLOG(TLVL_WRITEREADY) << std::hex << std::showbase << shm_key_ << " WriteReadyCount BEGIN" << std::dec;
+	// Broadcast buffers only become Empty when they time out, so without the reaper they must be checked here
+	if (shm_ptr_->destructive_read_mode || reaperActive_(touchTime_()))
+	{
+		if (overwrite && !UsesIndexQueues())
+		{
+			// Every buffer which is not being written can be overwritten
+			auto writing = GetBufferStateCount(BufferSemaphoreFlags::Writing);
+			return writing < size() ? size() - writing : 0;
+		}
+		return GetBufferStateCount(BufferSemaphoreFlags::Empty);
+	}
+
+	auto now = touchTime_();  // One clock read per operation
+	probeManagers_(now);
+	std::unique_lock<std::mutex> lk(search_mutex_);
+	// TraceLock lk(search_mutex_, 15, "WriteReadyCountSearch");
+	TLOG(TLVL_WRITEREADY) << "WriteReadyCount(" << overwrite << ") lock acquired, scanning " << shm_ptr_->buffer_count << " buffers";
+	size_t count = 0;
+	for (auto ii = 0; ii < shm_ptr_->buffer_count; ++ii)
+	{
+		// ELF, 3/19/2019: This TRACE call is a major performance hit with many buffers
+#ifndef __OPTIMIZE__
+		TLOG(TLVL_WRITEREADY + 1) << std::hex << std::showbase << shm_key_ << std::dec << " WriteReadyCount: Checking if buffer " << ii << " is stale.";
+#endif
+		resetBuffer_(ii, now);
+		auto buf = getBufferInfo_(ii);
+		if (buf == nullptr)
+		{
+			continue;
+		}
+		if ((buf->sem == BufferSemaphoreFlags::Empty && buf->sem_id == -1) || (overwrite && buf->sem != BufferSemaphoreFlags::Writing))
+		{
+#ifndef __OPTIMIZE__
+			TLOG(TLVL_WRITEREADY + 1) << std::hex << std::showbase << shm_key_ << std::dec << " WriteReadyCount: Buffer " << ii << " is either empty or is available for overwrite.";
+#endif
+			++count;
+		}
+	}
+	return count;
+}
+
+bool artdaq::SharedMemoryManager::ReadyForRead()
+{
+	if (!IsValid())
+	{
+		return false;
+	}
+	TLOG(TLVL_READREADY) << std::hex << std::showbase << shm_key_ << " ReadyForRead BEGIN" << std::dec;
+	if (UsesIndexQueues())
+	{
+		sweepStaleBuffer_(touchTime_());
+		if (manager_id_ >= 0 && manager_id_ < max_counted_destinations_)
+		{
+			// The Full queue also holds buffers sent to other managers, so count only the ones this manager may take
+			return shm_ptr_->full_count[fullSlot_(-1)].load() + shm_ptr_->full_count[fullSlot_(manager_id_)].load() > 0;
+		}
+		auto own_queue = destinationQueue_(manager_id_);
+		return queueDepth_(&shm_ptr_->full_queue) > 0 || (own_queue != nullptr && queueDepth_(own_queue) > 0);
+	}
+	auto now = touchTime_();  // One clock read per operation
+	auto reap_inline = !reaperActive_(now);
+	if (reap_inline) probeManagers_(now);
+	std::unique_lock<std::mutex> lk(search_mutex_);
+	// TraceLock lk(search_mutex_, 14, "ReadyForReadSearch");
 
 	auto rp = shm_ptr_->reader_pos.load();
 
@@ -669,7 +1369,7 @@ bool artdaq::SharedMemoryManager::ReadyForRead()
 #ifndef __OPTIMIZE__
 		TLOG(TLVL_READREADY + 1) << std::hex << std::showbase << shm_key_ << std::dec << " ReadyForRead: Checking if buffer " << buffer << " is stale.";
 #endif
-		ResetBuffer(buffer);
+		if (reap_inline) resetBuffer_(buffer, now);
 		auto buf = getBufferInfo_(buffer);
 		if (buf == nullptr)
 		{
@@ -681,10 +1381,10 @@ bool artdaq::SharedMemoryManager::ReadyForRead()
 		                         << " seq_id=" << buf->sequence_id << " >? " << last_seen_id_;
 #endif
 
-		if (buf->sem == BufferSemaphoreFlags::Full && (buf->sem_id == -1 || buf->sem_id == manager_id_) && (shm_ptr_->destructive_read_mode || buf->sequence_id > last_seen_id_))
+		if (buf->sem == BufferSemaphoreFlags::Full && (buf->sem_id == -1 || buf->sem_id == manager_id_) && (shm_ptr_->destructive_read_mode || buf->sequence_id > last_seen_id_) && inDispatchLane_(buf))
 		{
 			TLOG(TLVL_READREADY + 3) << std::hex << std::showbase << shm_key_ << std::dec << " ReadyForRead: Buffer " << buffer << " is either unowned or owned by this manager, and is marked full.";
-			touchBuffer_(buf);
+			touchBuffer_(buf, now);
 			return true;
 		}
 	}
@@ -698,7 +1398,15 @@ bool artdaq::SharedMemoryManager::ReadyForWrite(bool overwrite)
 		return false;
 	}
 	TLOG(TLVL_WRITEREADY) << std::hex << std::showbase << shm_key_ << " ReadyForWrite BEGIN" << std::dec;
+	if (UsesIndexQueues())
+	{
+		sweepStaleBuffer_(touchTime_());
+		return queueDepth_(&shm_ptr_->empty_queue) > 0;
+	}
 
+	auto now = touchTime_();  // One clock read per operation
+	auto reap_inline = !reaperActive_(now);
+	if (reap_inline) probeManagers_(now);
 	std::lock_guard<std::mutex> lk(search_mutex_);
 	// TraceLock lk(search_mutex_, 15, "ReadyForWriteSearch");
 
@@ -710,7 +1418,7 @@ bool artdaq::SharedMemoryManager::ReadyForWrite(bool overwrite)
 	{
 		auto buffer = (wp + ii) % shm_ptr_->buffer_count;
 		TLOG(TLVL_WRITEREADY + 1) << std::hex << std::showbase << shm_key_ << std::dec << " ReadyForWrite: Checking if buffer " << buffer << " is stale.";
-		ResetBuffer(buffer);
+		if (reap_inline) resetBuffer_(buffer, now);
 		auto buf = getBufferInfo_(buffer);
 		if (buf == nullptr)
 		{
@@ -847,6 +1555,7 @@ void artdaq::SharedMemoryManager::ResetWritePos(int buffer)
 	checkBuffer_(buf, BufferSemaphoreFlags::Writing);
 	touchBuffer_(buf);
 	buf->writePos = 0;
+	write_reservations_[buffer] = 0;
 
 	TLOG(TLVL_POS + 1) << "ResetWritePos(" << buffer << ") ended.";
 }
@@ -899,9 +1608,10 @@ bool artdaq::SharedMemoryManager::IncrementWritePos(int buffer, size_t written)
 	}
 	checkBuffer_(buf, BufferSemaphoreFlags::Writing);
 	touchBuffer_(buf);
-	if (buf->writePos + written > shm_ptr_->buffer_size)
+	auto limit = shm_ptr_->arena_size > 0 ? buf->data_capacity : shm_ptr_->buffer_size;
+	if (buf->writePos + written > limit)
 	{
-		TLOG(TLVL_ERROR) << "Requested write size is larger than the buffer size! (sz=" << std::dec << shm_ptr_->buffer_size << ", cur + req=" << std::dec << buf->writePos + written << ", diff=" << std::dec << (buf->writePos + written - shm_ptr_->buffer_size) << ")";
+		TLOG(TLVL_ERROR) << "Requested write size is larger than the buffer size! (sz=" << std::dec << limit << ", cur + req=" << std::dec << buf->writePos + written << ", diff=" << std::dec << (buf->writePos + written - limit) << ")";
 		return false;
 	}
 	TLOG(TLVL_POS + 1) << "IncrementWritePos: buffer= " << buffer << ", writePos=" << buf->writePos << ", bytes written=" << written;
@@ -915,6 +1625,26 @@ bool artdaq::SharedMemoryManager::IncrementWritePos(int buffer, size_t written)
 	return true;
 }
 
+bool artdaq::SharedMemoryManager::ReserveBufferSpace(int buffer, size_t size)
+{
+	TLOG(TLVL_POS + 1) << "ReserveBufferSpace called: buffer= " << buffer << ", size=" << size;
+
+	if (buffer >= shm_ptr_->buffer_count)
+	{
+		Detach(true, "ArgumentOutOfRange", "The specified buffer does not exist!");
+	}
+
+	std::lock_guard<std::mutex> lk(buffer_mutexes_[buffer]);
+	auto buf = getBufferInfo_(buffer);
+	if (buf == nullptr)
+	{
+		return false;
+	}
+	checkBuffer_(buf, BufferSemaphoreFlags::Writing);
+	touchBuffer_(buf);
+	return ensureCapacity_(buf, buf->writePos + size);
+}
+
 bool artdaq::SharedMemoryManager::MoreDataInBuffer(int buffer)
 {
 	TLOG(TLVL_POS + 2) << "MoreDataInBuffer(" << buffer << ") called.";
@@ -952,6 +1682,30 @@ bool artdaq::SharedMemoryManager::CheckBuffer(int buffer, BufferSemaphoreFlags f
 }
 
 void artdaq::SharedMemoryManager::MarkBufferFull(int buffer, int destination)
+{
+	if (markBufferFull_(buffer, destination))
+	{
+		notifyReaders_();
+		notifyWriters_();  // Full buffers may be taken by writers in overwrite mode
+	}
+}
+
+void artdaq::SharedMemoryManager::MarkBuffersFull(std::vector<int> const& buffers, int destination)
+{
+	TLOG(TLVL_POS) << "MarkBuffersFull BEGIN, " << buffers.size() << " buffers, destination=" << destination;
+	bool released = false;
+	for (auto buffer : buffers)
+	{
+		released = markBufferFull_(buffer, destination) || released;
+	}
+	if (released)
+	{
+		notifyReaders_();
+		notifyWriters_();
+	}
+}
+
+bool artdaq::SharedMemoryManager::markBufferFull_(int buffer, int destination)
 {
 	if (buffer >= shm_ptr_->buffer_count)
 	{
@@ -966,21 +1720,52 @@ void artdaq::SharedMemoryManager::MarkBufferFull(int buffer, int destination)
 	auto shmBuf = getBufferInfo_(buffer);
 	if (shmBuf == nullptr)
 	{
-		return;
+		return false;
 	}
-	touchBuffer_(shmBuf);
+	auto now = touchTime_();  // One clock read per operation
+	touchBuffer_(shmBuf, now);
+	write_reservations_[buffer] = 0;
 	if (shmBuf->sem_id == manager_id_)
 	{
-		if (shmBuf->sem != BufferSemaphoreFlags::Full)
+		if (shm_ptr_->dispatch_lanes > 0 && destination == -1)
 		{
-			shmBuf->sem = BufferSemaphoreFlags::Full;
+			auto ticket = shm_ptr_->next_ticket++;
+			shmBuf->ticket = ticket;
+			shm_ptr_->lanes[ticket % shm_ptr_->dispatch_lanes].dispatched++;
 		}
-
+		setBufferState_(shmBuf, BufferSemaphoreFlags::Full, now, destination);
 		shmBuf->sem_id = destination;
+		queueBuffer_(buffer);
+		return true;
 	}
+	return false;
 }
 
 void artdaq::SharedMemoryManager::MarkBufferEmpty(int buffer, bool force, bool detachOnException)
+{
+	bool notify_readers = false;
+	bool notify_writers = false;
+	markBufferEmpty_(buffer, force, detachOnException, notify_readers, notify_writers);
+	if (notify_readers && recyclePassedBuffers_()) notify_writers = true;
+	if (notify_readers) notifyReaders_();
+	if (notify_writers) notifyWriters_();
+}
+
+void artdaq::SharedMemoryManager::MarkBuffersEmpty(std::vector<int> const& buffers, bool force, bool detachOnException)
+{
+	TLOG(TLVL_POS + 3) << "MarkBuffersEmpty BEGIN, " << buffers.size() << " buffers, force=" << force;
+	bool notify_readers = false;
+	bool notify_writers = false;
+	for (auto buffer : buffers)
+	{
+		markBufferEmpty_(buffer, force, detachOnException, notify_readers, notify_writers);
+	}
+	if (notify_readers && recyclePassedBuffers_()) notify_writers = true;
+	if (notify_readers) notifyReaders_();
+	if (notify_writers) notifyWriters_();
+}
+
+void artdaq::SharedMemoryManager::markBufferEmpty_(int buffer, bool force, bool detachOnException, bool& notify_readers, bool& notify_writers)
 {
 	TLOG(TLVL_POS + 3) << "MarkBufferEmpty BEGIN, buffer=" << buffer << ", force=" << force << ", manager_id_=" << manager_id_;
 	if (buffer >= shm_ptr_->buffer_count)
@@ -999,7 +1784,8 @@ void artdaq::SharedMemoryManager::MarkBufferEmpty(int buffer, bool force, bool d
 		auto ret = checkBuffer_(shmBuf, BufferSemaphoreFlags::Reading, detachOnException);
 		if (!ret) return;
 	}
-	touchBuffer_(shmBuf);
+	auto now = touchTime_();  // One clock read per operation
+	touchBuffer_(shmBuf, now);
 
 	shmBuf->readPos = 0;
 
@@ -1007,7 +1793,8 @@ void artdaq::SharedMemoryManager::MarkBufferEmpty(int buffer, bool force, bool d
 	{
 		TLOG(TLVL_POS + 3) << "MarkBufferEmpty Resetting buffer " << buffer << " (SeqID " << shmBuf->sequence_id << ") to Empty state";
 		shmBuf->writePos = 0;
-		shmBuf->sem = BufferSemaphoreFlags::Empty;
+		write_reservations_[buffer] = 0;
+		setBufferState_(shmBuf, BufferSemaphoreFlags::Empty, now);
 		if (shm_ptr_->reader_pos == static_cast<unsigned>(buffer) && !shm_ptr_->destructive_read_mode)
 		{
 			TLOG(TLVL_POS + 3) << "MarkBufferEmpty Broadcast mode; incrementing reader_pos from " << shm_ptr_->reader_pos << " to " << (buffer + 1) % shm_ptr_->buffer_count;
@@ -1015,22 +1802,53 @@ void artdaq::SharedMemoryManager::MarkBufferEmpty(int buffer, bool force, bool d
 		}
 	}
 	else {
-		shmBuf->sem = BufferSemaphoreFlags::Full;
+		setBufferState_(shmBuf, BufferSemaphoreFlags::Full, now);
+		if (reader_cursor_ >= 0)
+		{
+			auto& position = shm_ptr_->cursors[reader_cursor_].position;
+			auto seqID = shmBuf->sequence_id.load();
+			auto last = position.load();
+			while (last < seqID && !position.compare_exchange_weak(last, seqID)) {}
+		}
 	}
 	shmBuf->sem_id = -1;
-	TLOG(TLVL_POS + 3) << "MarkBufferEmpty END, buffer=" << buffer << ", force=" << force;
+	queueBuffer_(buffer);
+	if (shmBuf->sem == BufferSemaphoreFlags::Empty)
+	{
+		notify_writers = true;
+	}
+	else
+	{
+		notify_readers = true;
+	}
+	TLOG(TLVL_POS + 3) << "MarkBufferEmpty END, buffer=" << buffer << ", force=" << force;
 }
 
 bool artdaq::SharedMemoryManager::ResetBuffer(int buffer)
+{
+	return resetBuffer_(buffer, touchTime_());
+}
+
+bool artdaq::SharedMemoryManager::resetBuffer_(int buffer, uint64_t now, bool try_lock)
 {
 	if (buffer >= shm_ptr_->buffer_count)
 	{
 		Detach(true, "ArgumentOutOfRange", "The specified buffer does not exist!");
+		return false;  // Only reached on the reaper thread, where Detach does not throw
 	}
 
 	// ELF, 3/19/2019: These TRACE calls are a major performance hit with many buffers.
 	// TLOG(TLVL_BUFLCK) << "ResetBuffer: obtaining buffer_mutex lock for buffer " << buffer;
-	std::lock_guard<std::mutex> lk(buffer_mutexes_[buffer]);
+	std::unique_lock<std::mutex> lk(buffer_mutexes_[buffer], std::defer_lock);
+	if (!try_lock)
+	{
+		lk.lock();
+	}
+	else if (!lk.try_lock())
+	{
+		// Someone in this process is working on the buffer right now, so it is not stale
+		return false;
+	}
 	// TLOG(TLVL_BUFLCK) << "ResetBuffer: obtained buffer_mutex lock for buffer " << buffer;
 
 	// TraceLock lk(buffer_mutexes_[buffer], 25, "ResetBuffer" + std::to_string(buffer));
@@ -1049,42 +1867,88 @@ bool artdaq::SharedMemoryManager::ResetBuffer(int buffer)
 	        return true;
 	    }*/
 
-	size_t delta = TimeUtils::gettimeofday_us() - shmBuf->last_touch_time;
-	if (delta > 0xFFFFFFFF)
+	// now may have been sampled at the start of a scan, so a buffer touched since then is simply not stale
+	uint64_t last_touch = shmBuf->last_touch_time;
+	if (last_touch > now + 0xFFFFFFFF)
 	{
 		TLOG(TLVL_RESET) << "Buffer has touch time in the future, setting it to current time and ignoring...";
-		shmBuf->last_touch_time = TimeUtils::gettimeofday_us();
+		shmBuf->last_touch_time = now;
 		return false;
 	}
-	if (shm_ptr_->buffer_timeout_us == 0 || delta <= shm_ptr_->buffer_timeout_us || shmBuf->sem == BufferSemaphoreFlags::Empty)
+	size_t delta = now > last_touch ? now - last_touch : 0;
+	auto sem = shmBuf->sem.load();
+	int16_t owner = shmBuf->sem_id.load();
+	if ((sem == BufferSemaphoreFlags::Writing || sem == BufferSemaphoreFlags::Reading) && owner != manager_id_ && managerDead_(owner))
+	{
+		// The process holding the buffer is gone, so there is no need to wait for the timeout. Take ownership first,
+		// so that only one of the processes noticing this reclaims the buffer.
+		if (!shmBuf->sem_id.compare_exchange_strong(owner, manager_id_) || shmBuf->sem != sem)
+		{
+			return false;
+		}
+		TLOG(TLVL_WARNING) << "Buffer " << buffer << " (seqid=" << shmBuf->sequence_id << ") is held by manager " << owner
+		                   << ", which has exited. Resetting... " << FlagToString(sem) << "-->" << (sem == BufferSemaphoreFlags::Reading ? "Full" : "Empty");
+		if (sem == BufferSemaphoreFlags::Reading)
+		{
+			shmBuf->readPos = 0;
+			setBufferState_(shmBuf, BufferSemaphoreFlags::Full, now);
+		}
+		else
+		{
+			shmBuf->writePos = 0;
+			write_reservations_[buffer] = 0;
+			setBufferState_(shmBuf, BufferSemaphoreFlags::Empty, now);
+		}
+		shmBuf->sem_id = -1;
+		shm_ptr_->reap_count++;
+		bumpCounter_(shm_ptr_->telemetry.dead_owner_resets);
+		queueBuffer_(buffer);
+		if (sem == BufferSemaphoreFlags::Reading)
+		{
+			notifyReaders_();
+		}
+		else
+		{
+			notifyWriters_();
+		}
+		return true;
+	}
+	if (shm_ptr_->buffer_timeout_us == 0 || delta <= shm_ptr_->buffer_timeout_us + touch_clock_slack_us_ || sem == BufferSemaphoreFlags::Empty)
 	{
 		return false;
 	}
-	TLOG(TLVL_RESET) << "Buffer " << buffer << " at " << static_cast<void*>(shmBuf) << " is stale, time=" << TimeUtils::gettimeofday_us() << ", last touch=" << shmBuf->last_touch_time << ", d=" << delta << ", timeout=" << shm_ptr_->buffer_timeout_us;
+	TLOG(TLVL_RESET) << "Buffer " << buffer << " at " << static_cast<void*>(shmBuf) << " is stale, time=" << now << ", last touch=" << last_touch << ", d=" << delta << ", timeout=" << shm_ptr_->buffer_timeout_us;
 
 	if (shmBuf->sem_id == manager_id_ && shmBuf->sem == BufferSemaphoreFlags::Writing)
 	{
 		return true;
 	}
 
-	if (!shm_ptr_->destructive_read_mode && shmBuf->sem == BufferSemaphoreFlags::Full && manager_id_ == 0)
+	uint64_t floor;
+	if (!shm_ptr_->destructive_read_mode && shmBuf->sem == BufferSemaphoreFlags::Full && manager_id_ == 0 && !cursorFloor_(floor))  // Reader cursors decide when buffers are recycled, if there are any
 	{
 		TLOG(TLVL_RESET) << "Resetting old broadcast mode buffer " << buffer << " (seqid=" << shmBuf->sequence_id << "). State: Full-->Empty";
 		shmBuf->writePos = 0;
-		shmBuf->sem = BufferSemaphoreFlags::Empty;
+		write_reservations_[buffer] = 0;
+		setBufferState_(shmBuf, BufferSemaphoreFlags::Empty, now);
 		shmBuf->sem_id = -1;
 		if (shm_ptr_->reader_pos == static_cast<unsigned>(buffer))
 		{
 			shm_ptr_->reader_pos = (buffer + 1) % shm_ptr_->buffer_count;
 		}
+		shm_ptr_->reap_count++;
+		bumpCounter_(shm_ptr_->telemetry.stale_resets);
+		notifyWriters_();
 		return true;
 	}
 
 	if (shmBuf->sem_id != manager_id_ && shmBuf->sem == BufferSemaphoreFlags::Reading)
 	{
 		// Ron wants to re-check for potential interleave of buffer state updates
-		size_t delta = TimeUtils::gettimeofday_us() - shmBuf->last_touch_time;
-		if (delta <= shm_ptr_->buffer_timeout_us)
+		now = touchTime_();
+		last_touch = shmBuf->last_touch_time;
+		delta = now > last_touch ? now - last_touch : 0;
+		if (delta <= shm_ptr_->buffer_timeout_us + touch_clock_slack_us_)
 		{
 			return false;
 		}
@@ -1092,29 +1956,91 @@ bool artdaq::SharedMemoryManager::ResetBuffer(int buffer)
 		                   << " ( " << delta << " / " << shm_ptr_->buffer_timeout_us << " us ) detected! (seqid="
 		                   << shmBuf->sequence_id << ") Resetting... Reading-->Full";
 		shmBuf->readPos = 0;
-		shmBuf->sem = BufferSemaphoreFlags::Full;
+		setBufferState_(shmBuf, BufferSemaphoreFlags::Full, now);
 		shmBuf->sem_id = -1;
+		shm_ptr_->reap_count++;
+		bumpCounter_(shm_ptr_->telemetry.stale_resets);
+		queueBuffer_(buffer);
+		notifyReaders_();
 		return true;
 	}
 	return false;
 }
 
-bool artdaq::SharedMemoryManager::IsEndOfData() const
+void artdaq::SharedMemoryManager::startReaper_()
 {
-	if (!IsValid())
+	if (shm_ptr_->reaper_interval_us == 0 || reaper_thread_.joinable())
 	{
-		return true;
+		return;
+	}
+	TLOG(TLVL_REAPER) << "Starting reaper thread, interval " << shm_ptr_->reaper_interval_us << " us";
+	reaper_stop_ = false;
+	shm_ptr_->reaper_heartbeat_us = touchTime_();
+	reaper_thread_ = std::thread(&SharedMemoryManager::runReaper_, this);
+}
+
+void artdaq::SharedMemoryManager::stopReaper_()
+{
+	if (!reaper_thread_.joinable())
+	{
+		return;
+	}
+	TLOG(TLVL_REAPER) << "Stopping reaper thread";
+	if (in_signal_handler != 0)
+	{
+		// Joining and notifying are not async-signal-safe, and the reaper may be waiting for the arena lock held by the
+		// interrupted thread. Only ask it to stop; it exits at its next check, and a later Detach joins it. Until then
+		// Detach keeps the segment mapped.
+		reaper_stop_ = true;
+		return;
+	}
+	else
+	{
+		{
+			// Set the flag under the mutex, so that the reaper cannot miss the notification between its check and its wait
+			std::lock_guard<std::mutex> lk(reaper_mutex_);
+			reaper_stop_ = true;
+		}
+		reaper_cv_.notify_all();
+		reaper_thread_.join();
+	}
+	if (shm_ptr_ != nullptr)
+	{
+		shm_ptr_->reaper_heartbeat_us = 0;  // Other managers go back to checking buffers inline
+	}
+}
+
+void artdaq::SharedMemoryManager::runReaper_()
+{
+	reaper_of = this;  // Detach only stops the reaper when called from here, see Detach
+	auto interval = std::chrono::microseconds(shm_ptr_->reaper_interval_us);
+	std::unique_lock<std::mutex> lk(reaper_mutex_);
+	while (!reaper_stop_)
+	{
+		auto now = touchTime_();
+		shm_ptr_->reaper_heartbeat_us = now;
+		probeManagers_(now);
+		for (int ii = 0; !reaper_stop_ && ii < shm_ptr_->buffer_count; ++ii)
+		{
+			if (resetBuffer_(ii, now, true))
+			{
+				TLOG(TLVL_REAPER) << "Reaper found stale buffer " << ii;
+			}
+		}
+		reaper_cv_.wait_for(lk, interval, [this] { return reaper_stop_.load(); });
 	}
+	TLOG(TLVL_REAPER) << "Reaper thread exiting";
+}
 
-	struct shmid_ds info;
-	auto sts = shmctl(shm_segment_id_, IPC_STAT, &info);
-	if (sts < 0)
+bool artdaq::SharedMemoryManager::IsEndOfData() const
+{
+	if (!IsValid())
 	{
-		TLOG(TLVL_BUFINFO) << "Error accessing Shared Memory info: " << errno << " (" << strerror(errno) << ").";
 		return true;
 	}
 
-	if ((info.shm_perm.mode & SHM_DEST) != 0)
+	// The SysV backend also reports removal by other means, e.g. ipcrm or a crashed owner's cleanup
+	if (shm_ptr_->end_of_data || (backend_ && backend_->IsRemoved()))
 	{
 		TLOG(TLVL_INFO) << "Shared Memory marked for destruction. Probably an end-of-data condition!";
 		return true;
@@ -1130,15 +2056,9 @@ uint16_t artdaq::SharedMemoryManager::GetAttachedCount() const
 		return 0;
 	}
 
-	struct shmid_ds info;
-	auto sts = shmctl(shm_segment_id_, IPC_STAT, &info);
-	if (sts < 0)
-	{
-		TLOG(TLVL_BUFINFO) << "Error accessing Shared Memory info: " << errno << " (" << strerror(errno) << ").";
-		return 0;
-	}
-
-	return info.shm_nattch;
+	// Prefer the operating system's count, which also drops when an attached process crashes
+	auto count = backend_ ? backend_->AttachCount() : -1;
+	return count >= 0 ? count : shm_ptr_->attached_count.load();
 }
 
 size_t artdaq::SharedMemoryManager::Write(int buffer, void* data, size_t size)
@@ -1164,11 +2084,16 @@ size_t artdaq::SharedMemoryManager::Write(int buffer, void* data, size_t size)
 		                 << ",writePos=" << shmBuf->writePos << ",writeSize=" << size;
 		Detach(true, "SharedMemoryWrite", "Attempted to write more data than fits into Shared Memory! \nRe-run with a larger buffer size!");
 	}
+	if (!ensureCapacity_(shmBuf, shmBuf->writePos + size))
+	{
+		TLOG(TLVL_WARNING) << "Write: No arena space for " << size << " more bytes in buffer " << buffer << " after waiting " << requested_options_.arena_wait_us << " us";
+		return 0;
+	}
 
 	auto pos = GetWritePos(buffer);
 	memcpy(pos, data, size);
-	touchBuffer_(shmBuf);
 	shmBuf->writePos = shmBuf->writePos + size;
+	write_reservations_[buffer] = 0;
 
 	auto last_seen = last_seen_id_.load();
 	while (last_seen < shmBuf->sequence_id && !last_seen_id_.compare_exchange_weak(last_seen, shmBuf->sequence_id)) {}
@@ -1177,6 +2102,119 @@ size_t artdaq::SharedMemoryManager::Write(int buffer, void* data, size_t size)
 	return size;
 }
 
+size_t artdaq::SharedMemoryManager::WriteV(int buffer, struct iovec const* iov, size_t n)
+{
+	TLOG(TLVL_WRITE) << "WriteV BEGIN, buffer=" << buffer << ", pieces=" << n;
+	if (buffer >= shm_ptr_->buffer_count)
+	{
+		Detach(true, "ArgumentOutOfRange", "The specified buffer does not exist!");
+	}
+	size_t size = 0;
+	for (size_t ii = 0; ii < n; ++ii)
+	{
+		size += iov[ii].iov_len;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+
+	std::lock_guard<std::mutex> lk(buffer_mutexes_[buffer]);
+	auto shmBuf = getBufferInfo_(buffer);
+	if (shmBuf == nullptr)
+	{
+		return -1;
+	}
+	checkBuffer_(shmBuf, BufferSemaphoreFlags::Writing);
+	touchBuffer_(shmBuf);
+	if (shmBuf->writePos + size > shm_ptr_->buffer_size)
+	{
+		TLOG(TLVL_ERROR) << "Attempted to write more data than fits into Shared Memory, bufferSize=" << std::dec << shm_ptr_->buffer_size
+		                 << ",writePos=" << shmBuf->writePos << ",writeSize=" << size;
+		Detach(true, "SharedMemoryWrite", "Attempted to write more data than fits into Shared Memory! \nRe-run with a larger buffer size!");
+	}
+	if (!ensureCapacity_(shmBuf, shmBuf->writePos + size))
+	{
+		TLOG(TLVL_WARNING) << "WriteV: No arena space for " << size << " more bytes in buffer " << buffer << " after waiting " << requested_options_.arena_wait_us << " us";
+		return 0;
+	}
+
+	auto pos = bufferStart_(buffer) + shmBuf->writePos;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	for (size_t ii = 0; ii < n; ++ii)
+	{
+		auto const& piece = iov[ii];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		if (piece.iov_len >= nontemporal_copy_threshold_)
+		{
+			stream_copy(pos, piece.iov_base, piece.iov_len);
+		}
+		else
+		{
+			memcpy(pos, piece.iov_base, piece.iov_len);
+		}
+		pos += piece.iov_len;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+	shmBuf->writePos = shmBuf->writePos + size;
+	write_reservations_[buffer] = 0;
+
+	auto last_seen = last_seen_id_.load();
+	while (last_seen < shmBuf->sequence_id && !last_seen_id_.compare_exchange_weak(last_seen, shmBuf->sequence_id)) {}
+
+	TLOG(TLVL_WRITE) << "WriteV END, wrote " << size << " bytes";
+	return size;
+}
+
+artdaq::SharedMemoryManager::WriteReservation artdaq::SharedMemoryManager::ReserveWrite(int buffer, size_t max_bytes)
+{
+	TLOG(TLVL_WRITE) << "ReserveWrite BEGIN, buffer=" << buffer << ", max_bytes=" << max_bytes;
+	if (buffer >= shm_ptr_->buffer_count)
+	{
+		Detach(true, "ArgumentOutOfRange", "The specified buffer does not exist!");
+	}
+	std::lock_guard<std::mutex> lk(buffer_mutexes_[buffer]);
+	WriteReservation reservation;
+	auto shmBuf = getBufferInfo_(buffer);
+	if (shmBuf == nullptr)
+	{
+		return reservation;
+	}
+	checkBuffer_(shmBuf, BufferSemaphoreFlags::Writing);
+	touchBuffer_(shmBuf);
+	if (!ensureCapacity_(shmBuf, shmBuf->writePos + max_bytes))
+	{
+		TLOG(TLVL_WARNING) << "ReserveWrite: Buffer " << buffer << " cannot hold " << max_bytes << " more bytes (writePos=" << shmBuf->writePos << ", bufferSize=" << shm_ptr_->buffer_size << ")";
+		write_reservations_[buffer] = 0;
+		return reservation;
+	}
+
+	reservation.data = bufferStart_(buffer) + shmBuf->writePos;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	reservation.size = max_bytes;
+	write_reservations_[buffer] = max_bytes;
+	return reservation;
+}
+
+bool artdaq::SharedMemoryManager::CommitWrite(int buffer, size_t bytes)
+{
+	TLOG(TLVL_WRITE) << "CommitWrite BEGIN, buffer=" << buffer << ", bytes=" << bytes;
+	if (buffer >= shm_ptr_->buffer_count)
+	{
+		Detach(true, "ArgumentOutOfRange", "The specified buffer does not exist!");
+	}
+	std::lock_guard<std::mutex> lk(buffer_mutexes_[buffer]);
+	auto shmBuf = getBufferInfo_(buffer);
+	if (shmBuf == nullptr)
+	{
+		return false;
+	}
+	if (!checkBuffer_(shmBuf, BufferSemaphoreFlags::Writing, false) || bytes > write_reservations_[buffer])
+	{
+		TLOG(TLVL_ERROR) << "CommitWrite: " << bytes << " bytes do not match the reservation of " << write_reservations_[buffer] << " bytes in buffer " << buffer;
+		return false;
+	}
+	touchBuffer_(shmBuf);
+	shmBuf->writePos = shmBuf->writePos + bytes;
+	write_reservations_[buffer] = 0;
+
+	auto last_seen = last_seen_id_.load();
+	while (last_seen < shmBuf->sequence_id && !last_seen_id_.compare_exchange_weak(last_seen, shmBuf->sequence_id)) {}
+	return true;
+}
+
 bool artdaq::SharedMemoryManager::Read(int buffer, void* data, size_t size)
 {
 	if (buffer >= shm_ptr_->buffer_count)
@@ -1192,9 +2230,10 @@ bool artdaq::SharedMemoryManager::Read(int buffer, void* data, size_t size)
 	}
 	checkBuffer_(shmBuf, BufferSemaphoreFlags::Reading);
 	touchBuffer_(shmBuf);
-	if (shmBuf->readPos + size > shm_ptr_->buffer_size)
+	auto limit = shm_ptr_->arena_size > 0 ? shmBuf->data_capacity : shm_ptr_->buffer_size;
+	if (shmBuf->readPos + size > limit)
 	{
-		TLOG(TLVL_ERROR) << "Attempted to read more data than fits into Shared Memory, bufferSize=" << shm_ptr_->buffer_size
+		TLOG(TLVL_ERROR) << "Attempted to read more data than fits into Shared Memory, bufferSize=" << limit
 		                 << ",readPos=" << shmBuf->readPos << ",readSize=" << size;
 		Detach(true, "SharedMemoryRead", "Attempted to read more data than exists in Shared Memory!");
 	}
@@ -1207,7 +2246,6 @@ bool artdaq::SharedMemoryManager::Read(int buffer, void* data, size_t size)
 	if (sts)
 	{
 		shmBuf->readPos += size;
-		touchBuffer_(shmBuf);
 		return true;
 	}
 	return false;
@@ -1219,8 +2257,11 @@ std::string artdaq::SharedMemoryManager::toString()
 	{
 		return "Not connected to shared memory";
 	}
+	SegmentTelemetry telemetry;
+	snapshotTelemetry_(shm_ptr_, telemetry);
 	std::ostringstream ostr;
 	ostr << "ShmStruct: " << std::endl
+	     << "Backend: " << (backend_ ? backend_->Describe() : "none") << std::endl
 	     << "Reader Position: " << shm_ptr_->reader_pos << std::endl
 	     << "Writer Position: " << shm_ptr_->writer_pos << std::endl
 	     << "Next ID Number: " << shm_ptr_->next_id << std::endl
@@ -1231,7 +2272,48 @@ std::string artdaq::SharedMemoryManager::toString()
 	     << "Number of Writers: " << shm_ptr_->writer_count << std::endl
 	     << "Number of Readers: " << shm_ptr_->reader_count << std::endl
 	     << "Ready Magic Bytes: " << std::hex << std::showbase << shm_ptr_->ready_magic << std::dec << std::endl
-	     << std::endl;
+	     << "Layout Version: " << shm_ptr_->layout_version << std::endl
+	     << "Huge Pages: " << std::boolalpha << shm_ptr_->huge_pages << std::noboolalpha << std::endl
+	     << "NUMA Node: " << shm_ptr_->numa_node << std::endl
+	     << "Touch Clock: " << (shm_ptr_->coarse_touch_clock ? "coarse" : "precise") << std::endl
+	     << "Reaper Interval: " << shm_ptr_->reaper_interval_us << " us" << std::endl
+	     << "Buffers Reaped: " << shm_ptr_->reap_count << std::endl
+	     << "Overwrites: " << telemetry.overwrites << std::endl
+	     << "Reader Clobbers: " << telemetry.reader_clobbers << std::endl
+	     << "Failed Acquisitions: " << telemetry.failed_reads << " read, " << telemetry.failed_writes << " write" << std::endl;
+	if (shm_ptr_->arena_size > 0)
+	{
+		ostr << "Arena Size: " << shm_ptr_->arena_size << " bytes" << std::endl
+		     << "Arena Free: " << GetArenaFreeBytes() << " bytes" << std::endl;
+	}
+	if (shm_ptr_->queue_capacity > 0)
+	{
+		ostr << "Index Queue Capacity: " << shm_ptr_->queue_capacity << std::endl
+		     << "Empty Queue Depth: " << queueDepth_(&shm_ptr_->empty_queue) << std::endl
+		     << "Full Queue Depth: " << queueDepth_(&shm_ptr_->full_queue) << std::endl;
+		for (size_t destination = 0; destination < shm_ptr_->destination_queues; ++destination)
+		{
+			ostr << "Destination " << destination << " Queue Depth: " << queueDepth_(&shm_ptr_->destination_queue[destination]) << std::endl;
+		}
+	}
+	if (shm_ptr_->reader_cursors)
+	{
+		ostr << "Reader Cursors: max lag " << shm_ptr_->max_cursor_lag << ", buffers recycled " << shm_ptr_->recycle_count << std::endl;
+		for (auto const& cursor : GetReaderCursorStats())
+		{
+			ostr << "Reader " << cursor.owner << ": position " << cursor.position << (cursor.dropped ? " (dropped)" : "") << ", drops " << cursor.drops << std::endl;
+		}
+	}
+	if (shm_ptr_->dispatch_lanes > 0)
+	{
+		ostr << "Dispatch Lanes: " << shm_ptr_->dispatch_lanes << std::endl;
+		for (size_t lane = 0; lane < shm_ptr_->dispatch_lanes; ++lane)
+		{
+			ostr << "Lane " << lane << ": owner " << shm_ptr_->lanes[lane].owner << ", dispatched " << shm_ptr_->lanes[lane].dispatched
+			     << ", consumed " << shm_ptr_->lanes[lane].consumed << std::endl;
+		}
+	}
+	ostr << std::endl;
 
 	for (auto ii = 0; ii < shm_ptr_->buffer_count; ++ii)
 	{
@@ -1323,7 +2405,7 @@ bool artdaq::SharedMemoryManager::checkBuffer_(ShmBuffer* buffer, BufferSemaphor
 	return ret;
 }
 
-void artdaq::SharedMemoryManager::touchBuffer_(ShmBuffer* buffer)
+void artdaq::SharedMemoryManager::touchBuffer_(ShmBuffer* buffer, uint64_t now)
 {
 	if ((buffer == nullptr) || (buffer->sem_id != -1 && buffer->sem_id != manager_id_))
 	{
@@ -1331,57 +2413,1038 @@ void artdaq::SharedMemoryManager::touchBuffer_(ShmBuffer* buffer)
 		return;
 	}
 	TLOG(TLVL_CHKBUFFER + 1) << "touchBuffer_: Touching buffer at " << static_cast<void*>(buffer) << " with sequence_id " << buffer->sequence_id;
-	buffer->last_touch_time = TimeUtils::gettimeofday_us();
+	buffer->last_touch_time = now;
 }
 
-void artdaq::SharedMemoryManager::Detach(bool throwException, const std::string& category, const std::string& message, bool force)
+void artdaq::SharedMemoryManager::setBufferState_(ShmBuffer* buffer, BufferSemaphoreFlags state, uint64_t now, int destination)
 {
-	TLOG(TLVL_DETACH) << "Detach BEGIN: throwException: " << std::boolalpha << throwException << ", force: " << force;
-	if (IsValid())
+	// Release arena space before the buffer becomes available, so that only the new owner can touch data_capacity
+	if (state == BufferSemaphoreFlags::Empty)
 	{
-		TLOG(TLVL_DETACH) << "Detach: Resetting owned buffers";
-		auto bufs = GetBuffersOwnedByManager(false);
-		for (auto buf : bufs)
+		releaseArena_(buffer);
+	}
+	auto previous = buffer->sem.exchange(state);
+	countStateChange_(buffer, previous, state, destination, now);
+}
+
+bool artdaq::SharedMemoryManager::casBufferState_(ShmBuffer* buffer, BufferSemaphoreFlags& expected, BufferSemaphoreFlags state, uint64_t now)
+{
+	if (!buffer->sem.compare_exchange_strong(expected, state))
+	{
+		return false;
+	}
+	countStateChange_(buffer, expected, state, -1, now);
+	if (state == BufferSemaphoreFlags::Writing)
+	{
+		releaseArena_(buffer);  // Overwriting a buffer which was not emptied
+	}
+	return true;
+}
+
+void artdaq::SharedMemoryManager::lockArena_() const
+{
+	auto sts = pthread_mutex_lock(&shm_ptr_->arena_mutex);
+	if (sts == EOWNERDEAD)
+	{
+		TLOG(TLVL_WARNING) << "A process died while holding the arena lock, recovering it";
+		pthread_mutex_consistent(&shm_ptr_->arena_mutex);
+	}
+}
+
+void artdaq::SharedMemoryManager::unlockArena_() const
+{
+	pthread_mutex_unlock(&shm_ptr_->arena_mutex);
+}
+
+bool artdaq::SharedMemoryManager::allocateArena_(size_t size, size_t& offset)
+{
+	// Called with the arena lock held
+	auto arena = shm_ptr_->arena_size;
+	auto length = sizeof(ShmArenaRecord) + cacheLineRound_(size);
+	if (shm_ptr_->arena_head == shm_ptr_->arena_tail)
+	{
+		// Nothing allocated: start over at the beginning, so that even the largest buffer fits
+		shm_ptr_->arena_head = shm_ptr_->arena_tail = (shm_ptr_->arena_head + arena - 1) / arena * arena;
+	}
+
+	auto pos = shm_ptr_->arena_head % arena;
+	size_t padding = pos + length > arena ? arena - pos : 0;  // Allocations do not wrap around the end of the arena
+	if (shm_ptr_->arena_head - shm_ptr_->arena_tail + padding + length > arena)
+	{
+		return false;
+	}
+
+	if (padding > 0)
+	{
+		auto pad = reinterpret_cast<ShmArenaRecord*>(dataStart_() + pos);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		pad->length = padding;
+		pad->released = true;
+		shm_ptr_->arena_head += padding;
+		pos = 0;
+	}
+	auto record = reinterpret_cast<ShmArenaRecord*>(dataStart_() + pos);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	record->length = length;
+	record->released = false;
+	shm_ptr_->arena_head += length;
+	offset = pos + sizeof(ShmArenaRecord);
+	return true;
+}
+
+void artdaq::SharedMemoryManager::releaseArena_(ShmBuffer* buffer)
+{
+	if (shm_ptr_->arena_size == 0 || buffer->data_capacity == 0)
+	{
+		return;
+	}
+	if (in_signal_handler != 0)
+	{
+		// The interrupted thread may hold the arena lock. The buffer keeps its space, which is released when the
+		// buffer is next taken for writing.
+		return;
+	}
+	lockArena_();
+	reinterpret_cast<ShmArenaRecord*>(dataStart_() + buffer->data_offset - sizeof(ShmArenaRecord))->released = true;  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	buffer->data_capacity = 0;
+
+	// Space is reclaimed in allocation order, up to the oldest allocation still in use
+	while (shm_ptr_->arena_tail != shm_ptr_->arena_head)
+	{
+		auto record = reinterpret_cast<ShmArenaRecord*>(dataStart_() + shm_ptr_->arena_tail % shm_ptr_->arena_size);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		if (!record->released)
 		{
-			auto shmBuf = getBufferInfo_(buf);
-			if (shmBuf == nullptr)
-			{
-				continue;
-			}
-			if (shmBuf->sem == BufferSemaphoreFlags::Writing)
-			{
-				shmBuf->sem = BufferSemaphoreFlags::Empty;
-			}
-			else if (shmBuf->sem == BufferSemaphoreFlags::Reading)
+			break;
+		}
+		shm_ptr_->arena_tail += record->length;
+	}
+	unlockArena_();
+}
+
+bool artdaq::SharedMemoryManager::ensureCapacity_(ShmBuffer* buffer, size_t needed)
+{
+	if (shm_ptr_->arena_size == 0)
+	{
+		return needed <= shm_ptr_->buffer_size;
+	}
+	if (needed <= buffer->data_capacity)
+	{
+		return true;
+	}
+	if (needed > shm_ptr_->buffer_size)
+	{
+		return false;
+	}
+
+	auto start_time = std::chrono::steady_clock::now();
+	size_t timeout_us = requested_options_.arena_wait_us;
+	while (true)
+	{
+		auto last_value = shm_ptr_->write_futex.load();
+		lockArena_();
+		auto capacity = buffer->data_capacity;
+		if (capacity > 0)
+		{
+			// Grow in place if this buffer holds the most recent allocation, and there is room before the end of the arena
+			auto record_pos = buffer->data_offset - sizeof(ShmArenaRecord);
+			auto record = reinterpret_cast<ShmArenaRecord*>(dataStart_() + record_pos);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+			auto extra = cacheLineRound_(needed) - capacity;
+			if (record_pos + record->length == shm_ptr_->arena_head % shm_ptr_->arena_size &&
+			    record_pos + record->length + extra <= shm_ptr_->arena_size &&
+			    shm_ptr_->arena_head - shm_ptr_->arena_tail + extra <= shm_ptr_->arena_size)
 			{
-				shmBuf->sem = BufferSemaphoreFlags::Full;
+				record->length += extra;
+				shm_ptr_->arena_head += extra;
+				buffer->data_capacity = capacity + extra;
+				unlockArena_();
+				return true;
 			}
-			shmBuf->sem_id = -1;
 		}
-		if (registered_reader_)
+
+		size_t offset = 0;
+		if (allocateArena_(needed, offset))
 		{
-			shm_ptr_->reader_count--;
-			registered_reader_ = false;
+			unlockArena_();
+			if (capacity > 0)
+			{
+				// Move what has been written so far, then give back the old space
+				memcpy(dataStart_() + offset, dataStart_() + buffer->data_offset, buffer->writePos);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+				releaseArena_(buffer);
+			}
+			buffer->data_offset = offset;
+			buffer->data_capacity = cacheLineRound_(needed);
+			return true;
 		}
-		if (registered_writer_)
+		unlockArena_();
+
+		auto elapsed = TimeUtils::GetElapsedTimeMicroseconds(start_time);
+		if (elapsed >= timeout_us || IsEndOfData())
 		{
-			shm_ptr_->writer_count--;
-			registered_writer_ = false;
+			return false;
 		}
+		TLOG(TLVL_WRITE) << "Waiting for " << needed << " bytes of arena space";
+		waitForChange_(&shm_ptr_->write_futex, &shm_ptr_->write_waiters, last_value, timeout_us - elapsed);
 	}
+}
 
-	if (shm_ptr_ != nullptr)
+bool artdaq::SharedMemoryManager::AddBufferType(int buffer, uint8_t type)
+{
+	if (buffer >= shm_ptr_->buffer_count)
 	{
-		TLOG(TLVL_DETACH) << "Detach: Detaching shared memory";
-		shmdt(shm_ptr_);
-		shm_ptr_ = nullptr;
+		Detach(true, "ArgumentOutOfRange", "The specified buffer does not exist!");
+	}
+	std::lock_guard<std::mutex> lk(buffer_mutexes_[buffer]);
+	auto buf = getBufferInfo_(buffer);
+	// Only the writer touches the mask while the buffer is Writing; readers see it once the buffer is marked Full
+	if (!checkBuffer_(buf, BufferSemaphoreFlags::Writing, false))
+	{
+		TLOG(TLVL_WARNING) << "AddBufferType: Buffer " << buffer << " is not being written by manager " << manager_id_ << ", not publishing type " << static_cast<int>(type);
+		return false;
+	}
+	buf->type_mask[type / 64] |= uint64_t(1) << (type % 64);
+	return true;
+}
+
+bool artdaq::SharedMemoryManager::BufferHasAnyType(int buffer, BufferTypeMask const& types)
+{
+	auto buf = getBufferInfo_(buffer);
+	if (buf == nullptr)
+	{
+		return false;
+	}
+	bool published = false;
+	for (size_t word = 0; word < 4; ++word)
+	{
+		auto mask = buf->type_mask[word];
+		if (mask == 0) continue;
+		published = true;
+		auto interest = ((types >> (word * 64)) & BufferTypeMask(UINT64_MAX)).to_ullong();
+		if ((mask & interest) != 0) return true;
+	}
+	return !published;
+}
+
+size_t artdaq::SharedMemoryManager::GetArenaFreeBytes() const
+{
+	if (!UsesArena())
+	{
+		return 0;
+	}
+	lockArena_();
+	auto used = shm_ptr_->arena_head - shm_ptr_->arena_tail;
+	unlockArena_();
+	return shm_ptr_->arena_size - used;
+}
+
+void artdaq::SharedMemoryManager::countStateChange_(ShmBuffer* buffer, BufferSemaphoreFlags from, BufferSemaphoreFlags to, int destination, uint64_t now)
+{
+	if (from != to)
+	{
+		shm_ptr_->state_count[static_cast<int>(from)]--;
+		shm_ptr_->state_count[static_cast<int>(to)]++;
+
+		// Counted in this manager's own lines, so that telemetry adds no traffic between the attached processes
+		auto& telemetry = transitionTelemetry_();
+		bumpCounter_(telemetry.transitions[static_cast<int>(from)][static_cast<int>(to)]);
+		if (manager_id_ >= 0 && manager_id_ < max_tracked_managers_)
+		{
+			if (to == BufferSemaphoreFlags::Reading) bumpCounter_(shm_ptr_->manager_telemetry[manager_id_].reads);
+			if (to == BufferSemaphoreFlags::Writing) bumpCounter_(shm_ptr_->manager_telemetry[manager_id_].writes);
+		}
+		if (from == BufferSemaphoreFlags::Reading || to == BufferSemaphoreFlags::Full || to == BufferSemaphoreFlags::Reading)
+		{
+			auto since = buffer->state_time.load(std::memory_order_relaxed);
+			auto elapsed = now > since ? now - since : 0;
+			if (from == BufferSemaphoreFlags::Full && to == BufferSemaphoreFlags::Reading) bumpCounter_(telemetry.queue_time[histogramBin_(elapsed)]);
+			if (from == BufferSemaphoreFlags::Reading) bumpCounter_(telemetry.hold_time[histogramBin_(elapsed)]);
+			buffer->state_time.store(now, std::memory_order_relaxed);
+		}
+	}
+	else if (to != BufferSemaphoreFlags::Full)
+	{
+		return;
+	}
+
+	// A Full buffer stays in the slot of the destination it was marked Full for, even while its sem_id changes
+	if (from == BufferSemaphoreFlags::Full)
+	{
+		shm_ptr_->full_count[fullSlot_(buffer->full_destination)]--;
+	}
+	if (to == BufferSemaphoreFlags::Full)
+	{
+		buffer->full_destination = destination;
+		shm_ptr_->full_count[fullSlot_(destination)]++;
+	}
+}
+
+void artdaq::SharedMemoryManager::countFailedAcquisition_(bool writing)
+{
+	auto& telemetry = transitionTelemetry_();
+	bumpCounter_(writing ? telemetry.failed_writes : telemetry.failed_reads);
+}
+
+bool artdaq::SharedMemoryManager::enqueueIndex_(ShmIndexQueue* queue, int buffer)
+{
+	auto cells = queueCells_(queue);
+	auto mask = shm_ptr_->queue_capacity - 1;
+	auto pos = queue->enqueue_pos.load(std::memory_order_relaxed);
+	ShmQueueCell* cell;
+	while (true)
+	{
+		cell = &cells[pos & mask];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		auto seq = cell->sequence.load(std::memory_order_acquire);
+		auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if (diff == 0)
+		{
+			if (queue->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		}
+		else if (diff < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = queue->enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+	cell->buffer = buffer;
+	cell->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+int artdaq::SharedMemoryManager::dequeueIndex_(ShmIndexQueue* queue)
+{
+	auto cells = queueCells_(queue);
+	auto mask = shm_ptr_->queue_capacity - 1;
+	auto pos = queue->dequeue_pos.load(std::memory_order_relaxed);
+	ShmQueueCell* cell;
+	while (true)
+	{
+		cell = &cells[pos & mask];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		auto seq = cell->sequence.load(std::memory_order_acquire);
+		auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+		if (diff == 0)
+		{
+			if (queue->dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		}
+		else if (diff < 0)
+		{
+			return -1;
+		}
+		else
+		{
+			pos = queue->dequeue_pos.load(std::memory_order_relaxed);
+		}
+	}
+	auto buffer = cell->buffer;
+	cell->sequence.store(pos + mask + 1, std::memory_order_release);
+
+	auto buf = getBufferInfo_(buffer);
+	if (buf != nullptr) buf->queued = false;
+	return buffer;
+}
+
+void artdaq::SharedMemoryManager::queueBuffer_(int buffer)
+{
+	if (!UsesIndexQueues()) return;
+	auto buf = getBufferInfo_(buffer);
+	if (buf == nullptr) return;
+
+	// The queued flag guarantees at most one queue entry per buffer, so neither queue can overflow. Whoever
+	// holds the flag is responsible for queueing the buffer; if it is not in a queueable state, the flag is
+	// released and the state re-checked, in case another process changed it while we held the flag.
+	while (!buf->queued.exchange(true))
+	{
+		auto sem = buf->sem.load();
+		auto sem_id = buf->sem_id.load();
+		ShmIndexQueue* queue = nullptr;
+		if (sem == BufferSemaphoreFlags::Empty && sem_id == -1)
+		{
+			queue = &shm_ptr_->empty_queue;
+		}
+		else if (sem == BufferSemaphoreFlags::Full)
+		{
+			queue = destinationQueue_(sem_id);
+			if (queue == nullptr) queue = &shm_ptr_->full_queue;
+		}
+
+		if (queue != nullptr)
+		{
+			if (!enqueueIndex_(queue, buffer))
+			{
+				TLOG(TLVL_ERROR) << "Index queue overflow while queueing buffer " << buffer << "! This should not happen!";
+				buf->queued = false;
+			}
+			return;
+		}
+
+		buf->queued = false;
+		sem = buf->sem.load();
+		if (sem != BufferSemaphoreFlags::Empty && sem != BufferSemaphoreFlags::Full) return;
+	}
+}
+
+int artdaq::SharedMemoryManager::getQueuedBufferForReading_(uint64_t now)
+{
+	sweepStaleBuffer_(now);
+
+	// Buffers sent to this manager first, then buffers for any reader
+	auto own_queue = destinationQueue_(manager_id_);
+	auto buffer = own_queue != nullptr ? dequeueBufferForReading_(own_queue, now) : -1;
+	if (buffer == -1)
+	{
+		buffer = dequeueBufferForReading_(&shm_ptr_->full_queue, now);
+	}
+	if (buffer == -1)
+	{
+		TLOG(TLVL_GETBUFFER) << "GetBufferForReading returning -1 because the Full queue is empty";
 	}
+	return buffer;
+}
 
-	if ((force || manager_id_ == 0) && shm_segment_id_ > -1)
+int artdaq::SharedMemoryManager::dequeueBufferForReading_(ShmIndexQueue* queue, uint64_t now)
+{
+	for (size_t attempt = 0; attempt < shm_ptr_->queue_capacity; ++attempt)
+	{
+		auto buffer = dequeueIndex_(queue);
+		if (buffer == -1) break;
+
+		auto buf = getBufferInfo_(buffer);
+		if (buf == nullptr) continue;
+
+		auto sem = BufferSemaphoreFlags::Full;
+		int16_t sem_id = buf->sem_id.load();
+		if (buf->sem != BufferSemaphoreFlags::Full || (sem_id != -1 && sem_id != manager_id_))
+		{
+			TLOG(TLVL_GETBUFFER + 1) << "GetBufferForReading: Queued buffer " << buffer << " is " << FlagToString(buf->sem) << " for manager " << sem_id << ", requeueing";
+			queueBuffer_(buffer);
+			continue;
+		}
+		if (!buf->sem_id.compare_exchange_strong(sem_id, manager_id_))
+		{
+			queueBuffer_(buffer);
+			continue;
+		}
+		if (!casBufferState_(buf, sem, BufferSemaphoreFlags::Reading, now))
+		{
+			int16_t expected = manager_id_;
+			buf->sem_id.compare_exchange_strong(expected, sem_id);
+			queueBuffer_(buffer);
+			continue;
+		}
+		buf->readPos = 0;
+		touchBuffer_(buf, now);
+
+		auto seqID = buf->sequence_id.load();
+		if (shm_ptr_->lowest_seq_id_read == last_seen_id_)
+		{
+			shm_ptr_->lowest_seq_id_read = seqID;
+		}
+		last_seen_id_ = seqID;
+		TLOG(TLVL_GETBUFFER) << "GetBufferForReading returning queued buffer " << buffer;
+		return buffer;
+	}
+	return -1;
+}
+
+int artdaq::SharedMemoryManager::getQueuedBufferForWriting_(uint64_t now)
+{
+	sweepStaleBuffer_(now);
+
+	for (size_t attempt = 0; attempt < shm_ptr_->queue_capacity; ++attempt)
+	{
+		auto buffer = dequeueIndex_(&shm_ptr_->empty_queue);
+		if (buffer == -1) break;
+
+		auto buf = getBufferInfo_(buffer);
+		if (buf == nullptr) continue;
+
+		auto sem = BufferSemaphoreFlags::Empty;
+		int16_t sem_id = -1;
+		if (!buf->sem_id.compare_exchange_strong(sem_id, manager_id_))
+		{
+			queueBuffer_(buffer);
+			continue;
+		}
+		if (!casBufferState_(buf, sem, BufferSemaphoreFlags::Writing, now))
+		{
+			int16_t expected = manager_id_;
+			buf->sem_id.compare_exchange_strong(expected, -1);
+			queueBuffer_(buffer);
+			continue;
+		}
+		buf->sequence_id = ++shm_ptr_->next_sequence_id;
+		buf->writePos = 0;
+		write_reservations_[buffer] = 0;
+		memset(buf->type_mask, 0, sizeof(buf->type_mask));
+		touchBuffer_(buf, now);
+		TLOG(TLVL_GETBUFFER + 1) << "GetBufferForWriting returning queued buffer " << buffer;
+		return buffer;
+	}
+
+	TLOG(TLVL_GETBUFFER + 1) << "GetBufferForWriting returning -1 because the Empty queue is empty";
+	return -1;
+}
+
+void artdaq::SharedMemoryManager::sweepStaleBuffer_(uint64_t now)
+{
+	// Without the full scan, stale buffers are detected incrementally: one buffer per acquisition attempt
+	if (reaperActive_(now)) return;
+	probeManagers_(now);
+	auto buffer = sweep_pos_.fetch_add(1) % shm_ptr_->buffer_count;
+	resetBuffer_(buffer, now);
+}
+
+void artdaq::SharedMemoryManager::registerReader_()
+{
+	if (registered_reader_)
+	{
+		return;
+	}
+	// Several threads (e.g. SharedMemoryEventReceiver cursors) may read for the first time at once; only one registers,
+	// and registered_reader_ is set last, so that the others see its cursor and lane
+	std::lock_guard<std::mutex> lk(registration_mutex_);
+	if (registered_reader_)
+	{
+		return;
+	}
+	shm_ptr_->reader_count++;
+	if (manager_id_ >= 0 && manager_id_ < max_tracked_managers_)
+	{
+		shm_ptr_->managers[manager_id_].reader = true;
+	}
+
+	for (size_t slot = 0; shm_ptr_->reader_cursors && slot < max_reader_cursors; ++slot)
+	{
+		int expected = -1;
+		if (shm_ptr_->cursors[slot].owner.compare_exchange_strong(expected, manager_id_))
+		{
+			// Start from the last buffer this manager saw, so that every buffer still in the segment is kept for it
+			shm_ptr_->cursors[slot].position = last_seen_id_.load();
+			shm_ptr_->cursors[slot].dropped = false;
+			shm_ptr_->cursors[slot].drops = 0;
+			reader_cursor_ = static_cast<int>(slot);
+			TLOG(TLVL_ATTACH) << "Manager " << manager_id_ << " reading with cursor " << slot;
+			break;
+		}
+	}
+	if (shm_ptr_->reader_cursors && reader_cursor_ == -1)
+	{
+		TLOG(TLVL_WARNING) << "All " << max_reader_cursors << " reader cursors are taken, buffers will not be held back for manager " << manager_id_;
+	}
+
+	for (size_t lane = 0; lane < shm_ptr_->dispatch_lanes; ++lane)
+	{
+		int expected = -1;
+		if (shm_ptr_->lanes[lane].owner.compare_exchange_strong(expected, manager_id_))
+		{
+			dispatch_lane_ = static_cast<int>(lane);
+			TLOG(TLVL_ATTACH) << "Manager " << manager_id_ << " reading from dispatch lane " << lane;
+			break;
+		}
+	}
+	if (shm_ptr_->dispatch_lanes > 0 && dispatch_lane_ == -1)
+	{
+		TLOG(TLVL_WARNING) << "All " << shm_ptr_->dispatch_lanes << " dispatch lanes are taken, manager " << manager_id_ << " will only read buffers sent to it or left in free lanes";
+	}
+	registered_reader_ = true;
+}
+
+bool artdaq::SharedMemoryManager::inDispatchLane_(ShmBuffer const* buffer) const
+{
+	if (shm_ptr_->dispatch_lanes == 0 || buffer->sem_id != -1)
+	{
+		return true;
+	}
+	auto lane = buffer->ticket % shm_ptr_->dispatch_lanes;
+	return static_cast<int>(lane) == dispatch_lane_ || shm_ptr_->lanes[lane].owner == -1;
+}
+
+void artdaq::SharedMemoryManager::registerWriter_()
+{
+	if (registered_writer_)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lk(registration_mutex_);
+	if (registered_writer_)
+	{
+		return;
+	}
+	shm_ptr_->writer_count++;
+	if (manager_id_ >= 0 && manager_id_ < max_tracked_managers_)
+	{
+		shm_ptr_->managers[manager_id_].writer = true;
+	}
+	registered_writer_ = true;
+}
+
+void artdaq::SharedMemoryManager::recordManager_()
+{
+	if (manager_id_ < 0 || manager_id_ >= max_tracked_managers_)
+	{
+		TLOG(TLVL_ATTACH) << "Manager ID " << manager_id_ << " is beyond the liveness table, its buffers are only reclaimed by timeout";
+		return;
+	}
+	// Manager IDs may be handed out again after ResetAttachedCount, so every field is overwritten
+	auto& record = shm_ptr_->managers[manager_id_];
+	record.pid = 0;
+	record.dead = false;
+	record.reader = false;
+	record.writer = false;
+	record.start_time = process_start_time(getpid());
+	record.checked_us = 0;
+	record.pid = getpid();
+}
+
+void artdaq::SharedMemoryManager::probeManagers_(uint64_t now)
+{
+	// Liveness checks may read /proc, so they are made here, before search_mutex_ is taken (or by the reaper), and
+	// resetBuffer_ only looks at their outcome. Each process probes at most once per interval.
+	auto last = last_probe_us_.load();
+	if (now < last + liveness_check_interval_us_ || !last_probe_us_.compare_exchange_strong(last, now))
+	{
+		return;
+	}
+	for (int id = 0; id < max_tracked_managers_; ++id)
+	{
+		if (id != manager_id_ && shm_ptr_->managers[id].pid != 0)
+		{
+			managerAlive_(id, now);
+		}
+	}
+}
+
+bool artdaq::SharedMemoryManager::managerAlive_(int manager_id, uint64_t now, bool force)
+{
+	if (manager_id < 0 || manager_id >= max_tracked_managers_)
+	{
+		return true;
+	}
+	auto& record = shm_ptr_->managers[manager_id];
+	if (record.dead)
+	{
+		return false;
+	}
+	pid_t pid = record.pid;
+	if (pid == 0 || pid == getpid())
+	{
+		return true;
+	}
+
+	// Share the checks between every attached process: at most one per manager per interval
+	auto checked = record.checked_us.load();
+	if (!force && (now < checked + liveness_check_interval_us_ || !record.checked_us.compare_exchange_strong(checked, now)))
+	{
+		return true;
+	}
+
+	bool alive = kill(pid, 0) == 0 || errno != ESRCH;
+	if (alive && record.start_time != 0)
+	{
+		auto start_time = process_start_time(pid);
+		alive = start_time == 0 || start_time == record.start_time;  // A different start time means the PID was reused
+	}
+	if (!alive)
+	{
+		markManagerDead_(manager_id);
+	}
+	return alive;
+}
+
+void artdaq::SharedMemoryManager::markManagerDead_(int manager_id)
+{
+	auto& record = shm_ptr_->managers[manager_id];
+	bool expected = false;
+	if (!record.dead.compare_exchange_strong(expected, true))
+	{
+		return;
+	}
+	TLOG(TLVL_WARNING) << "Manager " << manager_id << " (pid " << record.pid << ") has exited without detaching, reclaiming its buffers and registrations";
+
+	if (record.reader.exchange(false)) shm_ptr_->reader_count--;
+	if (record.writer.exchange(false)) shm_ptr_->writer_count--;
+	if (backend_->AttachCount() < 0)
+	{
+		shm_ptr_->attached_count--;  // Backends which count attachments themselves (SysV) already dropped the dead process
+	}
+	for (auto& lane : shm_ptr_->lanes)
+	{
+		int owner = manager_id;
+		lane.owner.compare_exchange_strong(owner, -1);
+	}
+	for (auto& cursor : shm_ptr_->cursors)
+	{
+		int owner = manager_id;
+		cursor.owner.compare_exchange_strong(owner, -1);
+	}
+}
+
+void artdaq::SharedMemoryManager::rejoinCursor_()
+{
+	if (reader_cursor_ < 0 || !shm_ptr_->cursors[reader_cursor_].dropped)
+	{
+		return;
+	}
+	// Buffers recycled while this reader was dropped are gone; hold back everything newer than what it last read
+	auto& cursor = shm_ptr_->cursors[reader_cursor_];
+	cursor.position = std::max(cursor.position.load(), last_seen_id_.load());
+	cursor.dropped = false;
+	TLOG(TLVL_WARNING) << "Manager " << manager_id_ << " was dropped for lagging behind the writers, resuming after sequence ID " << cursor.position;
+}
+
+bool artdaq::SharedMemoryManager::cursorFloor_(uint64_t& floor) const
+{
+	if (!shm_ptr_->reader_cursors)
+	{
+		return false;
+	}
+	bool found = false;
+	floor = -1;
+	for (auto const& cursor : shm_ptr_->cursors)
+	{
+		if (cursor.owner != -1 && !cursor.dropped)
+		{
+			floor = std::min(floor, cursor.position.load());
+			found = true;
+		}
+	}
+	return found;
+}
+
+bool artdaq::SharedMemoryManager::recyclePassedBuffers_()
+{
+	uint64_t floor;
+	if (!cursorFloor_(floor))
+	{
+		return false;
+	}
+
+	auto now = touchTime_();  // One clock read per operation
+	bool recycled = false;
+	for (auto ii = 0; ii < shm_ptr_->buffer_count; ++ii)
+	{
+		auto buf = getBufferInfo_(ii);
+		if (buf == nullptr || buf->sem != BufferSemaphoreFlags::Full || buf->sem_id != -1 || buf->sequence_id > floor)
+		{
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lk(buffer_mutexes_[ii]);
+		// Own the buffer while changing its state, so that no reader or writer can claim it in between
+		int16_t sem_id = -1;
+		if (!buf->sem_id.compare_exchange_strong(sem_id, manager_id_))
+		{
+			continue;
+		}
+		// Owning the buffer keeps its state from changing, so it can be emptied like any other; this also releases its arena space
+		if (buf->sequence_id <= floor && buf->sem == BufferSemaphoreFlags::Full)
+		{
+			setBufferState_(buf, BufferSemaphoreFlags::Empty, now);
+			TLOG(TLVL_RESET) << "Every reader cursor has passed buffer " << ii << " (seqid=" << buf->sequence_id << "), recycling it";
+			buf->writePos = 0;
+			write_reservations_[ii] = 0;
+			shm_ptr_->recycle_count++;
+			recycled = true;
+		}
+		buf->sem_id = -1;
+	}
+	return recycled;
+}
+
+bool artdaq::SharedMemoryManager::dropLaggingCursor_()
+{
+	if (!shm_ptr_->reader_cursors || shm_ptr_->max_cursor_lag == 0)
+	{
+		return false;
+	}
+
+	ShmReaderCursor* slowest = nullptr;
+	for (auto& cursor : shm_ptr_->cursors)
+	{
+		if (cursor.owner != -1 && !cursor.dropped && (slowest == nullptr || cursor.position < slowest->position))
+		{
+			slowest = &cursor;
+		}
+	}
+	if (slowest == nullptr || shm_ptr_->next_sequence_id - slowest->position <= shm_ptr_->max_cursor_lag)
+	{
+		return false;
+	}
+
+	bool expected = false;
+	if (slowest->dropped.compare_exchange_strong(expected, true))
+	{
+		slowest->drops++;
+		TLOG(TLVL_WARNING) << "Reader " << slowest->owner << " is " << shm_ptr_->next_sequence_id - slowest->position
+		                   << " buffers behind the writers (limit " << shm_ptr_->max_cursor_lag << "), no longer holding buffers for it";
+	}
+	return recyclePassedBuffers_();
+}
+
+std::vector<artdaq::SharedMemoryManager::ReaderCursorStats> artdaq::SharedMemoryManager::GetReaderCursorStats() const
+{
+	std::vector<ReaderCursorStats> stats;
+	if (!IsValid() || !shm_ptr_->reader_cursors)
+	{
+		return stats;
+	}
+	for (auto const& cursor : shm_ptr_->cursors)
+	{
+		auto owner = cursor.owner.load();
+		if (owner != -1)
+		{
+			stats.push_back({owner, cursor.position.load(), cursor.dropped.load(), cursor.drops.load()});
+		}
+	}
+	return stats;
+}
+
+std::vector<artdaq::SharedMemoryManager::DispatchLaneStats> artdaq::SharedMemoryManager::GetDispatchLaneStats() const
+{
+	std::vector<DispatchLaneStats> stats;
+	if (!IsValid())
+	{
+		return stats;
+	}
+	for (size_t lane = 0; lane < shm_ptr_->dispatch_lanes; ++lane)
+	{
+		stats.push_back({shm_ptr_->lanes[lane].owner.load(), shm_ptr_->lanes[lane].dispatched.load(), shm_ptr_->lanes[lane].consumed.load()});
+	}
+	return stats;
+}
+
+artdaq::SharedMemoryManager::SegmentTelemetry artdaq::SharedMemoryManager::GetTelemetry() const
+{
+	SegmentTelemetry telemetry{};
+	if (IsValid())
+	{
+		snapshotTelemetry_(shm_ptr_, telemetry);
+	}
+	return telemetry;
+}
+
+bool artdaq::SharedMemoryManager::ReadTelemetry(uint32_t key, SegmentTelemetry& telemetry, SharedMemoryBackendType backend)
+{
+	auto segment = SharedMemoryBackend::Make(backend);
+	if (!segment->Open(key, sizeof(ShmStruct)))
+	{
+		TLOG(TLVL_DEBUG) << "ReadTelemetry: Could not open shared memory segment with key " << std::hex << std::showbase << key << ", errno=" << std::dec << errno << " (" << strerror(errno) << ")";
+		return false;
+	}
+	auto shm = static_cast<ShmStruct const*>(segment->Map(false));
+	auto ok = shm != nullptr && segment->Size() >= sizeof(ShmStruct) && shm->ready_magic == SHM_READY_MAGIC && layoutMatches_(shm);
+	if (ok)
+	{
+		snapshotTelemetry_(shm, telemetry);
+	}
+	if (shm != nullptr)
+	{
+		segment->Unmap(const_cast<ShmStruct*>(shm));  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+	}
+	segment->Close();
+	return ok;
+}
+
+void artdaq::SharedMemoryManager::snapshotTelemetry_(ShmStruct const* shm, SegmentTelemetry& telemetry)
+{
+	// The hot counters are kept per manager ID, so they are summed here
+	memset(telemetry.transitions, 0, sizeof(telemetry.transitions));
+	memset(telemetry.queue_time_us, 0, sizeof(telemetry.queue_time_us));
+	memset(telemetry.hold_time_us, 0, sizeof(telemetry.hold_time_us));
+	telemetry.failed_reads = 0;
+	telemetry.failed_writes = 0;
+	auto add = [&telemetry](ShmTransitionTelemetry const& counters) {
+		for (int from = 0; from < 4; ++from)
+		{
+			for (int to = 0; to < 4; ++to)
+			{
+				telemetry.transitions[from][to] += counters.transitions[from][to].load(std::memory_order_relaxed);
+			}
+		}
+		for (size_t bin = 0; bin < telemetry_histogram_bins; ++bin)
+		{
+			telemetry.queue_time_us[bin] += counters.queue_time[bin].load(std::memory_order_relaxed);
+			telemetry.hold_time_us[bin] += counters.hold_time[bin].load(std::memory_order_relaxed);
+		}
+		telemetry.failed_reads += counters.failed_reads.load(std::memory_order_relaxed);
+		telemetry.failed_writes += counters.failed_writes.load(std::memory_order_relaxed);
+	};
+
+	add(shm->telemetry.untracked);
+	telemetry.managers.clear();
+	for (int id = 0; id < max_tracked_managers_; ++id)
+	{
+		auto const& manager = shm->manager_telemetry[id];
+		add(manager.counters);
+		ManagerTelemetry entry{id, manager.reads.load(std::memory_order_relaxed), manager.writes.load(std::memory_order_relaxed),
+		                       manager.counters.failed_reads.load(std::memory_order_relaxed), manager.counters.failed_writes.load(std::memory_order_relaxed)};
+		if (entry.reads + entry.writes + entry.failed_reads + entry.failed_writes > 0)
+		{
+			telemetry.managers.push_back(entry);
+		}
+	}
+	telemetry.overwrites = telemetry.transitions[static_cast<int>(BufferSemaphoreFlags::Full)][static_cast<int>(BufferSemaphoreFlags::Writing)];
+	telemetry.reader_clobbers = telemetry.transitions[static_cast<int>(BufferSemaphoreFlags::Reading)][static_cast<int>(BufferSemaphoreFlags::Writing)];
+	telemetry.stale_resets = shm->telemetry.stale_resets.load(std::memory_order_relaxed);
+	telemetry.dead_owner_resets = shm->telemetry.dead_owner_resets.load(std::memory_order_relaxed);
+}
+
+void artdaq::SharedMemoryManager::notifyReaders_()
+{
+	shm_ptr_->read_futex.fetch_add(1);
+#ifdef __linux__
+	if (shm_ptr_->read_waiters.load() > 0)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&shm_ptr_->read_futex), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+#endif
+}
+
+void artdaq::SharedMemoryManager::notifyWriters_()
+{
+	shm_ptr_->write_futex.fetch_add(1);
+#ifdef __linux__
+	if (shm_ptr_->write_waiters.load() > 0)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&shm_ptr_->write_futex), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+#endif
+}
+
+void artdaq::SharedMemoryManager::waitForChange_(std::atomic<uint32_t>* futex, std::atomic<int>* waiters, uint32_t last_value, size_t timeout_us)
+{
+	static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32-bit integers");
+
+#ifdef __linux__
+	// Not FUTEX_PRIVATE_FLAG: the futex word is shared between processes
+	struct timespec timeout;
+	timeout.tv_sec = timeout_us / 1000000;
+	timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+	waiters->fetch_add(1);
+	auto sts = syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex), FUTEX_WAIT, last_value, &timeout, nullptr, 0);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	waiters->fetch_sub(1);
+	if (sts != 0 && errno != EAGAIN && errno != ETIMEDOUT && errno != EINTR)
+	{
+		TLOG(TLVL_WARNING) << "futex wait returned error " << errno << " (" << strerror(errno) << ")";
+	}
+#else
+	// No futexes; poll for changes
+	auto start_time = std::chrono::steady_clock::now();
+	while (futex->load() == last_value && TimeUtils::GetElapsedTimeMicroseconds(start_time) < timeout_us)
+	{
+		usleep(1000);
+	}
+	(void)waiters;
+#endif
+}
+
+void artdaq::SharedMemoryManager::Detach(bool throwException, const std::string& category, const std::string& message, bool force)
+{
+	TLOG(TLVL_DETACH) << "Detach BEGIN: throwException: " << std::boolalpha << throwException << ", force: " << force;
+	if (reaper_of == this)
+	{
+		// The reaper keeps using the segment once this returns, and an exception cannot leave its thread. Stop it
+		// and leave detaching to the owner.
+		TLOG(TLVL_ERROR) << "Reaper thread stopping: " << category << ": " << message;
+		reaper_stop_ = true;
+		return;
+	}
+	stopReaper_();
+	// A reaper asked to stop from the signal handler may still be using the segment until a later Detach joins it
+	bool reaper_running = reaper_thread_.joinable();
+	bool released = false;
+	if (IsValid())
+	{
+		TLOG(TLVL_DETACH) << "Detach: Resetting owned buffers";
+		auto bufs = GetBuffersOwnedByManager(false);
+		released = !bufs.empty();
+		auto now = touchTime_();
+		for (auto buf : bufs)
+		{
+			auto shmBuf = getBufferInfo_(buf);
+			if (shmBuf == nullptr)
+			{
+				continue;
+			}
+			if (shmBuf->sem == BufferSemaphoreFlags::Writing)
+			{
+				setBufferState_(shmBuf, BufferSemaphoreFlags::Empty, now);
+				write_reservations_[buf] = 0;
+			}
+			else if (shmBuf->sem == BufferSemaphoreFlags::Reading)
+			{
+				setBufferState_(shmBuf, BufferSemaphoreFlags::Full, now);
+			}
+			shmBuf->sem_id = -1;
+			queueBuffer_(buf);
+		}
+		if (registered_reader_)
+		{
+			shm_ptr_->reader_count--;
+			registered_reader_ = false;
+		}
+		if (dispatch_lane_ >= 0)
+		{
+			// Tickets already dealt to this lane are taken by the remaining readers until someone claims it
+			shm_ptr_->lanes[dispatch_lane_].owner = -1;
+			dispatch_lane_ = -1;
+		}
+		if (reader_cursor_ >= 0)
+		{
+			// Buffers this reader was the last to hold back go back to the writers
+			shm_ptr_->cursors[reader_cursor_].owner = -1;
+			reader_cursor_ = -1;
+			released = (in_signal_handler == 0 && recyclePassedBuffers_()) || released;  // Recycling takes buffer and arena locks
+		}
+		if (manager_id_ >= 0 && manager_id_ < max_tracked_managers_)
+		{
+			auto& record = shm_ptr_->managers[manager_id_];
+			record.reader = false;
+			record.writer = false;
+			record.pid = 0;
+		}
+		if (registered_writer_)
+		{
+			shm_ptr_->writer_count--;
+			registered_writer_ = false;
+		}
+	}
+
+	// Mark for removal before detaching, so that waiters woken below observe the end-of-data condition
+	bool removed = false;
+	if ((force || manager_id_ == 0) && backend_ && backend_->IsOpen())
 	{
 		TLOG(TLVL_DETACH) << "Detach: Marking Shared memory for removal";
-		shmctl(shm_segment_id_, IPC_RMID, nullptr);
-		shm_segment_id_ = -1;
+		if (shm_ptr_ != nullptr)
+		{
+			shm_ptr_->end_of_data = true;
+		}
+		backend_->Remove();
+		removed = true;
+	}
+
+	if (reaper_running)
+	{
+		TLOG(TLVL_DETACH) << "Detach: Reaper thread still running, leaving the segment mapped";
+		return;
+	}
+
+	if (shm_ptr_ != nullptr)
+	{
+		if (removed || released)
+		{
+			notifyReaders_();
+			notifyWriters_();
+		}
+		TLOG(TLVL_DETACH) << "Detach: Detaching shared memory";
+		shm_ptr_->attached_count--;
+		// Unmapping also releases any lock taken with lock_memory
+		backend_->Unmap(shm_ptr_);
+		shm_ptr_ = nullptr;
+		memory_locked_ = false;
+	}
+	if (backend_)
+	{
+		backend_->Close();
 	}
 
 	// Reset manager_id_
@@ -1,18 +1,147 @@
 #ifndef artdaq_core_Core_SharedMemoryManager_hh
 #define artdaq_core_Core_SharedMemoryManager_hh 1
 
+#include <algorithm>
 #include <atomic>
+#include <bitset>
+#include <condition_variable>
 #include <deque>
 #include <iomanip>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
+#include "artdaq-core/Core/SharedMemoryBackend.hh"
 #include "artdaq-core/Utilities/TimeUtils.hh"
 #include "sys/sysinfo.h"
 
+#include <pthread.h>
+#include <sys/uio.h>
+
 namespace artdaq {
+/**
+ * \brief Clock used for buffer touch timestamps, which drive the stale-buffer timeout
+ */
+enum class SharedMemoryTouchClock
+{
+	Precise,  ///< gettimeofday, microsecond resolution
+	Coarse    ///< CLOCK_REALTIME_COARSE: much cheaper, one scheduler tick (1-4 ms) resolution
+};
+
+/**
+ * \brief Optional features of a Shared Memory segment. These are chosen by the owner of the segment (manager_id 0),
+ * and are read from the segment by every other SharedMemoryManager which attaches to it.
+ */
+struct SharedMemoryOptions
+{
+	/**
+	 * \brief Keep lock-free queues of Empty and Full buffer indices in the segment, so that buffers are acquired in O(1).
+	 * Only applies to destructive_read_mode segments; broadcast segments always use the buffer scan.
+	 * Writers only take Empty buffers from the queue: the overwrite flag of GetBufferForWriting is ignored, since a
+	 * buffer taken out of turn would leave a stale queue entry behind and never reach the Full queue.
+	 */
+	bool use_index_queues{false};
+
+	/**
+	 * \brief Back the segment with huge pages (SHM_HUGETLB), rounding its size up to a multiple of the huge page size.
+	 * If the system has no huge pages available, the segment is created with normal pages and a warning is printed.
+	 */
+	bool huge_pages{false};
+
+	/**
+	 * \brief Bind the memory of the segment to this NUMA node (mbind(MPOL_BIND)). -1 leaves placement to the kernel (first touch).
+	 */
+	int numa_node{-1};
+
+	/**
+	 * \brief Fault in every page of the segment when attaching, so that the first Write/Read of each buffer does not pay for it
+	 */
+	bool prefault{false};
+
+	/**
+	 * \brief Number of threads this process uses to prefault the segment. 0 uses one thread per
+	 * SharedMemoryBackend::populate_bytes_per_thread of segment, up to the number of cores.
+	 */
+	size_t prefault_threads{0};
+
+	/**
+	 * \brief Lock the segment into this process's memory (mlock) when attaching, after any prefault, so that its pages
+	 * are never swapped out. Applies only to the requesting process; if RLIMIT_MEMLOCK is too small, a warning is
+	 * printed and the segment is left unlocked.
+	 */
+	bool lock_memory{false};
+
+	/**
+	 * \brief Operating-system mechanism providing the segment. Unlike the other options, every process attaching to
+	 * the segment must request the same backend.
+	 */
+	SharedMemoryBackendType backend{SharedMemoryBackendType::SysV};
+
+	/**
+	 * \brief Clock for buffer touch timestamps. Chosen by the owner and used by every process attached to the segment,
+	 * so timestamps are always comparable. With the coarse clock, buffers time out up to one tick late, never early,
+	 * and the telemetry histograms cannot resolve times shorter than one tick (typically 1 to 4 ms).
+	 */
+	SharedMemoryTouchClock touch_clock{SharedMemoryTouchClock::Precise};
+
+	/**
+	 * \brief If non-zero, the owner runs a reaper thread which looks for stale buffers at this interval, and
+	 * buffer acquisition no longer checks every buffer it visits for a timeout. 0 keeps the inline checks.
+	 * While the reaper is running, stale buffers are reclaimed up to one interval after they time out.
+	 */
+	size_t reaper_interval_us{0};
+
+	/**
+	 * \brief If non-zero, all buffers share one circular data arena of this many bytes, instead of each owning a
+	 * fixed slot of buffer_size bytes. buffer_size is then the most data a single buffer may hold, and buffer_count
+	 * the number of buffers which can be in flight. Writers take exactly the space they write from the arena, and
+	 * the space of released buffers is reclaimed in the order it was allocated.
+	 */
+	size_t arena_size{0};
+
+	/**
+	 * \brief Longest a write waits for readers to release arena space, in microseconds. The writer holds its buffer
+	 * while it waits, and a write which times out stores nothing. Applies only to the requesting process; 0 fails at
+	 * once when the arena is full.
+	 */
+	size_t arena_wait_us{1000000};
+
+	/**
+	 * \brief If non-zero, each buffer marked Full without a destination gets the next dispatch ticket, and ticket t
+	 * belongs to reader lane t % dispatch_lanes. Every reader claims a free lane when it first reads, and only takes
+	 * buffers from its own lane (or from lanes no reader holds), so work is dealt out to the readers in strict rotation.
+	 * At most SharedMemoryManager::max_dispatch_lanes lanes; only applies to destructive_read_mode segments, and
+	 * replaces the index queues.
+	 */
+	size_t dispatch_lanes{0};
+
+	/**
+	 * \brief Broadcast segments only: keep a cursor in the segment for every reader, and return a Full buffer to the
+	 * writers as soon as every reader has released it, instead of when it times out. Writers then run at the speed of
+	 * the slowest reader. At most SharedMemoryManager::max_reader_cursors readers get a cursor.
+	 */
+	bool reader_cursors{false};
+
+	/**
+	 * \brief With reader_cursors: when a writer finds no Empty buffer and the slowest reader has released nothing for more
+	 * than this many sequence IDs, that reader is dropped, i.e. no longer holds buffers back until it reads again.
+	 * 0 never drops a reader. Since nothing times the buffers out, a reader which dies without detaching holds the
+	 * segment until it is dropped.
+	 */
+	size_t max_cursor_lag{0};
+
+	/**
+	 * \brief With use_index_queues: buffers marked Full for a destination manager ID below this number go into a queue
+	 * of their own, so that the destination finds them in O(1) and no other reader ever dequeues them. Buffers for higher
+	 * IDs share the Full queue as before. Each queue adds buffer_count cells to the segment.
+	 * At most SharedMemoryManager::max_destination_queues.
+	 */
+	size_t destination_queues{0};
+};
+
 /**
  * \brief The SharedMemoryManager creates a Shared Memory area which is divided into a number of fixed-size buffers.
  * It provides for multiple readers and multiple writers through a dual semaphore system.
@@ -52,6 +181,21 @@ public:
 		return "Unknown";
 	}
 
+	/**
+	 * \brief Region of a buffer handed out by ReserveWrite, to be filled in place and then committed
+	 */
+	struct WriteReservation
+	{
+		uint8_t* data{nullptr};  ///< Start of the region, at the buffer's write position; nullptr if nothing was reserved
+		size_t size{0};          ///< Size of the region, in bytes
+
+		/**
+		 * \brief Whether the reservation succeeded
+		 * \return True if data points to a reserved region
+		 */
+		explicit operator bool() const { return data != nullptr; }
+	};
+
 	/**
 	 * \brief SharedMemoryManager Constructor
 	 * \param shm_key The key to use when attaching/creating the shared memory segment
@@ -60,8 +204,9 @@ public:
 	 * \param buffer_timeout_us The maximum amount of time a buffer can be left untouched by its owner (if 0, buffers do not expire)
 	 * before being returned to its previous state.
 	 * \param destructive_read_mode Whether a read operation empties the buffer (default: true, false for broadcast mode)
+	 * \param options Optional segment features (only used by the owner of the segment)
 	 */
-	SharedMemoryManager(uint32_t shm_key, size_t buffer_count = 0, size_t buffer_size = 0, uint64_t buffer_timeout_us = 100 * 1000000, bool destructive_read_mode = true);
+	SharedMemoryManager(uint32_t shm_key, size_t buffer_count = 0, size_t buffer_size = 0, uint64_t buffer_timeout_us = 100 * 1000000, bool destructive_read_mode = true, SharedMemoryOptions const& options = SharedMemoryOptions());
 
 	/**
 	 * \brief SharedMemoryManager Destructor
@@ -86,6 +231,59 @@ public:
 	 */
 	int GetBufferForWriting(bool overwrite);
 
+	/**
+	 * \brief Reserves up to max_n buffers which are ready to be read, in a single scan of the segment (or queue).
+	 * Buffers are returned in sequence ID order. In destructive_read_mode, batches are not interleaved with other
+	 * readers the way successive GetBufferForReading calls are.
+	 * \param max_n Maximum number of buffers to reserve
+	 * \return The id numbers of the reserved buffers; empty if none were available
+	 */
+	std::vector<int> GetBuffersForReading(size_t max_n);
+
+	/**
+	 * \brief Reserves up to n buffers which are ready to be written to, in a single scan of the segment (or queue)
+	 * \param n Maximum number of buffers to reserve
+	 * \param overwrite Whether to consider buffers that are in the Full and Reading state as ready for write (non-reliable mode)
+	 * \return The id numbers of the reserved buffers, in the order their sequence IDs were assigned; empty if none were available
+	 */
+	std::vector<int> GetBuffersForWriting(size_t n, bool overwrite);
+
+	/**
+	 * \brief Finds a buffer that is ready to be read, blocking until one becomes available or the timeout expires.
+	 * The calling thread sleeps on a futex in the shared memory segment, and is woken as soon as a writer (or stale-buffer reset)
+	 * makes a buffer available for reading.
+	 * \param timeout_us Maximum amount of time to wait, in microseconds
+	 * \return The id number of the buffer. -1 indicates no buffers became available before the timeout (or end of data).
+	 */
+	int WaitForBufferForReading(size_t timeout_us);
+
+	/**
+	 * \brief Finds a buffer that is ready to be written to, blocking until one becomes available or the timeout expires.
+	 * The calling thread sleeps on a futex in the shared memory segment, and is woken as soon as a reader releases a buffer.
+	 * \param timeout_us Maximum amount of time to wait, in microseconds
+	 * \param overwrite Whether to consider buffers that are in the Full and Reading state as ready for write (non-reliable mode)
+	 * \return The id number of the buffer. -1 indicates no buffers became available before the timeout (or end of data).
+	 */
+	int WaitForBufferForWriting(size_t timeout_us, bool overwrite = false);
+
+	/**
+	 * \brief Get the segment's read notification count, which is incremented whenever a buffer may have become readable
+	 * (and at End of Data). Sample it before looking for a buffer, then pass it to WaitForReadable if none was found.
+	 * \return The current read notification count (0 if not attached)
+	 */
+	uint32_t GetReadNotifyCount() const { return shm_ptr_ ? shm_ptr_->read_futex.load() : 0; }
+
+	/**
+	 * \brief Block until any of several segments may have a buffer ready for reading, or the timeout expires.
+	 * Uses a single futex_waitv system call where the kernel supports it (Linux 5.16+), otherwise waits on the first
+	 * segment's futex in 1 ms slices while checking the others.
+	 * \param segments Segments to wait on (segments which are not attached are ignored)
+	 * \param last_counts GetReadNotifyCount of each segment, sampled before it was found to have no buffer ready
+	 * \param timeout_us Maximum amount of time to wait, in microseconds
+	 * \return Index in segments of a segment whose read notification count has changed, or -1 on timeout
+	 */
+	static int WaitForReadable(std::vector<SharedMemoryManager*> const& segments, std::vector<uint32_t> const& last_counts, size_t timeout_us);
+
 	/**
 	 * \brief Whether any buffer is ready for read
 	 * \return True if there is a buffer available
@@ -100,13 +298,15 @@ public:
 	virtual bool ReadyForWrite(bool overwrite);
 
 	/**
-	 * \brief Count the number of buffers that are ready for reading
+	 * \brief Count the number of buffers that are ready for reading. In destructive_read_mode, this reads the
+	 * segment's state counters instead of scanning the buffers, and does not check for stale buffers.
 	 * \return The number of buffers ready for reading
 	 */
 	size_t ReadReadyCount();
 
 	/**
-	 * \brief Count the number of buffers that are ready for writing
+	 * \brief Count the number of buffers that are ready for writing. Reads the segment's state counters instead of
+	 * scanning the buffers, except in broadcast mode without a reaper thread, where Full buffers are aged out here.
 	 * \param overwrite Whether to consider buffers that are in the Full and Reading state as ready for write (non-reliable mode)
 	 * \return The number of buffers ready for writing
 	 */
@@ -158,6 +358,16 @@ public:
 	 */
 	bool IncrementWritePos(int buffer, size_t written);
 
+	/**
+	 * \brief Make sure the given buffer can hold size more bytes past its write position. In arena mode, this takes the
+	 * space from the arena, waiting up to SharedMemoryOptions::arena_wait_us for readers to release space, and must be done before
+	 * writing through GetWritePos; Write reserves space itself. With fixed slots, this only checks the buffer size.
+	 * \param buffer Buffer ID of buffer
+	 * \param size Number of bytes which will be written
+	 * \return Whether the space is available
+	 */
+	bool ReserveBufferSpace(int buffer, size_t size);
+
 	/**
 	 * \brief Determine if more data is available to be read, based on the read position and data size
 	 * \param buffer Buffer ID of buffer
@@ -180,6 +390,13 @@ public:
 	 */
 	void MarkBufferFull(int buffer, int destination = -1);
 
+	/**
+	 * \brief Release several buffers from a writer, marking them Full. Waiting readers are woken once for the whole batch.
+	 * \param buffers Buffer IDs of the buffers
+	 * \param destination If desired, a destination manager ID may be specified for the buffers
+	 */
+	void MarkBuffersFull(std::vector<int> const& buffers, int destination = -1);
+
 	/**
 	 * \brief Release a buffer from a reader, marking it Empty and ready to accept more data
 	 * \param buffer Buffer ID of buffer
@@ -188,6 +405,14 @@ public:
 	 */
 	void MarkBufferEmpty(int buffer, bool force = false, bool detachOnException = true);
 
+	/**
+	 * \brief Release several buffers from a reader, marking them Empty. Waiting writers are woken once for the whole batch.
+	 * \param buffers Buffer IDs of the buffers
+	 * \param force Force buffers to empty state (only if manager_id_ == 0)
+	 * \param detachOnException Whether to throw exceptions when buffers are not in the expected state (default true)
+	 */
+	void MarkBuffersEmpty(std::vector<int> const& buffers, bool force = false, bool detachOnException = true);
+
 	/**
 	 * \brief Resets the buffer from Reading to Full. This operation will only have an
 	 * effect if performed by the owning manager or if the buffer has timed out.
@@ -196,6 +421,25 @@ public:
 	 */
 	bool ResetBuffer(int buffer);
 
+	/**
+	 * \brief Get the number of stale buffers which have been reclaimed, by any manager, since the segment was created
+	 * \return Number of buffers reset because their owner stopped touching them
+	 */
+	uint64_t GetReapCount() const { return IsValid() ? shm_ptr_->reap_count.load() : 0; }
+
+	/**
+	 * \brief Get the number of buffers in the given state, without scanning the buffers. The count is updated
+	 * separately from the buffer states, so it may be off by the number of transitions in progress.
+	 * \param state State to count
+	 * \return Number of buffers in the given state
+	 */
+	size_t GetBufferStateCount(BufferSemaphoreFlags state) const
+	{
+		if (!IsValid()) return 0;
+		auto count = shm_ptr_->state_count[static_cast<int>(state)].load();
+		return count > 0 ? count : 0;
+	}
+
 	/**
 	 * \brief Assign a new ID to the current SharedMemoryManager, if one has not yet been assigned
 	 */
@@ -224,6 +468,16 @@ public:
 	 */
 	int GetMyId() const { return manager_id_; }
 
+	/**
+	 * \brief Check whether the process which attached with the given manager ID is still running. Buffers held by a
+	 * manager whose process has died are reclaimed as soon as a scan (or the reaper) finds them, without waiting for
+	 * the buffer timeout.
+	 * \param manager_id Manager ID to check
+	 * \return False if the process has exited (or its PID now belongs to another process). Manager IDs which are not
+	 * tracked (beyond the size of the table, or detached) are reported alive, and left to the buffer timeout.
+	 */
+	bool IsManagerAlive(int manager_id) { return !IsValid() || managerAlive_(manager_id, touchTime_(), true); }
+
 	/**
 	 * \brief Get the rank of the owner of the Shared Memory (artdaq assigns rank to each artdaq process for data flow)
 	 * \return The rank of the owner of the Shared Memory
@@ -265,6 +519,56 @@ public:
 	 */
 	size_t Write(int buffer, void* data, size_t size);
 
+	/**
+	 * \brief Reserve space at the write position of a buffer, so that it can be filled in place instead of copied in
+	 * with Write. The buffer must be in the Writing state and owned by this manager. The reservation is only valid
+	 * until the next Write, ResetWritePos or MarkBufferFull of the buffer.
+	 * \param buffer Buffer ID of buffer
+	 * \param max_bytes Largest amount of data which will be committed
+	 * \return The reserved region, or an empty reservation if the buffer (or, in arena mode, the arena) cannot hold max_bytes more bytes
+	 */
+	WriteReservation ReserveWrite(int buffer, size_t max_bytes);
+
+	/**
+	 * \brief Write several pieces of data to a buffer, one after the other. The buffer state and size are checked
+	 * once for all pieces, and large pieces are copied with non-temporal stores, which bypass the writer's cache.
+	 * \param buffer Buffer ID of buffer
+	 * \param iov Pieces to write
+	 * \param n Number of pieces
+	 * \return Amount of data written, in bytes (0 if no arena space could be found)
+	 */
+	size_t WriteV(int buffer, struct iovec const* iov, size_t n);
+
+	/**
+	 * \brief Set of data types (e.g. Fragment types), one bit per type
+	 */
+	typedef std::bitset<256> BufferTypeMask;
+
+	/**
+	 * \brief Publish that a buffer being written contains data of the given type (e.g. a Fragment type), so that readers
+	 * which are only interested in some types can skip the buffer without reading it. The types are cleared when a writer acquires the buffer.
+	 * \param buffer Buffer ID of buffer
+	 * \param type Type of (some of) the data in the buffer
+	 * \return Whether the type was published; false if the buffer is not being written by this manager
+	 */
+	bool AddBufferType(int buffer, uint8_t type);
+
+	/**
+	 * \brief Determine whether a buffer contains any of the given types, as published by its writer
+	 * \param buffer Buffer ID of buffer
+	 * \param types Types of interest
+	 * \return True if the writer published one of the types, or did not publish any types
+	 */
+	bool BufferHasAnyType(int buffer, BufferTypeMask const& types);
+
+	/**
+	 * \brief Publish data written into a region returned by ReserveWrite, by advancing the write position
+	 * \param buffer Buffer ID of buffer
+	 * \param bytes Number of bytes actually written, at most the reserved size
+	 * \return Whether the commit matched a reservation and was applied
+	 */
+	bool CommitWrite(int buffer, size_t bytes);
+
 	/**
 	 * \brief Read size bytes of data from buffer into the given pointer
 	 * \param buffer Buffer ID of buffer
@@ -308,7 +612,8 @@ public:
 	void* GetBufferStart(int buffer);
 
 	/**
-	 * \brief Detach from the Shared Memory segment, optionally throwing a cet::exception with the specified properties
+	 * \brief Detach from the Shared Memory segment, optionally throwing a cet::exception with the specified properties.
+	 * Called on the reaper thread, it only logs the error and stops the reaper, leaving the segment attached.
 	 * \param throwException Whether to throw an exception after detaching
 	 * \param category Category for the cet::exception
 	 * \param message Message for the cet::exception
@@ -326,7 +631,7 @@ public:
 	 * \brief Gets the number of buffers which have been processed through the Shared Memory
 	 * \return The number of buffers processed by the Shared Memory
 	 */
-	size_t GetBufferCount() const { return IsValid() ? shm_ptr_->next_sequence_id : 0; }
+	size_t GetBufferCount() const { return IsValid() ? shm_ptr_->next_sequence_id.load() : 0; }
 
 	/**
 	 * \brief Gets the highest buffer number either written or read by this SharedMemoryManager
@@ -339,6 +644,181 @@ public:
 	 */
 	size_t GetLowestSeqIDRead() const { return IsValid() ? shm_ptr_->lowest_seq_id_read : 0; }
 
+	/**
+	 * \brief Whether the attached segment keeps index queues of Empty and Full buffers
+	 * \return True if buffers are acquired from the in-segment index queues
+	 */
+	bool UsesIndexQueues() const { return IsValid() && shm_ptr_->queue_capacity > 0; }
+
+	static constexpr size_t max_dispatch_lanes = 32;      ///< Largest supported SharedMemoryOptions::dispatch_lanes
+	static constexpr size_t max_destination_queues = 32;  ///< Largest supported SharedMemoryOptions::destination_queues
+
+	/**
+	 * \brief Get the number of destinations with a Full queue of their own
+	 * \return Number of destination queues, 0 if every Full buffer goes through the shared Full queue
+	 */
+	size_t GetDestinationQueueCount() const { return UsesIndexQueues() ? shm_ptr_->destination_queues : 0; }
+
+	/**
+	 * \brief Counters of one reader lane, see SharedMemoryOptions::dispatch_lanes
+	 */
+	struct DispatchLaneStats
+	{
+		int owner;            ///< Manager ID of the reader holding the lane, -1 if it is free
+		uint64_t dispatched;  ///< Buffers whose ticket fell in this lane
+		uint64_t consumed;    ///< Buffers taken by the reader(s) holding this lane, including ones from free lanes
+	};
+
+	/**
+	 * \brief Whether the attached segment deals Full buffers out to reader lanes by ticket
+	 * \return Number of reader lanes, 0 if dispatch tickets are disabled
+	 */
+	size_t GetDispatchLaneCount() const { return IsValid() ? shm_ptr_->dispatch_lanes : 0; }
+
+	/**
+	 * \brief Get the reader lane held by this manager
+	 * \return Lane number, -1 if this manager has not read yet, or no lane was free when it did
+	 */
+	int GetDispatchLane() const { return dispatch_lane_; }
+
+	/**
+	 * \brief Get the counters of every reader lane
+	 * \return One entry per lane, empty if dispatch tickets are disabled
+	 */
+	std::vector<DispatchLaneStats> GetDispatchLaneStats() const;
+
+	static constexpr size_t max_reader_cursors = 32;  ///< Most readers which get a cursor with SharedMemoryOptions::reader_cursors
+
+	/**
+	 * \brief State of one reader cursor, see SharedMemoryOptions::reader_cursors
+	 */
+	struct ReaderCursorStats
+	{
+		int owner;          ///< Manager ID of the reader
+		uint64_t position;  ///< Highest sequence ID the reader has released
+		bool dropped;       ///< Whether the reader is currently dropped for lagging
+		uint64_t drops;     ///< Number of times the reader has been dropped
+	};
+
+	/**
+	 * \brief Whether the attached segment recycles broadcast buffers once every reader cursor has passed them
+	 * \return True if the segment keeps reader cursors
+	 */
+	bool UsesReaderCursors() const { return IsValid() && shm_ptr_->reader_cursors; }
+
+	/**
+	 * \brief Get the reader cursor slot held by this manager
+	 * \return Cursor slot, -1 if this manager has not read yet, or every slot was taken when it did
+	 */
+	int GetReaderCursor() const { return reader_cursor_; }
+
+	/**
+	 * \brief Get the state of every reader cursor in use
+	 * \return One entry per reader holding a cursor
+	 */
+	std::vector<ReaderCursorStats> GetReaderCursorStats() const;
+
+	/**
+	 * \brief Get the number of broadcast buffers recycled because every reader cursor had passed them
+	 * \return Number of buffers returned to the writers by the reader cursors
+	 */
+	uint64_t GetRecycleCount() const { return IsValid() ? shm_ptr_->recycle_count.load() : 0; }
+
+	static constexpr size_t telemetry_histogram_bins = 32;  ///< Bin 0 holds times of 0 us, bin i > 0 times in [2^(i-1), 2^i) us; the last bin is open-ended
+
+	/*
+	 * The histograms are filled from the touch clock. With SharedMemoryTouchClock::Coarse, times shorter than one tick
+	 * land in bin 0 and longer ones are multiples of the tick, so only the bins above the tick carry information.
+	 */
+
+	/**
+	 * \brief Telemetry counters of one manager ID
+	 */
+	struct ManagerTelemetry
+	{
+		int id;                  ///< Manager ID
+		uint64_t reads;          ///< Buffers this manager took for reading
+		uint64_t writes;         ///< Buffers this manager took for writing
+		uint64_t failed_reads;   ///< Calls of GetBufferForReading or GetBuffersForReading which returned no buffer
+		uint64_t failed_writes;  ///< Calls of GetBufferForWriting or GetBuffersForWriting which returned no buffer
+	};
+
+	/**
+	 * \brief Snapshot of the telemetry kept in the segment. The counters only ever increase, from the creation of the segment,
+	 * so rates are obtained by differencing two snapshots. The segment keeps them per manager ID; a snapshot sums them.
+	 */
+	struct SegmentTelemetry
+	{
+		uint64_t transitions[4][4];                         ///< State transitions, indexed [from][to] by BufferSemaphoreFlags
+		uint64_t overwrites;                                ///< Full buffers taken for writing before they were read (transitions Full to Writing)
+		uint64_t reader_clobbers;                           ///< Buffers taken for writing from a reader (transitions Reading to Writing)
+		uint64_t failed_reads;                              ///< Read acquisitions which returned no buffer
+		uint64_t failed_writes;                             ///< Write acquisitions which returned no buffer
+		uint64_t stale_resets;                              ///< Buffers reset because they were not touched within the buffer timeout
+		uint64_t dead_owner_resets;                         ///< Buffers reclaimed from a manager whose process has exited
+		uint64_t queue_time_us[telemetry_histogram_bins];   ///< Histogram of the time buffers spent Full before being read
+		uint64_t hold_time_us[telemetry_histogram_bins];    ///< Histogram of the time readers held buffers
+		std::vector<ManagerTelemetry> managers;             ///< Counters of every (tracked) manager ID which has taken or asked for a buffer
+	};
+
+	/**
+	 * \brief Take a snapshot of the telemetry of the attached segment
+	 * \return Telemetry snapshot, all zero if the manager is not attached
+	 */
+	SegmentTelemetry GetTelemetry() const;
+
+	/**
+	 * \brief Take a snapshot of the telemetry of a segment without attaching to it, so that monitoring tools
+	 * neither take a manager ID nor count as a reader or writer
+	 * \param key Key of the segment
+	 * \param telemetry Snapshot, filled in on success
+	 * \param backend Backend the segment was created with
+	 * \return False if the segment does not exist or has not been initialized with this layout
+	 */
+	static bool ReadTelemetry(uint32_t key, SegmentTelemetry& telemetry, SharedMemoryBackendType backend = SharedMemoryBackendType::SysV);
+
+	/**
+	 * \brief Whether the attached segment is backed by huge pages
+	 * \return True if the owner created the segment with SHM_HUGETLB
+	 */
+	bool UsesHugePages() const { return IsValid() && shm_ptr_->huge_pages; }
+
+	/**
+	 * \brief Time this manager spent prefaulting the segment when it attached
+	 * \return Time in seconds, 0 if it did not prefault
+	 */
+	double GetPrefaultTime() const { return prefault_seconds_; }
+
+	/**
+	 * \brief Whether this manager has locked the segment into memory, see SharedMemoryOptions::lock_memory
+	 * \return True if the mlock succeeded
+	 */
+	bool IsMemoryLocked() const { return memory_locked_; }
+
+	/**
+	 * \brief Time this manager spent locking the segment into memory when it attached
+	 * \return Time in seconds, 0 if it did not lock the segment
+	 */
+	double GetLockTime() const { return lock_seconds_; }
+
+	/**
+	 * \brief The NUMA node the segment memory is bound to
+	 * \return NUMA node number, or -1 if the segment is not bound
+	 */
+	int GetNumaNode() const { return IsValid() ? shm_ptr_->numa_node : -1; }
+
+	/**
+	 * \brief Whether the buffers of the attached segment share a circular data arena
+	 * \return True if buffers take their space from the arena, false if each has a fixed slot
+	 */
+	bool UsesArena() const { return IsValid() && shm_ptr_->arena_size > 0; }
+
+	/**
+	 * \brief Get the amount of arena space which is not allocated to a buffer, or waiting to be reclaimed
+	 * \return Free arena space in bytes, 0 if the segment does not use an arena
+	 */
+	size_t GetArenaFreeBytes() const;
+
 	/**
 	 * \brief Sets the threshold after which a buffer should be considered "non-empty" (in case of default headers)
 	 * \param size Size (in bytes) after which a buffer will be considered non-empty
@@ -356,6 +836,13 @@ public:
 	 */
 	void TouchBuffer(int buffer) { return touchBuffer_(getBufferInfo_(buffer)); }
 
+	/**
+	 * \brief Get the sequence ID of the given buffer
+	 * \param buffer Buffer to query
+	 * \return Sequence ID assigned when the buffer was last marked Full
+	 */
+	size_t GetBufferSequenceID(int buffer) { return getBufferInfo_(buffer)->sequence_id; }
+
 	static uint64_t GetAvailableRAM()
 	{
 		struct sysinfo meminfo;
@@ -367,6 +854,12 @@ public:
 		return 0;
 	}
 
+	/**
+	 * \brief Get the default huge page size of the system
+	 * \return Huge page size in bytes, from /proc/meminfo, or 0 if huge pages are not supported
+	 */
+	static size_t GetHugePageSize() { return SharedMemoryBackend::HugePageSize(); }
+
 	static std::string PrintBytes(uint64_t bytes)
 	{
 		double print = bytes / 1024.0 / 1024.0 / 1024.0;
@@ -399,7 +892,19 @@ private:
 	SharedMemoryManager& operator=(SharedMemoryManager const&) = delete;
 	SharedMemoryManager& operator=(SharedMemoryManager&&) = delete;
 
-	struct ShmBuffer
+	static constexpr size_t cache_line_size_ = 64;  ///< Alignment used to keep independently-modified shared state on separate cache lines
+	static constexpr int max_counted_destinations_ = 62;  ///< Manager IDs with their own Full buffer counter
+	static constexpr int max_tracked_managers_ = 64;       ///< Manager IDs whose process is checked for liveness
+	static constexpr uint64_t liveness_check_interval_us_ = 1000;  ///< Shortest time between two liveness checks of the same manager
+	static constexpr size_t nontemporal_copy_threshold_ = 256 * 1024;  ///< WriteV pieces at least this large bypass the cache
+
+	static constexpr size_t cacheLineRound_(size_t bytes) { return (bytes + cache_line_size_ - 1) & ~(cache_line_size_ - 1); }
+
+	/**
+	 * Per-buffer bookkeeping. Each record occupies its own cache line(s), so that touching one buffer
+	 * does not invalidate the records of its neighbours in other processes.
+	 */
+	struct alignas(cache_line_size_) ShmBuffer
 	{
 		size_t writePos;
 		size_t readPos;
@@ -407,38 +912,232 @@ private:
 		std::atomic<int16_t> sem_id;
 		std::atomic<size_t> sequence_id;
 		std::atomic<uint64_t> last_touch_time;
+		std::atomic<bool> queued;  // Whether an index queue entry exists for this buffer
+		std::atomic<int16_t> full_destination;  // Destination given when the buffer was marked Full, selects its full_count slot
+		size_t data_offset;                     // Arena mode: offset of the buffer's data in the arena
+		size_t data_capacity;                   // Arena mode: bytes allocated to the buffer, 0 if it holds no arena space
+		uint64_t type_mask[4];                  // Types published with AddBufferType, one bit per type (all zero: none published)
+		std::atomic<uint64_t> ticket;           // Dispatch ticket, assigned when the buffer is marked Full without a destination
+		std::atomic<uint64_t> state_time;       // Touch time of the last transition to Full or Reading, for the telemetry histograms
 	};
 
+	/**
+	 * Header in front of each arena allocation. Allocations are reclaimed strictly in order, once released.
+	 */
+	struct alignas(cache_line_size_) ShmArenaRecord
+	{
+		size_t length;  // Bytes from this header to the next one
+		bool released;
+	};
+
+	/**
+	 * Bounded MPMC queue of buffer indices (D. Vyukov's algorithm). The cells live after the ShmBuffer array.
+	 * A process which dies between claiming a cell and publishing it will stall the queue at that cell.
+	 * Producers and consumers each get their own cache line.
+	 */
+	struct ShmIndexQueue
+	{
+		alignas(cache_line_size_) std::atomic<size_t> enqueue_pos;
+		alignas(cache_line_size_) std::atomic<size_t> dequeue_pos;
+	};
+
+	struct ShmQueueCell
+	{
+		std::atomic<size_t> sequence;
+		int buffer;
+	};
+
+	/**
+	 * One reader lane of ticket dispatch. Written by the writers (dispatched) and by its reader (consumed), so it
+	 * gets a line of its own.
+	 */
+	struct alignas(cache_line_size_) ShmDispatchLane
+	{
+		std::atomic<int> owner;  // Manager ID of the reader holding the lane, -1 if free
+		std::atomic<uint64_t> dispatched;
+		std::atomic<uint64_t> consumed;
+	};
+
+	/**
+	 * Read position of one broadcast reader. Written on every release by its reader, so it gets a line of its own.
+	 */
+	struct alignas(cache_line_size_) ShmReaderCursor
+	{
+		std::atomic<int> owner;          // Manager ID of the reader holding the cursor, -1 if free
+		std::atomic<bool> dropped;       // Set by a writer when the reader lagged too far, cleared when the reader reads again
+		std::atomic<uint64_t> position;  // Highest sequence ID the reader has released
+		std::atomic<uint64_t> drops;
+	};
+
+	/**
+	 * Process holding a manager ID, so that other processes can tell when it has died. Only written on attach,
+	 * detach, and by the (rate-limited) liveness checks.
+	 */
+	struct ShmManagerRecord
+	{
+		std::atomic<int32_t> pid;          // 0 if no process holds the ID
+		std::atomic<bool> dead;            // Set by whoever first notices that the process has gone away
+		std::atomic<bool> reader;          // Whether the manager is counted in reader_count
+		std::atomic<bool> writer;          // Whether the manager is counted in writer_count
+		uint64_t start_time;               // Process start time, from /proc, to detect PID reuse; 0 if unknown
+		std::atomic<uint64_t> checked_us;  // Touch time of the last liveness check
+	};
+
+	/**
+	 * Counters written on every state change or failed acquisition. Only ever incremented, with relaxed atomics, so that
+	 * tools may read them at any time.
+	 */
+	struct ShmTransitionTelemetry
+	{
+		std::atomic<uint64_t> transitions[4][4];  // [from][to], indexed by BufferSemaphoreFlags
+		std::atomic<uint64_t> queue_time[telemetry_histogram_bins];
+		std::atomic<uint64_t> hold_time[telemetry_histogram_bins];
+		std::atomic<uint64_t> failed_reads;
+		std::atomic<uint64_t> failed_writes;
+	};
+
+	/**
+	 * Telemetry of the whole segment. The hot counters are kept per manager ID; these lines only take the counts of
+	 * untracked manager IDs and the (rare) resets.
+	 */
+	struct ShmTelemetry
+	{
+		alignas(cache_line_size_) ShmTransitionTelemetry untracked;  // Managers with IDs of max_tracked_managers_ and above
+		alignas(cache_line_size_) std::atomic<uint64_t> stale_resets;
+		std::atomic<uint64_t> dead_owner_resets;
+	};
+
+	/**
+	 * Telemetry of one manager ID. Written only by that manager, so it gets lines of its own.
+	 */
+	struct alignas(cache_line_size_) ShmManagerTelemetry
+	{
+		std::atomic<uint64_t> reads;
+		std::atomic<uint64_t> writes;
+		ShmTransitionTelemetry counters;
+	};
+
+	/**
+	 * Segment header. ready_magic and layout_version are at offset 0 so that any future layout can identify
+	 * the segment. Read-mostly configuration shares the first cache line; every frequently-written field
+	 * (or group of fields written together) gets a line of its own.
+	 */
 	struct ShmStruct
 	{
-		std::atomic<unsigned int> reader_pos;
-		std::atomic<unsigned int> writer_pos;
+		alignas(cache_line_size_) unsigned ready_magic;
+		uint32_t layout_version;
 		int buffer_count;
+		int rank;
 		size_t buffer_size;
 		size_t buffer_timeout_us;
-		size_t next_sequence_id;
-		size_t lowest_seq_id_read;
+		size_t queue_capacity;  // Power of two >= buffer_count, 0 if index queues are disabled
 		bool destructive_read_mode;
-
-		std::atomic<int> writer_count;
+		bool huge_pages;  // Segment was created with SHM_HUGETLB
+		bool prefault;    // Every attaching process should prefault its mapping
+		bool coarse_touch_clock;  // last_touch_time comes from CLOCK_REALTIME_COARSE
+		int numa_node;    // -1 if not bound
+		size_t reaper_interval_us;  // 0 if the owner does not run a reaper thread
+		size_t arena_size;          // 0 if each buffer has a fixed slot of buffer_size bytes
+
+		alignas(cache_line_size_) std::atomic<int> writer_count;  // Registration counters only change on attach/detach
 		std::atomic<int> reader_count;
-
 		std::atomic<int> next_id;
-		int rank;
-		unsigned ready_magic;
+		std::atomic<int> attached_count;  // Managers currently attached, including crashed ones until their death is noticed
+		std::atomic<bool> end_of_data;    // Set by the owner when it removes the segment
+		size_t dispatch_lanes;            // 0 if readers do not take buffers by ticket (configuration, but the first line is full)
+		size_t max_cursor_lag;            // Sequence IDs a reader cursor may lag before it is dropped, 0 for never
+		bool reader_cursors;              // Broadcast buffers are recycled once every reader cursor has passed them
+		size_t destination_queues;        // Destinations with a Full index queue of their own
+		uint32_t header_size;             // sizeof(ShmStruct) of the owner, checked along with layout_version
+		uint32_t record_size;             // sizeof(ShmBuffer) of the owner, checked along with layout_version
+
+		alignas(cache_line_size_) std::atomic<uint64_t> reaper_heartbeat_us;  // Touch time of the reaper's last pass, 0 if it is not running
+		std::atomic<uint64_t> reap_count;                                    // Stale buffers reclaimed
+		std::atomic<uint64_t> recycle_count;                                 // Broadcast buffers recycled by the reader cursors
+
+		alignas(cache_line_size_) pthread_mutex_t arena_mutex;  // Process-shared and robust, guards the arena records
+		size_t arena_head;                                     // Total bytes ever allocated, including wrap-around padding
+		size_t arena_tail;                                     // Total bytes ever reclaimed
+
+		alignas(cache_line_size_) std::atomic<int> state_count[4];                   // Buffers in each BufferSemaphoreFlags state
+		std::atomic<int> full_count[max_counted_destinations_ + 2];  // Full buffers by destination slot, see fullSlot_
+
+		alignas(cache_line_size_) std::atomic<unsigned int> reader_pos;
+		alignas(cache_line_size_) std::atomic<unsigned int> writer_pos;
+		alignas(cache_line_size_) std::atomic<size_t> next_sequence_id;
+		alignas(cache_line_size_) size_t lowest_seq_id_read;
+
+		ShmIndexQueue empty_queue;
+		ShmIndexQueue full_queue;
+		ShmIndexQueue destination_queue[max_destination_queues];  // Full buffers sent to manager IDs below destination_queues
+
+		alignas(cache_line_size_) std::atomic<uint64_t> next_ticket;
+		ShmDispatchLane lanes[max_dispatch_lanes];
+		ShmReaderCursor cursors[max_reader_cursors];
+		ShmManagerRecord managers[max_tracked_managers_];  // Indexed by manager ID
+
+		ShmTelemetry telemetry;
+		ShmManagerTelemetry manager_telemetry[max_tracked_managers_];  // Indexed by manager ID
+
+		alignas(cache_line_size_) std::atomic<uint32_t> read_futex;  // Incremented whenever a buffer may have become readable
+		std::atomic<int> read_waiters;
+		alignas(cache_line_size_) std::atomic<uint32_t> write_futex;  // Incremented whenever a buffer may have become writable
+		std::atomic<int> write_waiters;
 	};
 
+	/// full_count slot for a destination: 0 for any reader, then one per manager ID, then one shared by all higher IDs
+	static size_t fullSlot_(int destination)
+	{
+		if (destination < 0) return 0;
+		return destination < max_counted_destinations_ ? destination + 1 : max_counted_destinations_ + 1;
+	}
+
+	static size_t queueCapacity_(size_t buffer_count)
+	{
+		size_t capacity = 1;
+		while (capacity < buffer_count) capacity <<= 1;
+		return capacity;
+	}
+
+	/// Size of everything before the buffer data: header, ShmBuffer array and index queue cells, rounded to a cache line
+	static size_t headerSize_(size_t buffer_count, size_t queue_capacity, size_t destination_queues)
+	{
+		return sizeof(ShmStruct) + buffer_count * sizeof(ShmBuffer) + cacheLineRound_((2 + destination_queues) * queue_capacity * sizeof(ShmQueueCell));
+	}
+
+	/// Cells of the empty queue, then the full queue, then each destination queue
+	inline ShmQueueCell* queueCells_(ShmIndexQueue const* queue) const
+	{
+		auto cells = reinterpret_cast<ShmQueueCell*>(reinterpret_cast<uint8_t*>(shm_ptr_ + 1) + shm_ptr_->buffer_count * sizeof(ShmBuffer));  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		size_t index = queue == &shm_ptr_->empty_queue ? 0 : queue == &shm_ptr_->full_queue ? 1 : 2 + (queue - shm_ptr_->destination_queue);  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		return cells + index * shm_ptr_->queue_capacity;                                                                                       // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+
+	/// Full queue of this manager, nullptr if it has none
+	inline ShmIndexQueue* destinationQueue_(int destination) const
+	{
+		if (destination < 0 || static_cast<size_t>(destination) >= std::min(shm_ptr_->destination_queues, max_destination_queues)) return nullptr;
+		return &shm_ptr_->destination_queue[destination];
+	}
+
 	inline uint8_t* dataStart_() const
 	{
 		if (shm_ptr_ == nullptr) return nullptr;
-		return reinterpret_cast<uint8_t*>(shm_ptr_ + 1) + shm_ptr_->buffer_count * sizeof(ShmBuffer);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		return reinterpret_cast<uint8_t*>(shm_ptr_) + headerSize_(shm_ptr_->buffer_count, shm_ptr_->queue_capacity, shm_ptr_->destination_queues);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
 	}
 
 	inline uint8_t* bufferStart_(int buffer)
 	{
 		if (shm_ptr_ == nullptr) return nullptr;
 		if (buffer >= requested_shm_parameters_.buffer_count && buffer >= shm_ptr_->buffer_count) Detach(true, "ArgumentOutOfRange", "The specified buffer does not exist!");
-		return dataStart_() + buffer * shm_ptr_->buffer_size;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		if (shm_ptr_->arena_size > 0) return dataStart_() + buffer_ptrs_[buffer]->data_offset;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		return dataStart_() + buffer * shm_ptr_->buffer_size;                                   // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+
+	/// Size of the data area following the header: the arena, or one slot per buffer
+	static size_t dataSize_(size_t buffer_count, size_t buffer_size, size_t arena_size)
+	{
+		return arena_size > 0 ? cacheLineRound_(arena_size) : buffer_count * buffer_size;
 	}
 
 	inline ShmBuffer* getBufferInfo_(int buffer)
@@ -446,26 +1145,106 @@ private:
 		if (shm_ptr_ == nullptr) return nullptr;
 		// Check local variable first, but re-check shared memory
 		if (buffer >= requested_shm_parameters_.buffer_count && buffer >= shm_ptr_->buffer_count)
+		{
 			Detach(true, "ArgumentOutOfRange", "The specified buffer does not exist!");
+			return nullptr;  // Only reached on the reaper thread, where Detach does not throw
+		}
 		return buffer_ptrs_[buffer];
 	}
+	bool hasLegacyLayout_() const;
+	static bool layoutMatches_(ShmStruct const* shm);
+	void prefault_(size_t size);
+	void lockMemory_(size_t size);
+	bool bindToNumaNode_(size_t size, int node);
 	bool checkBuffer_(ShmBuffer* buffer, BufferSemaphoreFlags flags, bool exceptions = true);
-	void touchBuffer_(ShmBuffer* buffer);
+	bool claimBufferForReading_(int buffer, ShmBuffer* buf, BufferSemaphoreFlags sem, int16_t sem_id, uint64_t now);
+	bool claimBufferForWriting_(int buffer, ShmBuffer* buf, BufferSemaphoreFlags sem, int16_t sem_id, uint64_t now);
+	bool markBufferFull_(int buffer, int destination);
+	void markBufferEmpty_(int buffer, bool force, bool detachOnException, bool& notify_readers, bool& notify_writers);
+	bool resetBuffer_(int buffer, uint64_t now, bool try_lock = false);
+	void setBufferState_(ShmBuffer* buffer, BufferSemaphoreFlags state, uint64_t now, int destination = -1);
+	void lockArena_() const;
+	void unlockArena_() const;
+	bool ensureCapacity_(ShmBuffer* buffer, size_t needed);
+	bool allocateArena_(size_t size, size_t& offset);
+	void releaseArena_(ShmBuffer* buffer);
+	bool casBufferState_(ShmBuffer* buffer, BufferSemaphoreFlags& expected, BufferSemaphoreFlags state, uint64_t now);
+	void countStateChange_(ShmBuffer* buffer, BufferSemaphoreFlags from, BufferSemaphoreFlags to, int destination, uint64_t now);
+	ShmTransitionTelemetry& transitionTelemetry_()
+	{
+		return manager_id_ >= 0 && manager_id_ < max_tracked_managers_ ? shm_ptr_->manager_telemetry[manager_id_].counters : shm_ptr_->telemetry.untracked;
+	}
+	void countFailedAcquisition_(bool writing);
+	static void snapshotTelemetry_(ShmStruct const* shm, SegmentTelemetry& telemetry);
+	static void bumpCounter_(std::atomic<uint64_t>& counter) { counter.fetch_add(1, std::memory_order_relaxed); }
+	static size_t histogramBin_(uint64_t us) { return us == 0 ? 0 : std::min<size_t>(64 - __builtin_clzll(us), telemetry_histogram_bins - 1); }
+	bool reaperActive_(uint64_t now) const
+	{
+		auto interval = shm_ptr_->reaper_interval_us;
+		return interval > 0 && shm_ptr_->reaper_heartbeat_us.load() + 2 * interval + touch_clock_slack_us_ >= now;
+	}
+	void startReaper_();
+	void stopReaper_();
+	void runReaper_();
+	uint64_t touchTime_() const { return shm_ptr_->coarse_touch_clock ? TimeUtils::gettimeofday_coarse_us() : TimeUtils::gettimeofday_us(); }
+	void touchBuffer_(ShmBuffer* buffer, uint64_t now);
+	void touchBuffer_(ShmBuffer* buffer) { touchBuffer_(buffer, touchTime_()); }
+
+	bool enqueueIndex_(ShmIndexQueue* queue, int buffer);
+	int dequeueIndex_(ShmIndexQueue* queue);
+	size_t queueDepth_(ShmIndexQueue const* queue) const { return queue->enqueue_pos.load() - queue->dequeue_pos.load(); }
+	void queueBuffer_(int buffer);
+	int getQueuedBufferForReading_(uint64_t now);
+	int dequeueBufferForReading_(ShmIndexQueue* queue, uint64_t now);
+	int getQueuedBufferForWriting_(uint64_t now);
+	void sweepStaleBuffer_(uint64_t now);
+	void registerReader_();
+	void registerWriter_();
+	void recordManager_();
+	void probeManagers_(uint64_t now);
+	bool managerAlive_(int manager_id, uint64_t now, bool force = false);
+	bool managerDead_(int manager_id) const { return manager_id >= 0 && manager_id < max_tracked_managers_ && shm_ptr_->managers[manager_id].dead; }
+	void markManagerDead_(int manager_id);
+	bool inDispatchLane_(ShmBuffer const* buffer) const;
+	void rejoinCursor_();
+	bool cursorFloor_(uint64_t& floor) const;
+	bool recyclePassedBuffers_();
+	bool dropLaggingCursor_();
+
+	void notifyReaders_();
+	void notifyWriters_();
+	void waitForChange_(std::atomic<uint32_t>* futex, std::atomic<int>* waiters, uint32_t last_value, size_t timeout_us);
 
 	ShmStruct requested_shm_parameters_;
 
-	int shm_segment_id_;
+	std::unique_ptr<SharedMemoryBackend> backend_;
 	ShmStruct* shm_ptr_;
 	uint32_t shm_key_;
 	int manager_id_;
 	std::vector<ShmBuffer*> buffer_ptrs_;
 	mutable std::vector<std::mutex> buffer_mutexes_;
+	std::vector<size_t> write_reservations_;  // Bytes reserved by ReserveWrite in each buffer, guarded by buffer_mutexes_
 	mutable std::mutex search_mutex_;
 
 	std::atomic<size_t> last_seen_id_;
-	bool registered_reader_{false};
-	bool registered_writer_{false};
+	std::mutex registration_mutex_;  // Serializes the first read or write of concurrent threads, see registerReader_
+	std::atomic<bool> registered_reader_{false};
+	std::atomic<bool> registered_writer_{false};
+	std::atomic<int> dispatch_lane_{-1};
+	std::atomic<int> reader_cursor_{-1};
 	size_t min_write_size_;
+	SharedMemoryOptions requested_options_;
+	std::atomic<unsigned> sweep_pos_{0};
+	std::atomic<uint64_t> last_probe_us_{0};  // Touch time of this process's last liveness probe, see probeManagers_
+	uint64_t touch_clock_slack_us_{0};  // Resolution of the segment's touch clock, added to the buffer timeout
+	double prefault_seconds_{0.0};
+	double lock_seconds_{0.0};
+	bool memory_locked_{false};
+
+	std::thread reaper_thread_;
+	std::atomic<bool> reaper_stop_{false};
+	std::mutex reaper_mutex_;
+	std::condition_variable reaper_cv_;
 };
 
 }  // namespace artdaq
@@ -0,0 +1,202 @@
+#ifndef artdaq_core_Data_FragmentView_hh
+#define artdaq_core_Data_FragmentView_hh 1
+
+#include "artdaq-core/Data/Fragment.hh"
+
+#include "cetlib_except/exception.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace artdaq {
+class FragmentView;
+
+/**
+ * \brief A std::vector of FragmentView objects
+ */
+typedef std::vector<FragmentView> FragmentViews;
+
+/**
+ * \brief A read-only, non-owning view of a Fragment stored in memory owned by someone else (e.g. a Shared Memory buffer)
+ *
+ * A FragmentView is two pointers and a counter, so it is cheap to copy. It is only valid as long as the memory it
+ * points to; the owner of that memory increments a generation counter when it gives the memory up. In debug builds
+ * (NDEBUG not defined), every accessor checks that counter and throws a cet::exception if the view has outlived its data.
+ */
+class FragmentView
+{
+public:
+	typedef Fragment::byte_t byte_t;                ///< Byte type used for byte-wise access
+	typedef Fragment::version_t version_t;          ///< typedef for version_t from Fragment
+	typedef Fragment::type_t type_t;                ///< typedef for type_t from Fragment
+	typedef Fragment::sequence_id_t sequence_id_t;  ///< typedef for sequence_id_t from Fragment
+	typedef Fragment::fragment_id_t fragment_id_t;  ///< typedef for fragment_id_t from Fragment
+	typedef Fragment::timestamp_t timestamp_t;      ///< typedef for timestamp_t from Fragment
+
+	/**
+	 * \brief Construct a FragmentView
+	 * \param header Address of the RawFragmentHeader of the Fragment. The Fragment must have the current header version
+	 * \param generation Generation counter of the owner of the memory (may be nullptr to disable lifetime checking)
+	 */
+	FragmentView(RawDataType const* header, uint64_t const* generation)
+	    : header_(header)
+	    , generation_(generation)
+	    , expected_generation_(generation != nullptr ? *generation : 0)
+	{}
+
+	/**
+	 * \brief Whether the memory this view points to is still valid
+	 * \return False if the owner of the memory has released it since the view was created
+	 */
+	bool isValid() const { return generation_ == nullptr || *generation_ == expected_generation_; }
+
+	/**
+	 * \brief Gets the size of the Fragment, from the Fragment header
+	 * \return Number of words in the Fragment. Includes header, metadata, and payload
+	 */
+	std::size_t size() const { return fragmentHeader_()->word_count; }
+
+	/**
+	 * \brief Gets the size of the Fragment, in bytes
+	 * \return Number of bytes in the Fragment. Includes header, metadata, and payload
+	 */
+	std::size_t sizeBytes() const { return sizeof(RawDataType) * size(); }
+
+	/**
+	 * \brief Version of the Fragment, from the Fragment header
+	 * \return Version of the Fragment
+	 */
+	version_t version() const { return fragmentHeader_()->version; }
+
+	/**
+	 * \brief Type of the Fragment, from the Fragment header
+	 * \return Type of the Fragment
+	 */
+	type_t type() const { return fragmentHeader_()->type; }
+
+	/**
+	 * \brief Sequence ID of the Fragment, from the Fragment header
+	 * \return Sequence ID of the Fragment
+	 */
+	sequence_id_t sequenceID() const { return fragmentHeader_()->sequence_id; }
+
+	/**
+	 * \brief Fragment ID of the Fragment, from the Fragment header
+	 * \return Fragment ID of the Fragment
+	 */
+	fragment_id_t fragmentID() const { return fragmentHeader_()->fragment_id; }
+
+	/**
+	 * \brief Timestamp of the Fragment, from the Fragment header
+	 * \return Timestamp of the Fragment
+	 */
+	timestamp_t timestamp() const { return fragmentHeader_()->timestamp; }
+
+	/**
+	 * \brief Test whether this Fragment has metadata
+	 * \return If a metadata object has been set
+	 */
+	bool hasMetadata() const { return fragmentHeader_()->metadata_word_count != 0; }
+
+	/**
+	 * \brief Return a pointer to the metadata
+	 * \tparam T Type of the metadata
+	 * \return Pointer to the metadata
+	 * \exception cet::exception if no metadata is present
+	 */
+	template<class T>
+	T const* metadata() const
+	{
+		if (fragmentHeader_()->metadata_word_count == 0)
+		{
+			throw cet::exception("InvalidRequest")  // NOLINT(cert-err60-cpp)
+			    << "No metadata has been stored in this Fragment.";
+		}
+		return reinterpret_cast<T const*>(header_ + detail::RawFragmentHeader::num_words());  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+
+	/**
+	 * \brief Return the number of RawDataType words in the data payload. This does not include the number of words in the header or the metadata.
+	 * \return Number of RawDataType words in the payload section of the Fragment
+	 */
+	std::size_t dataSize() const { return size() - detail::RawFragmentHeader::num_words() - fragmentHeader_()->metadata_word_count; }
+
+	/**
+	 * \brief Return the number of bytes in the data payload
+	 * \return Number of bytes in the payload section of the Fragment
+	 */
+	std::size_t dataSizeBytes() const { return sizeof(RawDataType) * dataSize(); }
+
+	/**
+	 * \brief Return a pointer to the beginning of the payload
+	 * \return Pointer to the first payload word
+	 */
+	RawDataType const* dataBegin() const { return header_ + detail::RawFragmentHeader::num_words() + fragmentHeader_()->metadata_word_count; }  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+	/**
+	 * \brief Return a pointer to the end of the payload
+	 * \return Pointer one past the last payload word
+	 */
+	RawDataType const* dataEnd() const { return header_ + size(); }  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+	/**
+	 * \brief Return a byte pointer to the beginning of the payload
+	 * \return Pointer to the first payload byte
+	 */
+	byte_t const* dataBeginBytes() const { return reinterpret_cast<byte_t const*>(dataBegin()); }  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+
+	/**
+	 * \brief Return a byte pointer to the end of the payload
+	 * \return Pointer one past the last payload byte
+	 */
+	byte_t const* dataEndBytes() const { return reinterpret_cast<byte_t const*>(dataEnd()); }  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+
+	/**
+	 * \brief Return a pointer to the beginning of the header
+	 * \return Pointer to the first header word
+	 */
+	RawDataType const* headerAddress() const
+	{
+		checkGeneration_();
+		return header_;
+	}
+
+	/**
+	 * \brief Copy the viewed Fragment into an owning Fragment, for consumers which need to keep it past the lifetime of the view
+	 * \return Fragment containing a copy of the header, metadata and payload
+	 */
+	Fragment toFragment() const
+	{
+		auto words = size();
+		Fragment frag(words - detail::RawFragmentHeader::num_words());
+		memcpy(frag.headerAddress(), header_, words * sizeof(RawDataType));
+		frag.autoResize();
+		return frag;
+	}
+
+private:
+	detail::RawFragmentHeader const* fragmentHeader_() const
+	{
+		checkGeneration_();
+		return reinterpret_cast<detail::RawFragmentHeader const*>(header_);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+
+	void checkGeneration_() const
+	{
+#ifndef NDEBUG
+		if (!isValid())
+		{
+			throw cet::exception("FragmentView")  // NOLINT(cert-err60-cpp)
+			    << "FragmentView used after the buffer it points to was released (generation " << expected_generation_ << ", now " << *generation_ << ")";
+		}
+#endif
+	}
+
+	RawDataType const* header_;
+	uint64_t const* generation_;
+	uint64_t expected_generation_;
+};
+}  // namespace artdaq
+
+#endif /* artdaq_core_Data_FragmentView_hh */
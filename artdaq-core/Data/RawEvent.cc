@@ -15,6 +15,7 @@ void detail::RawEventHeader::print(std::ostream& os) const
 }
 
 constexpr uint8_t detail::RawEventHeader::CURRENT_VERSION;
+constexpr uint8_t detail::RawEventHeader::DIRECTORY_VERSION;
 void RawEvent::print(std::ostream& os) const
 {
 	os << "Run " << runID()
@@ -0,0 +1,112 @@
+#ifndef artdaq_core_Data_detail_RawEventDirectory_hh
+#define artdaq_core_Data_detail_RawEventDirectory_hh 1
+
+#include "artdaq-core/Data/RawEvent.hh"
+#include "artdaq-core/Data/detail/RawFragmentHeader.hh"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace artdaq {
+namespace detail {
+
+/**
+ * \brief One Fragment in a RawEventDirectory
+ */
+struct RawEventDirectoryEntry
+{
+	uint32_t offset_words;  ///< Offset of the Fragment's RawFragmentHeader from the start of the RawEventHeader, in RawDataType words
+	uint32_t word_count;    ///< Size of the Fragment (header, metadata and payload), in RawDataType words
+	uint16_t fragment_id;   ///< Fragment ID of the Fragment
+	uint8_t type;           ///< Type of the Fragment
+	uint8_t reserved0;      ///< Reserved, written as zero
+	uint32_t reserved1;     ///< Reserved, written as zero
+};
+static_assert(sizeof(RawEventDirectoryEntry) == 2 * sizeof(RawFragmentHeader::RawDataType), "RawEventDirectoryEntry must be two RawDataType words");
+
+/**
+ * \brief Optional directory of the Fragments in an event, written by the producer of the event.
+ *
+ * An event whose RawEventHeader has version RawEventHeader::DIRECTORY_VERSION is laid out as the RawEventHeader,
+ * a RawEventDirectory with room for capacity entries, then the Fragments. The producer sizes the directory when it
+ * starts the event and adds an entry as it writes each Fragment; Fragments beyond fragment_count (e.g. when more
+ * Fragments arrive than expected) are still found by walking the Fragment headers after the last listed one.
+ * All Fragments of the event share the sequence ID of the RawEventHeader.
+ */
+struct RawEventDirectory
+{
+	uint32_t capacity;        ///< Number of entries allocated after this header
+	uint32_t fragment_count;  ///< Number of entries filled in
+
+	/**
+	 * \brief Size of a directory with the given capacity
+	 * \param capacity Number of entries
+	 * \return Size in bytes (a whole number of RawDataType words)
+	 */
+	static constexpr size_t SizeBytes(size_t capacity) { return sizeof(RawEventDirectory) + capacity * sizeof(RawEventDirectoryEntry); }
+
+	/**
+	 * \brief Initialize an empty directory in place
+	 * \param ptr Address of the directory, right after the RawEventHeader. Must have room for SizeBytes(capacity) bytes
+	 * \param capacity Number of entries to allocate
+	 * \return Pointer to the initialized directory
+	 */
+	static RawEventDirectory* Init(void* ptr, uint32_t capacity)
+	{
+		auto dir = static_cast<RawEventDirectory*>(ptr);
+		dir->capacity = capacity;
+		dir->fragment_count = 0;
+		return dir;
+	}
+
+	/**
+	 * \brief Offset of the first Fragment from the start of an event
+	 * \param event Address of the RawEventHeader
+	 * \return Offset in bytes, which includes the directory if the event has one
+	 */
+	static size_t FragmentsOffset(void const* event)
+	{
+		auto hdr = static_cast<RawEventHeader const*>(event);
+		if (hdr->version != RawEventHeader::DIRECTORY_VERSION) return sizeof(RawEventHeader);
+		return sizeof(RawEventHeader) + reinterpret_cast<RawEventDirectory const*>(hdr + 1)->sizeBytes();  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	}
+
+	/**
+	 * \brief Size of this directory
+	 * \return Size in bytes
+	 */
+	size_t sizeBytes() const { return SizeBytes(capacity); }
+
+	/**
+	 * \brief The directory entries
+	 * \return Pointer to the first of capacity entries
+	 */
+	RawEventDirectoryEntry const* entries() const { return reinterpret_cast<RawEventDirectoryEntry const*>(this + 1); }  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+	/**
+	 * \brief Record a Fragment which has been written into the event
+	 * \param offset_bytes Offset of the Fragment's RawFragmentHeader from the start of the RawEventHeader, in bytes
+	 * \param hdr Header of the Fragment
+	 * \return False if the directory is full, in which case readers will find the Fragment by walking the headers
+	 */
+	bool addFragment(size_t offset_bytes, RawFragmentHeader const& hdr)
+	{
+		if (fragment_count >= capacity) return false;
+		auto entry = const_cast<RawEventDirectoryEntry*>(entries()) + fragment_count;  // NOLINT(cppcoreguidelines-pro-type-const-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		entry->offset_words = offset_bytes / sizeof(RawFragmentHeader::RawDataType);
+		entry->word_count = hdr.word_count;
+		entry->fragment_id = hdr.fragment_id;
+		entry->type = hdr.type;
+		entry->reserved0 = 0;
+		entry->reserved1 = 0;
+		++fragment_count;
+		return true;
+	}
+};
+static_assert(sizeof(RawEventDirectory) == sizeof(RawFragmentHeader::RawDataType), "RawEventDirectory must be one RawDataType word");
+static_assert(sizeof(RawEventHeader) % sizeof(RawFragmentHeader::RawDataType) == 0, "RawEventHeader must be a whole number of RawDataType words");
+
+}  // namespace detail
+}  // namespace artdaq
+
+#endif /* artdaq_core_Data_detail_RawEventDirectory_hh */
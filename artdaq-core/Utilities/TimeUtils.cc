@@ -55,6 +55,29 @@ uint64_t artdaq::TimeUtils::gettimeofday_us()
 	return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
 }
 
+uint64_t artdaq::TimeUtils::gettimeofday_coarse_us()
+{
+#ifdef CLOCK_REALTIME_COARSE
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else
+	return gettimeofday_us();
+#endif
+}
+
+uint64_t artdaq::TimeUtils::gettimeofday_coarse_resolution_us()
+{
+#ifdef CLOCK_REALTIME_COARSE
+	struct timespec res;
+	if (clock_getres(CLOCK_REALTIME_COARSE, &res) == 0)
+	{
+		return static_cast<uint64_t>(res.tv_sec) * 1000000 + (res.tv_nsec + 999) / 1000;
+	}
+#endif
+	return 1;
+}
+
 struct timespec artdaq::TimeUtils::get_realtime_clock()
 {
 	struct timespec ts;
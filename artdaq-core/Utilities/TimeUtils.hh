@@ -100,6 +100,19 @@ std::string convertUnixTimeToString(struct timespec const& inputUnixTime);
  */
 uint64_t gettimeofday_us();
 
+/**
+ * \brief Get the current time of day in microseconds from the kernel's coarse real-time clock (CLOCK_REALTIME_COARSE).
+ * Same epoch as gettimeofday_us, but much cheaper to read, at the cost of a resolution of one scheduler tick.
+ * \return The current time of day in microseconds, truncated to the coarse clock resolution
+ */
+uint64_t gettimeofday_coarse_us();
+
+/**
+ * \brief Get the resolution of gettimeofday_coarse_us
+ * \return Resolution in microseconds (rounded up)
+ */
+uint64_t gettimeofday_coarse_resolution_us();
+
 /**
  * \brief Converts a Unix time to double
  * \param inputUnixTime A time_t Unix time variable
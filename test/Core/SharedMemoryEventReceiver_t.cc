@@ -0,0 +1,414 @@
+#define TRACE_NAME "SharedMemoryEventReceiver_t"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "TRACE/tracemf.h"
+#include "artdaq-core/Core/SharedMemoryEventReceiver.hh"
+#include "artdaq-core/Core/SharedMemoryManager.hh"
+#include "artdaq-core/Data/Fragment.hh"
+#include "artdaq-core/Data/RawEvent.hh"
+#include "artdaq-core/Data/detail/RawEventDirectory.hh"
+#include "artdaq-core/Utilities/configureMessageFacility.hh"
+
+#define BOOST_TEST_MODULE(SharedMemoryEventReceiver_t)
+#include "SharedMemoryTestShims.hh"
+#include "cetlib/quiet_unit_test.hpp"
+
+namespace {
+/// Write an event containing one Fragment of each of the given types (with sizes 10, 20, ... words of payload) into a buffer of man,
+/// optionally publishing the Fragment types in the buffer's type mask
+void WriteEvent(artdaq::SharedMemoryManager& man, std::vector<artdaq::Fragment::type_t> const& types, bool publish_types = false)
+{
+	auto buf = man.WaitForBufferForWriting(1000000);
+	BOOST_REQUIRE(buf != -1);
+
+	artdaq::detail::RawEventHeader hdr(1, 1, 1, 1, 1);
+	man.Write(buf, &hdr, sizeof(hdr));
+
+	size_t payload = 0;
+	for (size_t ii = 0; ii < types.size(); ++ii)
+	{
+		payload += 10;
+		artdaq::Fragment frag(1, ii, types[ii]);
+		frag.resize(payload);
+		for (size_t jj = 0; jj < payload; ++jj)
+		{
+			*(frag.dataBegin() + jj) = ii * 1000 + jj;
+		}
+		man.Write(buf, frag.headerAddress(), frag.sizeBytes());
+		if (publish_types) man.AddBufferType(buf, types[ii]);
+	}
+	man.MarkBufferFull(buf);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(SharedMemoryEventReceiver_test)
+
+BOOST_AUTO_TEST_CASE(FragmentViews)
+{
+	artdaq::configureMessageFacility("SharedMemoryEventReceiver_t", true, true);
+	TLOG(TLVL_INFO) << "BEGIN TEST FragmentViews";
+	uint32_t key = GetRandomKey(0xE7E7);
+	uint32_t broadcast_key = GetRandomKey(0xB7B7);
+	artdaq::SharedMemoryManager man(key, 2, 0x2000);
+	artdaq::SharedMemoryManager broadcasts(broadcast_key, 2, 0x1000);
+	artdaq::SharedMemoryEventReceiver recv(key, broadcast_key);
+
+	auto type_a = artdaq::Fragment::FirstUserFragmentType;
+	artdaq::Fragment::type_t type_b = artdaq::Fragment::FirstUserFragmentType + 1;
+	WriteEvent(man, {type_a, type_b, type_a});
+
+	BOOST_REQUIRE(recv.ReadyForRead());
+	bool err = false;
+	BOOST_REQUIRE(recv.ReadHeader(err) != nullptr);
+	BOOST_REQUIRE(!err);
+
+	auto views = recv.GetFragmentViewsByType(err, type_a);
+	BOOST_REQUIRE(!err);
+	BOOST_REQUIRE_EQUAL(views.size(), 2);
+	BOOST_REQUIRE_EQUAL(views[0].fragmentID(), 0);
+	BOOST_REQUIRE_EQUAL(views[1].fragmentID(), 2);
+	BOOST_REQUIRE_EQUAL(views[1].type(), type_a);
+	BOOST_REQUIRE_EQUAL(views[1].sequenceID(), 1);
+	BOOST_REQUIRE_EQUAL(views[1].dataSize(), 30);
+	BOOST_REQUIRE_EQUAL(*(views[1].dataBegin() + 29), 2029);
+	BOOST_REQUIRE_EQUAL(views[1].dataEnd() - views[1].dataBegin(), 30);
+
+	// The views point into the buffer, and agree with the copying interface
+	auto frags = recv.GetFragmentsByType(err, type_a);
+	BOOST_REQUIRE(!err);
+	BOOST_REQUIRE_EQUAL(frags->size(), 2);
+	for (size_t ii = 0; ii < views.size(); ++ii)
+	{
+		BOOST_REQUIRE_EQUAL(views[ii].sizeBytes(), (*frags)[ii].sizeBytes());
+		BOOST_REQUIRE_EQUAL(memcmp(views[ii].headerAddress(), (*frags)[ii].headerAddress(), views[ii].sizeBytes()), 0);
+	}
+
+	auto all = recv.GetFragmentViewsByType(err, artdaq::Fragment::InvalidFragmentType);
+	BOOST_REQUIRE(!err);
+	BOOST_REQUIRE_EQUAL(all.size(), 3);
+	BOOST_REQUIRE_EQUAL(all[1].type(), type_b);
+
+	auto copy = views[0].toFragment();
+	BOOST_REQUIRE_EQUAL(copy.dataSize(), 10);
+
+	recv.ReleaseBuffer();
+	BOOST_REQUIRE(!views[0].isValid());
+	BOOST_REQUIRE_EQUAL(*(copy.dataBegin() + 9), 9);
+#ifndef NDEBUG
+	BOOST_REQUIRE_THROW(views[0].type(), cet::exception);
+#endif
+
+	TLOG(TLVL_INFO) << "END TEST FragmentViews";
+}
+
+BOOST_AUTO_TEST_CASE(FragmentIndex)
+{
+	TLOG(TLVL_INFO) << "BEGIN TEST FragmentIndex";
+	uint32_t key = GetRandomKey(0xE7E7);
+	uint32_t broadcast_key = GetRandomKey(0xB7B7);
+	artdaq::SharedMemoryManager man(key, 2, 0x2000);
+	artdaq::SharedMemoryManager broadcasts(broadcast_key, 2, 0x1000);
+	artdaq::SharedMemoryEventReceiver recv(key, broadcast_key);
+
+	auto type_a = artdaq::Fragment::FirstUserFragmentType;
+	artdaq::Fragment::type_t type_b = artdaq::Fragment::FirstUserFragmentType + 1;
+	artdaq::Fragment::type_t type_c = artdaq::Fragment::FirstUserFragmentType + 2;
+	WriteEvent(man, {type_b, type_a, type_b, type_c});
+
+	BOOST_REQUIRE(recv.ReadyForRead());
+	bool err = false;
+	BOOST_REQUIRE(recv.ReadHeader(err) != nullptr);
+
+	auto types = recv.GetFragmentTypes(err);
+	BOOST_REQUIRE(!err);
+	BOOST_REQUIRE_EQUAL(types.size(), 3);
+
+	// Queries may be repeated in any order without re-walking the buffer
+	auto frags_b = recv.GetFragmentsByType(err, type_b);
+	BOOST_REQUIRE(!err);
+	BOOST_REQUIRE_EQUAL(frags_b->size(), 2);
+	BOOST_REQUIRE_EQUAL((*frags_b)[1].fragmentID(), 2);
+	BOOST_REQUIRE_EQUAL(*((*frags_b)[1].dataBegin() + 29), 2029);
+	auto frags_c = recv.GetFragmentsByType(err, type_c);
+	BOOST_REQUIRE(!err);
+	BOOST_REQUIRE_EQUAL(frags_c->size(), 1);
+	BOOST_REQUIRE_EQUAL((*frags_c)[0].dataSize(), 40);
+	BOOST_REQUIRE_EQUAL(recv.GetFragmentsByType(err, artdaq::Fragment::InvalidFragmentType)->size(), 4);
+	recv.ReleaseBuffer();
+
+	// An event whose last Fragment is truncated is reported as an error
+	auto buf = man.GetBufferForWriting(false);
+	artdaq::detail::RawEventHeader hdr(1, 1, 2, 2, 2);
+	man.Write(buf, &hdr, sizeof(hdr));
+	artdaq::Fragment frag(2, 0, type_a);
+	frag.resize(100);
+	man.Write(buf, frag.headerAddress(), frag.sizeBytes() / 2);
+	man.MarkBufferFull(buf);
+
+	BOOST_REQUIRE(recv.ReadyForRead());
+	BOOST_REQUIRE(recv.ReadHeader(err) != nullptr);
+	recv.GetFragmentTypes(err);
+	BOOST_REQUIRE(err);
+	recv.ReleaseBuffer();
+
+	TLOG(TLVL_INFO) << "END TEST FragmentIndex";
+}
+
+BOOST_AUTO_TEST_CASE(FragmentDirectory)
+{
+	TLOG(TLVL_INFO) << "BEGIN TEST FragmentDirectory";
+	uint32_t key = GetRandomKey(0xE7E7);
+	uint32_t broadcast_key = GetRandomKey(0xB7B7);
+	artdaq::SharedMemoryManager man(key, 2, 0x2000);
+	artdaq::SharedMemoryManager broadcasts(broadcast_key, 2, 0x1000);
+	artdaq::SharedMemoryEventReceiver recv(key, broadcast_key);
+
+	// Write an event with a directory, which has room for two of its three Fragments
+	auto buf = man.GetBufferForWriting(false);
+	artdaq::detail::RawEventHeader hdr(1, 1, 3, 3, 3);
+	hdr.version = artdaq::detail::RawEventHeader::DIRECTORY_VERSION;
+	man.Write(buf, &hdr, sizeof(hdr));
+	auto dir = artdaq::detail::RawEventDirectory::Init(static_cast<uint8_t*>(man.GetBufferStart(buf)) + sizeof(hdr), 2);
+	man.IncrementWritePos(buf, artdaq::detail::RawEventDirectory::SizeBytes(2));
+
+	auto type_a = artdaq::Fragment::FirstUserFragmentType;
+	artdaq::Fragment::type_t type_b = artdaq::Fragment::FirstUserFragmentType + 1;
+	std::vector<artdaq::Fragment::type_t> types{type_a, type_b, type_a};
+	for (size_t ii = 0; ii < types.size(); ++ii)
+	{
+		artdaq::Fragment frag(3, ii + 10, types[ii]);
+		frag.resize(ii + 1);
+		*frag.dataBegin() = ii;
+		auto offset = man.BufferDataSize(buf);
+		man.Write(buf, frag.headerAddress(), frag.sizeBytes());
+		BOOST_REQUIRE_EQUAL(dir->addFragment(offset, *reinterpret_cast<artdaq::detail::RawFragmentHeader const*>(frag.headerAddress())), ii < 2);
+	}
+	man.MarkBufferFull(buf);
+
+	BOOST_REQUIRE(recv.ReadyForRead());
+	bool err = false;
+	BOOST_REQUIRE(recv.ReadHeader(err) != nullptr);
+	BOOST_REQUIRE_EQUAL(recv.GetFragmentTypes(err).size(), 2);
+	BOOST_REQUIRE(!err);
+
+	auto frags = recv.GetFragmentsByType(err, type_a);
+	BOOST_REQUIRE(!err);
+	BOOST_REQUIRE_EQUAL(frags->size(), 2);
+	BOOST_REQUIRE_EQUAL((*frags)[0].fragmentID(), 10);
+	BOOST_REQUIRE_EQUAL((*frags)[1].fragmentID(), 12);
+	BOOST_REQUIRE_EQUAL((*frags)[1].sequenceID(), 3);
+	BOOST_REQUIRE_EQUAL((*frags)[1].dataSize(), 3);
+	BOOST_REQUIRE_EQUAL(*(*frags)[1].dataBegin(), 2);
+
+	auto views = recv.GetFragmentViewsByType(err, type_b);
+	BOOST_REQUIRE(!err);
+	BOOST_REQUIRE_EQUAL(views.size(), 1);
+	BOOST_REQUIRE_EQUAL(views[0].fragmentID(), 11);
+	recv.ReleaseBuffer();
+
+	TLOG(TLVL_INFO) << "END TEST FragmentDirectory";
+}
+
+BOOST_AUTO_TEST_CASE(Lookahead)
+{
+	TLOG(TLVL_INFO) << "BEGIN TEST Lookahead";
+	uint32_t key = GetRandomKey(0xE7E7);
+	uint32_t broadcast_key = GetRandomKey(0xB7B7);
+	artdaq::SharedMemoryManager man(key, 5, 0x2000);
+	artdaq::SharedMemoryManager broadcasts(broadcast_key, 2, 0x1000);
+	artdaq::SharedMemoryEventReceiver recv(key, broadcast_key, 2);
+
+	for (size_t ii = 0; ii < 4; ++ii)
+	{
+		WriteEvent(man, {artdaq::Fragment::FirstUserFragmentType});
+	}
+
+	BOOST_REQUIRE(recv.ReadyForRead());
+	BOOST_REQUIRE_EQUAL(recv.GetLookaheadCount(), 2);
+	BOOST_REQUIRE_EQUAL(recv.ReadReadyCount(), 3);
+	BOOST_REQUIRE_EQUAL(man.ReadReadyCount(), 1);
+
+	// The lookahead queue is topped up each time an event is handed out, until the segment runs dry
+	for (size_t ii = 0; ii < 4; ++ii)
+	{
+		BOOST_REQUIRE(recv.ReadyForRead());
+		bool err = false;
+		BOOST_REQUIRE(recv.ReadHeader(err) != nullptr);
+		auto frags = recv.GetFragmentsByType(err, artdaq::Fragment::FirstUserFragmentType);
+		BOOST_REQUIRE(!err);
+		BOOST_REQUIRE_EQUAL(frags->size(), 1);
+		BOOST_REQUIRE_EQUAL(recv.GetLookaheadCount(), std::min(static_cast<size_t>(2), 3 - ii));
+		recv.ReleaseBuffer();
+	}
+	BOOST_REQUIRE_EQUAL(recv.ReadyForRead(false, 1000), false);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 5);
+
+	TLOG(TLVL_INFO) << "END TEST Lookahead";
+}
+
+BOOST_AUTO_TEST_CASE(LookaheadTimeout)
+{
+	TLOG(TLVL_INFO) << "BEGIN TEST LookaheadTimeout";
+	uint32_t key = GetRandomKey(0xE7E7);
+	uint32_t broadcast_key = GetRandomKey(0xB7B7);
+	artdaq::SharedMemoryManager man(key, 5, 0x2000, 100000);
+	artdaq::SharedMemoryManager broadcasts(broadcast_key, 2, 0x1000);
+	artdaq::SharedMemoryEventReceiver recv(key, broadcast_key, 3);
+	auto first = recv.MakeCursor();
+	auto second = recv.MakeCursor();
+
+	// Each event is identified by the type of its only Fragment
+	for (size_t ii = 0; ii < 4; ++ii)
+	{
+		WriteEvent(man, {static_cast<artdaq::Fragment::type_t>(artdaq::Fragment::FirstUserFragmentType + ii)});
+	}
+	std::vector<artdaq::Fragment::type_t> seen;
+	auto take = [&](artdaq::SharedMemoryEventReceiver::Cursor& cursor) {
+		bool err = false;
+		auto types = cursor.GetFragmentTypes(err);
+		BOOST_REQUIRE(!err);
+		BOOST_REQUIRE_EQUAL(types.size(), 1);
+		seen.push_back(*types.begin());
+	};
+
+	BOOST_REQUIRE(first->ReadyForRead());
+	take(*first);
+	BOOST_REQUIRE_EQUAL(recv.GetLookaheadCount(), 3);
+
+	// The second lookahead buffer times out and is reset to Full, so the receiver claims it again while its old entry is still queued
+	usleep(150000);
+	BOOST_REQUIRE(man.ResetBuffer(2));
+	BOOST_REQUIRE(second->ReadyForRead());
+	take(*second);
+
+	// The old entry must not hand that event to a second Cursor while the first one still holds it
+	first->ReleaseBuffer();
+	BOOST_REQUIRE(first->ReadyForRead());
+	take(*first);
+	second->ReleaseBuffer();
+	BOOST_REQUIRE(second->ReadyForRead());
+	take(*second);
+	second->ReleaseBuffer();
+	BOOST_REQUIRE_EQUAL(second->ReadyForRead(false, 1000), false);
+	first->ReleaseBuffer();
+	BOOST_REQUIRE_EQUAL(first->ReadyForRead(false, 1000), false);
+
+	std::sort(seen.begin(), seen.end());
+	BOOST_REQUIRE_EQUAL(seen.size(), 4);
+	BOOST_REQUIRE(std::unique(seen.begin(), seen.end()) == seen.end());
+	BOOST_REQUIRE_EQUAL(recv.GetLookaheadCount(), 0);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 5);
+
+	TLOG(TLVL_INFO) << "END TEST LookaheadTimeout";
+}
+
+BOOST_AUTO_TEST_CASE(Cursors)
+{
+	TLOG(TLVL_INFO) << "BEGIN TEST Cursors";
+	uint32_t key = GetRandomKey(0xE7E7);
+	uint32_t broadcast_key = GetRandomKey(0xB7B7);
+	artdaq::SharedMemoryManager man(key, 8, 0x2000);
+	artdaq::SharedMemoryManager broadcasts(broadcast_key, 2, 0x1000);
+	artdaq::SharedMemoryEventReceiver recv(key, broadcast_key, 2);
+
+	constexpr size_t events = 200;
+	constexpr size_t workers = 4;
+	std::atomic<size_t> received{0};
+	std::atomic<size_t> fragments{0};
+	std::atomic<size_t> errors{0};
+	std::vector<size_t> per_worker(workers, 0);
+
+	// Each worker thread reads through its own Cursor, sharing the receiver's attachment and lookahead queue
+	std::vector<std::thread> threads;
+	for (size_t ii = 0; ii < workers; ++ii)
+	{
+		threads.emplace_back([&, ii]() {
+			auto cursor = recv.MakeCursor();
+			while (received.load() < events)
+			{
+				if (!cursor->ReadyForRead(false, 10000)) continue;
+				bool err = false;
+				if (cursor->ReadHeader(err) == nullptr || err)
+				{
+					++errors;
+					continue;
+				}
+				auto views = cursor->GetFragmentViewsByType(err, artdaq::Fragment::InvalidFragmentType);
+				if (err || views.size() != 2 || *(views[1].dataBegin() + 19) != 1019) ++errors;
+				fragments += views.size();
+				cursor->ReleaseBuffer();
+				++per_worker[ii];
+				++received;
+			}
+		});
+	}
+
+	for (size_t ii = 0; ii < events; ++ii)
+	{
+		WriteEvent(man, {artdaq::Fragment::FirstUserFragmentType, artdaq::Fragment::FirstUserFragmentType});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	BOOST_REQUIRE_EQUAL(received.load(), events);
+	BOOST_REQUIRE_EQUAL(fragments.load(), 2 * events);
+	BOOST_REQUIRE_EQUAL(errors.load(), 0);
+	for (size_t ii = 0; ii < workers; ++ii)
+	{
+		TLOG(TLVL_INFO) << "Worker " << ii << " read " << per_worker[ii] << " events";
+	}
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 8);
+
+	TLOG(TLVL_INFO) << "END TEST Cursors";
+}
+
+BOOST_AUTO_TEST_CASE(TypeInterest)
+{
+	TLOG(TLVL_INFO) << "BEGIN TEST TypeInterest";
+	uint32_t key = GetRandomKey(0xE7E7);
+	uint32_t broadcast_key = GetRandomKey(0xB7B7);
+	artdaq::SharedMemoryManager man(key, 5, 0x2000);
+	artdaq::SharedMemoryManager broadcasts(broadcast_key, 2, 0x1000);
+	artdaq::SharedMemoryEventReceiver recv(key, broadcast_key);
+
+	auto type_a = artdaq::Fragment::FirstUserFragmentType;
+	artdaq::Fragment::type_t type_b = artdaq::Fragment::FirstUserFragmentType + 1;
+	recv.SetFragmentTypeInterest({type_a});
+
+	WriteEvent(man, {type_b}, true);          // Rejected from the type mask
+	WriteEvent(man, {type_a, type_b}, true);  // Accepted from the type mask
+	WriteEvent(man, {type_b, type_b});        // No mask, rejected from the Fragment index
+	WriteEvent(man, {type_b, type_a});        // No mask, accepted from the Fragment index
+
+	BOOST_REQUIRE(man.BufferHasAnyType(0, artdaq::SharedMemoryManager::BufferTypeMask().set(type_b)));
+	BOOST_REQUIRE(!man.BufferHasAnyType(0, artdaq::SharedMemoryManager::BufferTypeMask().set(type_a)));
+	BOOST_REQUIRE(man.BufferHasAnyType(2, artdaq::SharedMemoryManager::BufferTypeMask().set(type_a)));
+
+	std::vector<artdaq::Fragment::fragment_id_t> ids;
+	while (recv.ReadyForRead(false, 1000))
+	{
+		bool err = false;
+		BOOST_REQUIRE(recv.ReadHeader(err) != nullptr);
+		auto views = recv.GetFragmentViewsByType(err, type_a);
+		BOOST_REQUIRE(!err);
+		BOOST_REQUIRE_EQUAL(views.size(), 1);
+		ids.push_back(views[0].fragmentID());
+		recv.ReleaseBuffer();
+	}
+	BOOST_REQUIRE_EQUAL(ids.size(), 2);
+	BOOST_REQUIRE_EQUAL(ids[0], 0);
+	BOOST_REQUIRE_EQUAL(ids[1], 1);
+	BOOST_REQUIRE_EQUAL(recv.GetFilteredEventCount(), 2);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 5);
+
+	TLOG(TLVL_INFO) << "END TEST TypeInterest";
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,145 @@
+// Multi-process benchmark for the cache-line-aligned segment layout. Not part of the unit tests, since it takes
+// several seconds and its numbers depend on the machine (and are meaningless on a single core).
+//
+// Usage: SharedMemoryLayout_bench [processes]
+
+#include "artdaq-core/Core/SharedMemoryManager.hh"
+#include "artdaq-core/Utilities/TimeUtils.hh"
+
+#include "SharedMemoryTestShims.hh"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+constexpr size_t kStores = 2000000;
+constexpr size_t kWrites = 100000;
+constexpr size_t kLegacyRecordSize = 48;  // sizeof(ShmBuffer) in the original packed layout
+constexpr size_t kTouchTimeOffset = 40;   // last_touch_time offset in the packed record
+
+/// Fork processes children running func(index), returns the elapsed wall-clock time once all exit, or -1 if any failed
+template<typename F>
+double RunChildren(int processes, F func)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<pid_t> children;
+	bool ok = true;
+	for (int ii = 0; ii < processes; ++ii)
+	{
+		auto pid = fork();
+		if (pid < 0)
+		{
+			ok = false;
+			break;
+		}
+		if (pid == 0)
+		{
+			_exit(func(ii) ? 0 : 1);
+		}
+		children.push_back(pid);
+	}
+	for (auto pid : children)
+	{
+		int status = 0;
+		ok = waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 && ok;
+	}
+	return ok ? artdaq::TimeUtils::GetElapsedTime(start) : -1;
+}
+
+/// Each process stores a timestamp into its own record, as touchBuffer_ does, with the given record stride
+double TimeRecordStores(int processes, size_t stride)
+{
+	size_t size = (processes + 1) * stride + 64;
+	auto region = static_cast<uint8_t*>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+	if (region == MAP_FAILED)
+	{
+		return -1;
+	}
+	memset(region, 0, size);
+
+	auto elapsed = RunChildren(processes, [&](int index) {
+		auto touch = reinterpret_cast<std::atomic<uint64_t>*>(region + index * stride + kTouchTimeOffset);  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		for (size_t ii = 0; ii < kStores; ++ii)
+		{
+			touch->store(ii);
+		}
+		return touch->load() == kStores - 1;
+	});
+
+	munmap(region, size);
+	return elapsed;
+}
+
+/// Each process writes repeatedly into its own buffer of one segment
+double TimeConcurrentWriters(int processes)
+{
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager man(key, processes, 0x1000);
+	if (!man.IsValid())
+	{
+		return -1;
+	}
+
+	auto elapsed = RunChildren(processes, [&](int) {
+		artdaq::SharedMemoryManager writer(key);
+		if (!writer.IsValid()) return false;
+		auto buf = writer.GetBufferForWriting(false);
+		if (buf == -1) return false;
+
+		uint64_t word = 0;
+		for (size_t ii = 0; ii < kWrites; ++ii)
+		{
+			word = ii;
+			writer.Write(buf, &word, sizeof(word));
+			writer.ResetWritePos(buf);
+		}
+		writer.MarkBufferFull(buf);
+		return true;
+	});
+
+	if (man.ReadReadyCount() != static_cast<size_t>(processes))
+	{
+		return -1;
+	}
+	return elapsed;
+}
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+	int processes = argc > 1 ? atoi(argv[1]) : 4;
+	if (processes < 1)
+	{
+		std::cerr << "Usage: " << argv[0] << " [processes]" << std::endl;
+		return 1;
+	}
+
+	auto packed = TimeRecordStores(processes, kLegacyRecordSize);
+	auto padded = TimeRecordStores(processes, 64);
+	if (packed < 0 || padded < 0)
+	{
+		std::cerr << "Record store benchmark failed" << std::endl;
+		return 1;
+	}
+	std::cout << processes << " processes x " << kStores << " timestamp stores:" << std::endl
+	          << "  packed " << kLegacyRecordSize << "-byte records: " << packed * 1e9 / (processes * kStores) << " ns/store" << std::endl
+	          << "  padded 64-byte records: " << padded * 1e9 / (processes * kStores) << " ns/store" << std::endl
+	          << "  packed/padded: " << packed / padded << "x" << std::endl;
+
+	auto writers = TimeConcurrentWriters(processes);
+	if (writers < 0)
+	{
+		std::cerr << "Concurrent writer benchmark failed" << std::endl;
+		return 1;
+	}
+	std::cout << processes << " writer processes x " << kWrites << " small writes to separate buffers: "
+	          << writers * 1e9 / (processes * kWrites) << " ns/write" << std::endl;
+	return 0;
+}
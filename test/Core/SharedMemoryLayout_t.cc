@@ -0,0 +1,41 @@
+#include "artdaq-core/Core/SharedMemoryManager.hh"
+#include "artdaq-core/Utilities/configureMessageFacility.hh"
+
+#define BOOST_TEST_MODULE SharedMemoryLayout_t
+#include "cetlib/quiet_unit_test.hpp"
+
+#define TRACE_NAME "SharedMemoryLayout_t"
+#include "SharedMemoryTestShims.hh"
+#include "TRACE/tracemf.h"
+
+#include <sys/shm.h>
+#include <unistd.h>
+#include <cstring>
+
+// The multi-process layout benchmarks are in SharedMemoryLayout_bench, outside of the unit tests
+
+BOOST_AUTO_TEST_SUITE(SharedMemoryLayout_test)
+
+BOOST_AUTO_TEST_CASE(LegacyLayoutRejected)
+{
+	artdaq::configureMessageFacility("SharedMemoryLayout_t", true, true);
+	TLOG(TLVL_DEBUG) << "BEGIN TEST LegacyLayoutRejected";
+	uint32_t key = GetRandomKey(0x7357);
+
+	// Fake a fully-initialized segment in the original packed layout
+	auto id = shmget(key, 0x10000, IPC_CREAT | 0666);
+	BOOST_REQUIRE(id != -1);
+	auto ptr = static_cast<uint8_t*>(shmat(id, nullptr, 0));
+	BOOST_REQUIRE(ptr != reinterpret_cast<void*>(-1));
+	unsigned legacy_magic = 0xCAFE1111;
+	memcpy(ptr + 68, &legacy_magic, sizeof(legacy_magic));
+
+	artdaq::SharedMemoryManager man(key);
+	BOOST_REQUIRE_EQUAL(man.IsValid(), false);
+
+	shmdt(ptr);
+	shmctl(id, IPC_RMID, nullptr);
+	TLOG(TLVL_DEBUG) << "END TEST LegacyLayoutRejected";
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,15 @@
 #include "SharedMemoryTestShims.hh"
 #include "TRACE/tracemf.h"
 
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <thread>
+
 BOOST_AUTO_TEST_SUITE(SharedMemoryManager_test)
 
 BOOST_AUTO_TEST_CASE(Construct)
@@ -341,4 +350,1107 @@ BOOST_AUTO_TEST_CASE(Broadcast)
 	TLOG(TLVL_DEBUG) << "END TEST Broadcast";
 }
 
+BOOST_AUTO_TEST_CASE(IndexQueues)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST IndexQueues";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.use_index_queues = true;
+	artdaq::SharedMemoryManager man(key, 10, 0x1000, 0x10000, true, options);
+	artdaq::SharedMemoryManager man2(key);
+	artdaq::SharedMemoryManager man3(key);
+
+	BOOST_REQUIRE_EQUAL(man.UsesIndexQueues(), true);
+	BOOST_REQUIRE_EQUAL(man2.UsesIndexQueues(), true);
+	BOOST_REQUIRE_EQUAL(man.ReadyForWrite(false), true);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 10);
+	BOOST_REQUIRE_EQUAL(man2.ReadyForRead(), false);
+	BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), -1);
+
+	uint8_t n = 0;
+	uint8_t data[0x1000];
+	std::generate_n(data, 0x1000, [&]() { return ++n; });
+
+	// Buffers are handed out in FIFO order
+	std::vector<int> written;
+	for (int ii = 0; ii < 10; ++ii)
+	{
+		int buf = man.GetBufferForWriting(false);
+		BOOST_REQUIRE_EQUAL(buf, ii);
+		BOOST_REQUIRE_EQUAL(man.CheckBuffer(buf, artdaq::SharedMemoryManager::BufferSemaphoreFlags::Writing), true);
+		man.Write(buf, data, 0x100);
+		written.push_back(buf);
+	}
+	BOOST_REQUIRE_EQUAL(man.GetBufferForWriting(false), -1);
+	BOOST_REQUIRE_EQUAL(man.ReadyForWrite(false), false);
+
+	for (auto buf : written)
+	{
+		man.MarkBufferFull(buf);
+	}
+	BOOST_REQUIRE_EQUAL(man2.ReadyForRead(), true);
+	BOOST_REQUIRE_EQUAL(man2.ReadReadyCount(), 10);
+
+	for (int ii = 0; ii < 10; ++ii)
+	{
+		auto reader = ii % 2 == 0 ? &man2 : &man3;
+		auto readbuf = reader->GetBufferForReading();
+		BOOST_REQUIRE_EQUAL(readbuf, written[ii]);
+		BOOST_REQUIRE_EQUAL(reader->CheckBuffer(readbuf, artdaq::SharedMemoryManager::BufferSemaphoreFlags::Reading), true);
+		uint8_t byte;
+		BOOST_REQUIRE_EQUAL(reader->Read(readbuf, &byte, 1), true);
+		BOOST_REQUIRE_EQUAL(byte, 1);
+		reader->MarkBufferEmpty(readbuf);
+	}
+	BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 10);
+
+	// Buffers targeted at a specific reader are only returned to that reader
+	int buf = man.GetBufferForWriting(false);
+	man.Write(buf, data, 0x100);
+	man.MarkBufferFull(buf, man3.GetMyId());
+	BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(man3.GetBufferForReading(), buf);
+	man3.MarkBufferEmpty(buf);
+
+	// Buffers left behind by a detaching reader are requeued
+	buf = man.GetBufferForWriting(false);
+	man.Write(buf, data, 0x100);
+	man.MarkBufferFull(buf);
+	BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), buf);
+	man2.Detach();
+	BOOST_REQUIRE_EQUAL(man3.GetBufferForReading(), buf);
+	man3.MarkBufferEmpty(buf);
+
+	// Overwrite mode does not take buffers out of queue order once the Empty queue is exhausted
+	for (int ii = 0; ii < 10; ++ii)
+	{
+		buf = man.GetBufferForWriting(false);
+		BOOST_REQUIRE_NE(buf, -1);
+		man.MarkBufferFull(buf);
+	}
+	BOOST_REQUIRE_EQUAL(man.GetBufferForWriting(false), -1);
+	BOOST_REQUIRE_EQUAL(man.GetBufferForWriting(true), -1);
+	BOOST_REQUIRE_EQUAL(man3.ReadReadyCount(), 10);
+	for (int ii = 0; ii < 10; ++ii)
+	{
+		buf = man3.GetBufferForReading();
+		BOOST_REQUIRE_NE(buf, -1);
+		man3.MarkBufferEmpty(buf);
+	}
+	BOOST_REQUIRE_EQUAL(man3.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 10);
+	TLOG(TLVL_DEBUG) << "END TEST IndexQueues";
+}
+
+BOOST_AUTO_TEST_CASE(IndexQueueReadiness)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST IndexQueueReadiness";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.use_index_queues = true;
+	artdaq::SharedMemoryManager man(key, 2, 0x1000, 0x10000, true, options);
+	artdaq::SharedMemoryManager man2(key);
+	artdaq::SharedMemoryManager man3(key);
+
+	auto first = man.GetBufferForWriting(false);
+	auto second = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_NE(first, -1);
+	BOOST_REQUIRE_NE(second, -1);
+
+	// Overwriting writers see the same readiness as any other writer
+	BOOST_REQUIRE_EQUAL(man.ReadyForWrite(true), false);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(true), 0);
+
+	// A buffer sent to another manager does not make this one ready, so polling readers do not spin
+	man.MarkBufferFull(first, man3.GetMyId());
+	BOOST_REQUIRE_EQUAL(man2.ReadyForRead(), false);
+	BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(man3.ReadyForRead(), true);
+	BOOST_REQUIRE_EQUAL(man3.GetBufferForReading(), first);
+	man3.MarkBufferEmpty(first);
+
+	man.MarkBufferFull(second);
+	BOOST_REQUIRE_EQUAL(man2.ReadyForRead(), true);
+	BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), second);
+	man2.MarkBufferEmpty(second);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 2);
+	TLOG(TLVL_DEBUG) << "END TEST IndexQueueReadiness";
+}
+
+BOOST_AUTO_TEST_CASE(BlockingWaits)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST BlockingWaits";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager man(key, 2, 0x1000);
+	artdaq::SharedMemoryManager man2(key);
+
+	// Nothing to read: the wait times out
+	auto start_time = std::chrono::steady_clock::now();
+	BOOST_REQUIRE_EQUAL(man2.WaitForBufferForReading(20000), -1);
+	BOOST_REQUIRE_GE(artdaq::TimeUtils::GetElapsedTimeMicroseconds(start_time), 20000);
+
+	// A writer marking a buffer Full wakes the waiting reader long before the timeout
+	std::thread writer([&]() {
+		usleep(10000);
+		int buf = man.GetBufferForWriting(false);
+		man.MarkBufferFull(buf);
+	});
+	start_time = std::chrono::steady_clock::now();
+	auto readbuf = man2.WaitForBufferForReading(10000000);
+	auto elapsed = artdaq::TimeUtils::GetElapsedTimeMicroseconds(start_time);
+	writer.join();
+	BOOST_REQUIRE_NE(readbuf, -1);
+	BOOST_REQUIRE_LT(elapsed, 5000000);
+	BOOST_REQUIRE_EQUAL(man2.CheckBuffer(readbuf, artdaq::SharedMemoryManager::BufferSemaphoreFlags::Reading), true);
+
+	// With every buffer taken, a writer waits until MarkBufferEmpty releases one
+	int buf = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_NE(buf, -1);
+	BOOST_REQUIRE_EQUAL(man.WaitForBufferForWriting(20000), -1);
+	std::thread reader([&]() {
+		usleep(10000);
+		man2.MarkBufferEmpty(readbuf);
+	});
+	start_time = std::chrono::steady_clock::now();
+	auto writebuf = man.WaitForBufferForWriting(10000000);
+	elapsed = artdaq::TimeUtils::GetElapsedTimeMicroseconds(start_time);
+	reader.join();
+	BOOST_REQUIRE_EQUAL(writebuf, readbuf);
+	BOOST_REQUIRE_LT(elapsed, 5000000);
+	TLOG(TLVL_DEBUG) << "END TEST BlockingWaits";
+}
+
+BOOST_AUTO_TEST_CASE(PlacementOptions)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST PlacementOptions";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.huge_pages = true;  // Falls back to normal pages if the system has none configured
+	options.numa_node = 0;
+	options.prefault = true;
+	artdaq::SharedMemoryManager man(key, 10, 0x1000, 0x10000, true, options);
+	artdaq::SharedMemoryManager man2(key);
+
+	BOOST_REQUIRE_EQUAL(man.IsValid(), true);
+	BOOST_REQUIRE_EQUAL(man2.IsValid(), true);
+	BOOST_REQUIRE_EQUAL(man2.UsesHugePages(), man.UsesHugePages());
+	BOOST_REQUIRE_EQUAL(man2.GetNumaNode(), man.GetNumaNode());
+	BOOST_REQUIRE(man.GetNumaNode() == 0 || man.GetNumaNode() == -1);
+	if (man.UsesHugePages())
+	{
+		BOOST_REQUIRE(artdaq::SharedMemoryManager::GetHugePageSize() > 0);
+	}
+
+	uint8_t n = 0;
+	uint8_t data[0x1000];
+	std::generate_n(data, 0x1000, [&]() { return ++n; });
+	auto buf = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_NE(buf, -1);
+	man.Write(buf, data, 0x1000);
+	man.MarkBufferFull(buf);
+
+	auto readbuf = man2.GetBufferForReading();
+	BOOST_REQUIRE_EQUAL(readbuf, buf);
+	uint8_t out[0x1000];
+	BOOST_REQUIRE_EQUAL(man2.Read(readbuf, out, 0x1000), true);
+	BOOST_REQUIRE_EQUAL(memcmp(data, out, 0x1000), 0);
+	man2.MarkBufferEmpty(readbuf);
+
+	TLOG(TLVL_DEBUG) << "END TEST PlacementOptions";
+}
+
+BOOST_AUTO_TEST_CASE(Backends)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST Backends";
+	for (auto backend : {artdaq::SharedMemoryBackendType::PosixShm, artdaq::SharedMemoryBackendType::Memfd})
+	{
+		uint32_t key = GetRandomKey(0x7357);
+		artdaq::SharedMemoryOptions options;
+		options.backend = backend;
+		options.prefault = true;
+		auto man = std::make_unique<artdaq::SharedMemoryManager>(key, 10, 0x1000, 0x10000, true, options);
+		artdaq::SharedMemoryManager man2(key, 0, 0, 0x10000, true, options);
+
+		BOOST_REQUIRE_EQUAL(man->IsValid(), true);
+		BOOST_REQUIRE_EQUAL(man2.IsValid(), true);
+		BOOST_REQUIRE_EQUAL(man2.GetMyId(), 1);
+		BOOST_REQUIRE_EQUAL(man2.size(), 10);
+		BOOST_REQUIRE_EQUAL(man->GetAttachedCount(), 2);
+		BOOST_REQUIRE_EQUAL(man2.IsEndOfData(), false);
+
+		uint8_t n = 0;
+		uint8_t data[0x1000];
+		std::generate_n(data, 0x1000, [&]() { return ++n; });
+		auto buf = man->GetBufferForWriting(false);
+		BOOST_REQUIRE_NE(buf, -1);
+		man->Write(buf, data, 0x1000);
+		man->MarkBufferFull(buf);
+
+		auto readbuf = man2.GetBufferForReading();
+		BOOST_REQUIRE_EQUAL(readbuf, buf);
+		uint8_t out[0x1000];
+		BOOST_REQUIRE_EQUAL(man2.Read(readbuf, out, 0x1000), true);
+		BOOST_REQUIRE_EQUAL(memcmp(data, out, 0x1000), 0);
+		man2.MarkBufferEmpty(readbuf);
+
+		// The owner removes the segment: attached managers see end-of-data, new ones cannot attach
+		man.reset(nullptr);
+		BOOST_REQUIRE_EQUAL(man2.IsEndOfData(), true);
+		BOOST_REQUIRE_EQUAL(man2.GetAttachedCount(), 1);
+		artdaq::SharedMemoryManager man3(key, 0, 0, 0x10000, true, options);
+		BOOST_REQUIRE_EQUAL(man3.IsValid(), false);
+	}
+	TLOG(TLVL_DEBUG) << "END TEST Backends";
+}
+
+BOOST_AUTO_TEST_CASE(BatchAcquire)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST BatchAcquire";
+	for (auto use_index_queues : {false, true})
+	{
+		uint32_t key = GetRandomKey(0x7357);
+		artdaq::SharedMemoryOptions options;
+		options.use_index_queues = use_index_queues;
+		artdaq::SharedMemoryManager man(key, 10, 0x1000, 0x10000, true, options);
+		artdaq::SharedMemoryManager man2(key);
+
+		BOOST_REQUIRE_EQUAL(man2.GetBuffersForReading(4).size(), 0);
+
+		auto written = man.GetBuffersForWriting(6, false);
+		BOOST_REQUIRE_EQUAL(written.size(), 6);
+		for (auto buf : written)
+		{
+			BOOST_REQUIRE_EQUAL(man.CheckBuffer(buf, artdaq::SharedMemoryManager::BufferSemaphoreFlags::Writing), true);
+			man.Write(buf, &buf, sizeof(buf));
+		}
+		BOOST_REQUIRE_EQUAL(man.GetBuffersForWriting(6, false).size(), 4);  // Only 4 left
+		BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 0);
+
+		man.MarkBuffersFull(written);
+		BOOST_REQUIRE_EQUAL(man2.ReadReadyCount(), 6);
+
+		// Buffers come back in the order they were written
+		auto read = man2.GetBuffersForReading(4);
+		BOOST_REQUIRE_EQUAL(read.size(), 4);
+		for (size_t ii = 0; ii < read.size(); ++ii)
+		{
+			BOOST_REQUIRE_EQUAL(read[ii], written[ii]);
+			BOOST_REQUIRE_EQUAL(man2.CheckBuffer(read[ii], artdaq::SharedMemoryManager::BufferSemaphoreFlags::Reading), true);
+		}
+		auto rest = man2.GetBuffersForReading(4);
+		BOOST_REQUIRE_EQUAL(rest.size(), 2);
+		BOOST_REQUIRE_EQUAL(rest[0], written[4]);
+		BOOST_REQUIRE_EQUAL(rest[1], written[5]);
+
+		read.insert(read.end(), rest.begin(), rest.end());
+		man2.MarkBuffersEmpty(read);
+		BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 6);
+		BOOST_REQUIRE_EQUAL(man2.ReadReadyCount(), 0);
+	}
+	TLOG(TLVL_DEBUG) << "END TEST BatchAcquire";
+}
+
+BOOST_AUTO_TEST_CASE(CoarseTouchClock)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST CoarseTouchClock";
+	BOOST_REQUIRE_GE(artdaq::TimeUtils::gettimeofday_coarse_resolution_us(), 1);
+
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.touch_clock = artdaq::SharedMemoryTouchClock::Coarse;
+	artdaq::SharedMemoryManager man(key, 4, 0x1000, 100000, true, options);
+	artdaq::SharedMemoryManager man2(key);  // Picks up the clock choice from the segment
+	BOOST_REQUIRE(man.IsValid());
+	BOOST_REQUIRE(man2.IsValid());
+
+	auto buf = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_NE(buf, -1);
+	man.Write(buf, &buf, sizeof(buf));
+	man.MarkBufferFull(buf);
+
+	auto read = man2.GetBufferForReading();
+	BOOST_REQUIRE_EQUAL(read, buf);
+	BOOST_REQUIRE_EQUAL(man.ResetBuffer(read), false);
+
+	// A reader which stops touching its buffer is still timed out, give or take a clock tick
+	usleep(300000);
+	BOOST_REQUIRE_EQUAL(man.ResetBuffer(read), true);
+	BOOST_REQUIRE_EQUAL(man.CheckBuffer(read, artdaq::SharedMemoryManager::BufferSemaphoreFlags::Full), true);
+	TLOG(TLVL_DEBUG) << "END TEST CoarseTouchClock";
+}
+
+BOOST_AUTO_TEST_CASE(ReaperThread)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST ReaperThread";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.reaper_interval_us = 10000;
+	artdaq::SharedMemoryManager man(key, 4, 0x1000, 100000, true, options);
+	artdaq::SharedMemoryManager man2(key);
+	BOOST_REQUIRE(man2.IsValid());
+
+	auto buf = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_NE(buf, -1);
+	man.MarkBufferFull(buf);
+	BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), buf);
+	BOOST_REQUIRE_EQUAL(man.GetReapCount(), 0);
+
+	// Nobody scans the buffers while the reader sleeps; the owner's reaper thread reclaims the stale buffer
+	usleep(300000);
+	BOOST_REQUIRE_EQUAL(man.GetReapCount(), 1);
+	BOOST_REQUIRE_EQUAL(man2.CheckBuffer(buf, artdaq::SharedMemoryManager::BufferSemaphoreFlags::Full), true);
+	BOOST_REQUIRE_EQUAL(man2.ReadReadyCount(), 1);
+
+	// Stopping the reaper wakes it up, rather than waiting for the end of its interval
+	options.reaper_interval_us = 10 * 1000000;
+	artdaq::SharedMemoryManager slow(GetRandomKey(0x7357), 4, 0x1000, 100000, true, options);
+	usleep(10000);
+	auto start = std::chrono::steady_clock::now();
+	slow.Detach();
+	BOOST_REQUIRE_LT(artdaq::TimeUtils::GetElapsedTime(start), 1.0);
+	TLOG(TLVL_DEBUG) << "END TEST ReaperThread";
+}
+
+BOOST_AUTO_TEST_CASE(StateCounters)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST StateCounters";
+	using Flags = artdaq::SharedMemoryManager::BufferSemaphoreFlags;
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager man(key, 6, 0x1000);
+	artdaq::SharedMemoryManager reader1(key);
+	artdaq::SharedMemoryManager reader2(key);
+	BOOST_REQUIRE_EQUAL(man.GetBufferStateCount(Flags::Empty), 6);
+
+	auto any = man.GetBufferForWriting(false);
+	auto targeted = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_NE(man.GetBufferForWriting(false), -1);  // Still Writing when the owner detaches
+	BOOST_REQUIRE_EQUAL(man.GetBufferStateCount(Flags::Writing), 3);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 3);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(true), 3);
+
+	man.MarkBufferFull(any);
+	man.MarkBufferFull(targeted, reader2.GetMyId());
+	BOOST_REQUIRE_EQUAL(man.GetBufferStateCount(Flags::Full), 2);
+	BOOST_REQUIRE_EQUAL(reader1.ReadReadyCount(), 1);
+	BOOST_REQUIRE_EQUAL(reader2.ReadReadyCount(), 2);
+
+	auto read = reader2.GetBufferForReading();
+	BOOST_REQUIRE(read == any || read == targeted);
+	BOOST_REQUIRE_EQUAL(man.GetBufferStateCount(Flags::Reading), 1);
+	BOOST_REQUIRE_EQUAL(reader2.ReadReadyCount(), 1);
+	reader2.MarkBufferEmpty(read);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 4);
+
+	// Buffers released by a detaching manager are counted in their new state
+	man.Detach();
+	BOOST_REQUIRE_EQUAL(reader1.IsValid(), true);
+	BOOST_REQUIRE_EQUAL(reader1.GetBufferStateCount(Flags::Writing), 0);
+	BOOST_REQUIRE_EQUAL(reader1.GetBufferStateCount(Flags::Empty), 5);
+	TLOG(TLVL_DEBUG) << "END TEST StateCounters";
+}
+
+BOOST_AUTO_TEST_CASE(Arena)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST Arena";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.arena_size = 0x10000;
+	options.arena_wait_us = 20000;
+	artdaq::SharedMemoryManager man(key, 16, 0x8000, 100000, true, options);
+	artdaq::SharedMemoryManager man2(key);
+	BOOST_REQUIRE(man2.UsesArena());
+	BOOST_REQUIRE_EQUAL(man.GetArenaFreeBytes(), 0x10000);
+
+	// Far more than the arena size is written, wrapping around it several times
+	std::vector<uint8_t> data(0x8000);
+	int held = -1;
+	for (size_t round = 0; round < 20; ++round)
+	{
+		std::vector<int> bufs;
+		for (size_t size : {100, 0x3000, 0x800, 40})
+		{
+			auto buf = man.GetBufferForWriting(false);
+			BOOST_REQUIRE_NE(buf, -1);
+			std::fill_n(data.begin(), size, static_cast<uint8_t>(round + size));
+			BOOST_REQUIRE_EQUAL(man.Write(buf, data.data(), size), size);
+			man.MarkBufferFull(buf);
+			bufs.push_back(buf);
+		}
+
+		auto read = man2.GetBuffersForReading(4);
+		BOOST_REQUIRE_EQUAL(read.size(), 4);
+		for (auto buf : read)
+		{
+			auto size = man2.BufferDataSize(buf);
+			std::vector<uint8_t> out(size);
+			BOOST_REQUIRE(man2.Read(buf, out.data(), size));
+			BOOST_REQUIRE(std::all_of(out.begin(), out.end(), [&](uint8_t b) { return b == static_cast<uint8_t>(round + size); }));
+		}
+
+		// Releasing out of order only reclaims space once the oldest allocation is released
+		auto free_before = man.GetArenaFreeBytes();
+		man2.MarkBufferEmpty(read[2]);
+		man2.MarkBufferEmpty(read[1]);
+		BOOST_REQUIRE_EQUAL(man.GetArenaFreeBytes(), free_before);
+		if (held != -1) man2.MarkBufferEmpty(held);
+		man2.MarkBufferEmpty(read[0]);
+		BOOST_REQUIRE_GT(man.GetArenaFreeBytes(), free_before);
+		held = read[3];
+	}
+	man2.MarkBufferEmpty(held);
+	BOOST_REQUIRE_EQUAL(man.GetArenaFreeBytes(), 0x10000);
+
+	// A buffer written in pieces keeps its data when it has to move
+	auto first = man.GetBufferForWriting(false);
+	auto second = man.GetBufferForWriting(false);
+	std::iota(data.begin(), data.end(), 0);
+	man.Write(first, data.data(), 0x100);
+	man.Write(second, data.data(), 0x100);
+	man.Write(first, data.data() + 0x100, 0x4000);
+	BOOST_REQUIRE_EQUAL(memcmp(man.GetBufferStart(first), data.data(), 0x4100), 0);
+
+	// Buffers are limited to buffer_size, and arena space by what readers have released
+	BOOST_REQUIRE_EQUAL(man.ReserveBufferSpace(second, 0x8000), false);
+	BOOST_REQUIRE_EQUAL(man.ReserveBufferSpace(second, 0x7000), true);
+	auto third = man.GetBufferForWriting(false);
+	auto start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE_EQUAL(man.ReserveBufferSpace(third, 0x7000), false);
+	// The wait is bounded by arena_wait_us, not the buffer timeout
+	BOOST_REQUIRE_LT(artdaq::TimeUtils::GetElapsedTime(start), 0.09);
+	man.MarkBufferEmpty(first, true);
+	man.MarkBufferEmpty(second, true);
+	BOOST_REQUIRE_EQUAL(man.ReserveBufferSpace(third, 0x7000), true);
+	TLOG(TLVL_DEBUG) << "END TEST Arena";
+}
+
+BOOST_AUTO_TEST_CASE(ReserveCommit)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST ReserveCommit";
+	for (size_t arena_size : {0, 0x4000})
+	{
+		uint32_t key = GetRandomKey(0x7357);
+		artdaq::SharedMemoryOptions options;
+		options.arena_size = arena_size;
+		artdaq::SharedMemoryManager man(key, 4, 0x1000, 100000, true, options);
+		artdaq::SharedMemoryManager man2(key);
+
+		auto buf = man.GetBufferForWriting(false);
+		BOOST_REQUIRE(!man.ReserveWrite(buf, 0x1001));
+		BOOST_REQUIRE_EQUAL(man.CommitWrite(buf, 1), false);  // Nothing reserved
+
+		auto reservation = man.ReserveWrite(buf, 0x800);
+		BOOST_REQUIRE(reservation);
+		BOOST_REQUIRE_EQUAL(reservation.size, 0x800);
+		std::iota(reservation.data, reservation.data + 0x100, 0);
+		BOOST_REQUIRE_EQUAL(man.CommitWrite(buf, 0x801), false);
+		BOOST_REQUIRE_EQUAL(man.CommitWrite(buf, 0x100), true);
+		BOOST_REQUIRE_EQUAL(man.CommitWrite(buf, 0x100), false);  // Reservations are used up by a commit
+		BOOST_REQUIRE_EQUAL(man.BufferDataSize(buf), 0x100);
+
+		// Reservations follow the write position
+		reservation = man.ReserveWrite(buf, 0xF00);
+		BOOST_REQUIRE(reservation);
+		reservation.data[0] = 0xAB;
+		BOOST_REQUIRE_EQUAL(man.CommitWrite(buf, 1), true);
+		man.MarkBufferFull(buf);
+
+		BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), buf);
+		BOOST_REQUIRE_EQUAL(man2.BufferDataSize(buf), 0x101);
+		uint8_t out[0x101];
+		BOOST_REQUIRE(man2.Read(buf, out, sizeof(out)));
+		for (size_t ii = 0; ii < 0x100; ++ii)
+		{
+			BOOST_REQUIRE_EQUAL(out[ii], static_cast<uint8_t>(ii));
+		}
+		BOOST_REQUIRE_EQUAL(out[0x100], 0xAB);
+		man2.MarkBufferEmpty(buf);
+
+		// A reservation does not survive the buffer being released and taken again
+		buf = man.GetBufferForWriting(false);
+		BOOST_REQUIRE(man.ReserveWrite(buf, 0x800));
+		man.MarkBufferEmpty(buf, true);
+		int again = -1;
+		for (int ii = 0; ii < 4 && again != buf; ++ii)
+		{
+			again = man.GetBufferForWriting(false);
+		}
+		BOOST_REQUIRE_EQUAL(again, buf);
+		BOOST_REQUIRE_EQUAL(man.CommitWrite(buf, 0x100), false);
+		BOOST_REQUIRE_EQUAL(man.BufferDataSize(buf), 0);
+	}
+	TLOG(TLVL_DEBUG) << "END TEST ReserveCommit";
+}
+
+BOOST_AUTO_TEST_CASE(WriteV)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST WriteV";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager man(key, 2, 0x100000);
+	artdaq::SharedMemoryManager man2(key);
+
+	// A small header, a large piece which is streamed (starting at an unaligned position), and a small trailer
+	std::vector<uint8_t> header(13, 0x11);
+	std::vector<uint8_t> payload(0x80005);
+	std::iota(payload.begin(), payload.end(), 0);
+	std::vector<uint8_t> trailer(7, 0x22);
+	std::vector<struct iovec> iov{{header.data(), header.size()}, {payload.data(), payload.size()}, {trailer.data(), trailer.size()}};
+
+	auto buf = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_EQUAL(man.WriteV(buf, iov.data(), iov.size()), header.size() + payload.size() + trailer.size());
+	BOOST_REQUIRE_EQUAL(man.WriteV(buf, iov.data(), 1), header.size());
+	man.MarkBufferFull(buf);
+
+	BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), buf);
+	auto data = static_cast<uint8_t*>(man2.GetReadPos(buf));
+	BOOST_REQUIRE_EQUAL(man2.BufferDataSize(buf), 2 * header.size() + payload.size() + trailer.size());
+	BOOST_REQUIRE_EQUAL(memcmp(data, header.data(), header.size()), 0);
+	BOOST_REQUIRE_EQUAL(memcmp(data + header.size(), payload.data(), payload.size()), 0);
+	BOOST_REQUIRE_EQUAL(memcmp(data + header.size() + payload.size(), trailer.data(), trailer.size()), 0);
+	BOOST_REQUIRE_EQUAL(memcmp(data + header.size() + payload.size() + trailer.size(), header.data(), header.size()), 0);
+	man2.MarkBufferEmpty(buf);
+
+	// Pieces which do not fit are rejected as a whole
+	buf = man.GetBufferForWriting(false);
+	std::vector<struct iovec> too_big{{payload.data(), payload.size()}, {payload.data(), payload.size()}};
+	BOOST_REQUIRE_EXCEPTION(man.WriteV(buf, too_big.data(), too_big.size()), cet::exception, [&](cet::exception e) { return e.category() == "SharedMemoryWrite"; });
+	TLOG(TLVL_DEBUG) << "END TEST WriteV";
+}
+
+BOOST_AUTO_TEST_CASE(WaitForReadable)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST WaitForReadable";
+	uint32_t key = GetRandomKey(0x7357);
+	uint32_t key2 = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager man(key, 2, 0x1000);
+	artdaq::SharedMemoryManager man2(key2, 2, 0x1000);
+	artdaq::SharedMemoryManager reader(key);
+	artdaq::SharedMemoryManager reader2(key2);
+	std::vector<artdaq::SharedMemoryManager*> segments{&reader, &reader2};
+
+	std::vector<uint32_t> counts{reader.GetReadNotifyCount(), reader2.GetReadNotifyCount()};
+	BOOST_REQUIRE_EQUAL(artdaq::SharedMemoryManager::WaitForReadable(segments, counts, 10000), -1);
+
+	// A buffer made ready on the second segment wakes a reader waiting on both
+	std::thread writer([&]() {
+		usleep(100000);
+		auto buf = man2.GetBufferForWriting(false);
+		man2.MarkBufferFull(buf);
+	});
+	auto start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE_EQUAL(artdaq::SharedMemoryManager::WaitForReadable(segments, counts, 10000000), 1);
+	BOOST_REQUIRE_LT(artdaq::TimeUtils::GetElapsedTime(start), 5.0);
+	writer.join();
+	BOOST_REQUIRE(reader2.ReadyForRead());
+
+	// A change which happened before the wait returns immediately
+	BOOST_REQUIRE_EQUAL(artdaq::SharedMemoryManager::WaitForReadable(segments, counts, 10000000), 1);
+	TLOG(TLVL_DEBUG) << "END TEST WaitForReadable";
+}
+
+BOOST_AUTO_TEST_CASE(DispatchLanes)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST DispatchLanes";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.dispatch_lanes = 2;
+	options.use_index_queues = true;
+	artdaq::SharedMemoryManager man(key, 8, 0x1000, 0x10000, true, options);
+	artdaq::SharedMemoryManager reader(key);
+	artdaq::SharedMemoryManager reader2(key);
+
+	BOOST_REQUIRE_EQUAL(man.UsesIndexQueues(), false);
+	BOOST_REQUIRE_EQUAL(reader.GetDispatchLaneCount(), 2);
+
+	// Readers claim their lanes when they first read
+	BOOST_REQUIRE_EQUAL(reader.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(reader2.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(reader.GetDispatchLane(), 0);
+	BOOST_REQUIRE_EQUAL(reader2.GetDispatchLane(), 1);
+
+	auto write = [&]() {
+		auto buf = man.GetBufferForWriting(false);
+		man.MarkBufferFull(buf);
+		return buf;
+	};
+	std::vector<int> written;
+	for (int ii = 0; ii < 6; ++ii)
+	{
+		written.push_back(write());
+	}
+
+	// Tickets are dealt out in strict rotation, and a reader never takes a buffer from another reader's lane
+	BOOST_REQUIRE_EQUAL(reader.ReadReadyCount(), 3);
+	for (int ii = 0; ii < 3; ++ii)
+	{
+		auto buf = reader.GetBufferForReading();
+		BOOST_REQUIRE_EQUAL(buf, written[2 * ii]);
+		reader.MarkBufferEmpty(buf);
+	}
+	BOOST_REQUIRE_EQUAL(reader.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(reader.ReadyForRead(), false);
+	BOOST_REQUIRE_EQUAL(reader2.ReadReadyCount(), 3);
+	auto batch = reader2.GetBuffersForReading(8);
+	BOOST_REQUIRE_EQUAL(batch.size(), 3);
+	for (int ii = 0; ii < 3; ++ii)
+	{
+		BOOST_REQUIRE_EQUAL(batch[ii], written[2 * ii + 1]);
+	}
+	reader2.MarkBuffersEmpty(batch);
+
+	auto stats = man.GetDispatchLaneStats();
+	BOOST_REQUIRE_EQUAL(stats.size(), 2);
+	BOOST_REQUIRE_EQUAL(stats[0].owner, reader.GetMyId());
+	BOOST_REQUIRE_EQUAL(stats[1].owner, reader2.GetMyId());
+	for (auto const& lane : stats)
+	{
+		BOOST_REQUIRE_EQUAL(lane.dispatched, 3);
+		BOOST_REQUIRE_EQUAL(lane.consumed, 3);
+	}
+
+	// Buffers dealt to a lane which nobody holds go to the remaining readers
+	reader2.Detach();
+	BOOST_REQUIRE_EQUAL(man.GetDispatchLaneStats()[1].owner, -1);
+	written = {write(), write()};
+	for (auto expected : written)
+	{
+		auto buf = reader.GetBufferForReading();
+		BOOST_REQUIRE_EQUAL(buf, expected);
+		reader.MarkBufferEmpty(buf);
+	}
+	stats = man.GetDispatchLaneStats();
+	BOOST_REQUIRE_EQUAL(stats[0].consumed, 5);
+	BOOST_REQUIRE_EQUAL(stats[1].dispatched, 4);
+	TLOG(TLVL_DEBUG) << "END TEST DispatchLanes";
+}
+
+BOOST_AUTO_TEST_CASE(ReaderCursors)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST ReaderCursors";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.reader_cursors = true;
+	artdaq::SharedMemoryManager man(key, 4, 0x1000, 0x10000, false, options);
+	artdaq::SharedMemoryManager fast(key);
+	artdaq::SharedMemoryManager slow(key);
+	BOOST_REQUIRE_EQUAL(fast.UsesReaderCursors(), true);
+
+	// Readers get their cursors when they first read
+	BOOST_REQUIRE_EQUAL(fast.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(slow.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(man.GetReaderCursorStats().size(), 2);
+
+	auto write = [&]() {
+		auto buf = man.GetBufferForWriting(false);
+		if (buf != -1) man.MarkBufferFull(buf);
+		return buf;
+	};
+	// Each reader sees every buffer, in sequence ID order
+	auto read = [](artdaq::SharedMemoryManager& reader, size_t first, size_t count) {
+		for (size_t seqID = first; seqID < first + count; ++seqID)
+		{
+			auto buf = reader.GetBufferForReading();
+			BOOST_REQUIRE_NE(buf, -1);
+			BOOST_REQUIRE_EQUAL(reader.GetLastSeenBufferID(), seqID);
+			reader.MarkBufferEmpty(buf);
+		}
+	};
+	for (int ii = 0; ii < 4; ++ii)
+	{
+		BOOST_REQUIRE_NE(write(), -1);
+	}
+	BOOST_REQUIRE_EQUAL(write(), -1);
+
+	// Buffers go back to the writers once the slowest reader has released them, not when they time out
+	read(fast, 1, 4);
+	BOOST_REQUIRE_EQUAL(man.GetBufferForWriting(false), -1);
+	read(slow, 1, 2);
+	BOOST_REQUIRE_EQUAL(man.GetRecycleCount(), 2);
+	BOOST_REQUIRE_NE(write(), -1);
+	BOOST_REQUIRE_NE(write(), -1);
+	BOOST_REQUIRE_EQUAL(write(), -1);
+	TLOG(TLVL_DEBUG) << "END TEST ReaderCursors";
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentFirstReads)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST ConcurrentFirstReads";
+	// Threads sharing one manager register it as a reader only once, with one cursor or lane
+	auto firstReads = [](artdaq::SharedMemoryManager& reader) {
+		std::atomic<bool> go{false};
+		std::vector<std::thread> threads;
+		for (int ii = 0; ii < 8; ++ii)
+		{
+			threads.emplace_back([&]() {
+				while (!go.load()) {}
+				reader.GetBufferForReading();
+			});
+		}
+		go = true;
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+	};
+
+	artdaq::SharedMemoryOptions options;
+	options.reader_cursors = true;
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager man(key, 4, 0x1000, 0x10000, false, options);
+	artdaq::SharedMemoryManager reader(key);
+	firstReads(reader);
+	BOOST_REQUIRE_EQUAL(man.GetReaderCursorStats().size(), 1);
+	BOOST_REQUIRE_EQUAL(reader.GetReaderCursor(), 0);
+
+	artdaq::SharedMemoryOptions lane_options;
+	lane_options.dispatch_lanes = 4;
+	uint32_t lane_key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager lane_man(lane_key, 4, 0x1000, 0x10000, true, lane_options);
+	artdaq::SharedMemoryManager lane_reader(lane_key);
+	firstReads(lane_reader);
+	auto lanes = lane_man.GetDispatchLaneStats();
+	BOOST_REQUIRE_EQUAL(std::count_if(lanes.begin(), lanes.end(), [&](auto const& lane) { return lane.owner == lane_reader.GetMyId(); }), 1);
+	BOOST_REQUIRE_EQUAL(lane_reader.GetDispatchLane(), 0);
+	TLOG(TLVL_DEBUG) << "END TEST ConcurrentFirstReads";
+}
+
+BOOST_AUTO_TEST_CASE(ReaderCursorDrop)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST ReaderCursorDrop";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.reader_cursors = true;
+	options.max_cursor_lag = 2;
+	artdaq::SharedMemoryManager man(key, 4, 0x1000, 0x10000, false, options);
+	artdaq::SharedMemoryManager fast(key);
+	artdaq::SharedMemoryManager slow(key);
+	BOOST_REQUIRE_EQUAL(fast.GetBufferForReading(), -1);
+	BOOST_REQUIRE_EQUAL(slow.GetBufferForReading(), -1);
+
+	for (int ii = 0; ii < 4; ++ii)
+	{
+		auto buf = man.GetBufferForWriting(false);
+		man.MarkBufferFull(buf);
+		buf = fast.GetBufferForReading();
+		BOOST_REQUIRE_NE(buf, -1);
+		fast.MarkBufferEmpty(buf);
+	}
+
+	// The idle reader is more than max_cursor_lag behind, so the writer drops it rather than waiting for it
+	auto buf = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_NE(buf, -1);
+	auto stats = man.GetReaderCursorStats();
+	BOOST_REQUIRE_EQUAL(stats.size(), 2);
+	BOOST_REQUIRE_EQUAL(stats[1].owner, slow.GetMyId());
+	BOOST_REQUIRE_EQUAL(stats[1].dropped, true);
+	BOOST_REQUIRE_EQUAL(stats[1].drops, 1);
+	BOOST_REQUIRE_EQUAL(man.GetRecycleCount(), 4);
+	man.MarkBufferFull(buf);
+
+	// When it reads again it holds buffers back as before, starting from the oldest one still in the segment
+	buf = slow.GetBufferForReading();
+	BOOST_REQUIRE_NE(buf, -1);
+	BOOST_REQUIRE_EQUAL(slow.GetLastSeenBufferID(), 5);
+	BOOST_REQUIRE_EQUAL(man.GetReaderCursorStats()[1].dropped, false);
+	slow.MarkBufferEmpty(buf);
+	BOOST_REQUIRE_EQUAL(man.GetRecycleCount(), 4);
+	TLOG(TLVL_DEBUG) << "END TEST ReaderCursorDrop";
+}
+
+BOOST_AUTO_TEST_CASE(ReaderCursorArena)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST ReaderCursorArena";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.reader_cursors = true;
+	options.arena_size = 0x4000;
+	// The buffer timeout is far longer than the test, so only the reader cursors recycle buffers
+	artdaq::SharedMemoryManager man(key, 4, 0x2000, 100 * 1000000, false, options);
+	artdaq::SharedMemoryManager reader(key);
+	BOOST_REQUIRE_EQUAL(reader.GetBufferForReading(), -1);
+
+	// Recycled buffers must give their arena space back, or the arena fills up after a few rounds
+	std::vector<uint8_t> data(0x1000);
+	for (size_t round = 0; round < 40; ++round)
+	{
+		auto buf = man.GetBufferForWriting(false);
+		BOOST_REQUIRE_NE(buf, -1);
+		std::fill(data.begin(), data.end(), static_cast<uint8_t>(round));
+		BOOST_REQUIRE_EQUAL(man.Write(buf, data.data(), data.size()), data.size());
+		man.MarkBufferFull(buf);
+
+		auto readbuf = reader.GetBufferForReading();
+		BOOST_REQUIRE_EQUAL(readbuf, buf);
+		std::vector<uint8_t> out(data.size());
+		BOOST_REQUIRE(reader.Read(readbuf, out.data(), out.size()));
+		BOOST_REQUIRE(out == data);
+		reader.MarkBufferEmpty(readbuf);
+	}
+	BOOST_REQUIRE_EQUAL(man.GetRecycleCount(), 40);
+	BOOST_REQUIRE_EQUAL(man.GetArenaFreeBytes(), 0x4000);
+	TLOG(TLVL_DEBUG) << "END TEST ReaderCursorArena";
+}
+
+BOOST_AUTO_TEST_CASE(BufferTypes)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST BufferTypes";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager man(key, 2, 0x1000);
+	artdaq::SharedMemoryManager man2(key);
+	artdaq::SharedMemoryManager::BufferTypeMask wanted, other;
+	wanted.set(200);
+	other.set(3);
+
+	auto buf = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_EQUAL(man2.AddBufferType(buf, 3), false);  // Only the writer publishes types
+	BOOST_REQUIRE_EQUAL(man.AddBufferType(buf, 200), true);
+	man.MarkBufferFull(buf);
+
+	// Once the buffer is Full, readers filter on the published types, which can no longer change
+	BOOST_REQUIRE_EQUAL(man.AddBufferType(buf, 3), false);
+	BOOST_REQUIRE_EQUAL(man2.BufferHasAnyType(buf, wanted), true);
+	BOOST_REQUIRE_EQUAL(man2.BufferHasAnyType(buf, other), false);
+	TLOG(TLVL_DEBUG) << "END TEST BufferTypes";
+}
+
+BOOST_AUTO_TEST_CASE(DestinationQueues)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST DestinationQueues";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.use_index_queues = true;
+	options.destination_queues = 4;
+	artdaq::SharedMemoryManager man(key, 8, 0x1000, 0x10000, true, options);
+	artdaq::SharedMemoryManager reader(key);
+	artdaq::SharedMemoryManager reader2(key);
+	BOOST_REQUIRE_EQUAL(reader.GetDestinationQueueCount(), 4);
+
+	auto write = [&](int destination) {
+		auto buf = man.GetBufferForWriting(false);
+		man.MarkBufferFull(buf, destination);
+		return buf;
+	};
+	std::vector<int> targeted{write(reader2.GetMyId()), write(reader2.GetMyId())};
+	auto shared = write(-1);
+	targeted.push_back(write(reader2.GetMyId()));
+
+	// Buffers sent to another reader are never handed to this one, or even dequeued by it
+	BOOST_REQUIRE_EQUAL(reader.ReadyForRead(), true);
+	BOOST_REQUIRE_EQUAL(reader.GetBufferForReading(), shared);
+	BOOST_REQUIRE_EQUAL(reader.ReadyForRead(), false);
+	BOOST_REQUIRE_EQUAL(reader.GetBufferForReading(), -1);
+	reader.MarkBufferEmpty(shared);
+
+	// The destination gets its buffers in the order they were marked Full
+	for (auto expected : targeted)
+	{
+		auto buf = reader2.GetBufferForReading();
+		BOOST_REQUIRE_EQUAL(buf, expected);
+		reader2.MarkBufferEmpty(buf);
+	}
+	BOOST_REQUIRE_EQUAL(reader2.ReadyForRead(), false);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 8);
+	TLOG(TLVL_DEBUG) << "END TEST DestinationQueues";
+}
+
+BOOST_AUTO_TEST_CASE(DeadManagerRecovery)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST DeadManagerRecovery";
+	uint32_t key = GetRandomKey(0x7357);
+	// The buffer timeout is far longer than the test, so only the liveness check can reclaim buffers
+	artdaq::SharedMemoryManager man(key, 4, 0x1000, 100 * 1000000);
+	auto full = man.GetBufferForWriting(false);
+	man.MarkBufferFull(full);
+
+	// A child process takes one buffer for reading and one for writing, then exits without detaching
+	auto pid = fork();
+	BOOST_REQUIRE_NE(pid, -1);
+	if (pid == 0)
+	{
+		artdaq::SharedMemoryManager child(key);
+		auto ok = child.GetBufferForReading() == full && child.GetBufferForWriting(false) != -1;
+		_exit(ok ? 0 : 1);
+	}
+	int status = 0;
+	BOOST_REQUIRE_EQUAL(waitpid(pid, &status, 0), pid);
+	BOOST_REQUIRE(WIFEXITED(status));
+	BOOST_REQUIRE_EQUAL(WEXITSTATUS(status), 0);
+
+	int child_id = -1;
+	for (auto const& report : man.GetBufferReport())
+	{
+		if (report.second == artdaq::SharedMemoryManager::BufferSemaphoreFlags::Reading) child_id = report.first;
+	}
+	BOOST_REQUIRE_GT(child_id, 0);
+	BOOST_REQUIRE_EQUAL(man.IsManagerAlive(man.GetMyId()), true);
+	BOOST_REQUIRE_EQUAL(man.IsManagerAlive(child_id), false);
+
+	// Both buffers are reclaimed right away, and the child no longer counts as attached
+	auto start = std::chrono::steady_clock::now();
+	BOOST_REQUIRE_EQUAL(man.GetBufferForReading(), full);
+	BOOST_REQUIRE_EQUAL(man.WriteReadyCount(false), 3);
+	BOOST_REQUIRE_LT(artdaq::TimeUtils::GetElapsedTime(start), 1.0);
+	BOOST_REQUIRE_EQUAL(man.GetAttachedCount(), 1);
+
+	// Without IsManagerAlive, the liveness probe made before each scan notices the exit
+	pid = fork();
+	BOOST_REQUIRE_NE(pid, -1);
+	if (pid == 0)
+	{
+		artdaq::SharedMemoryManager child(key);
+		auto ok = child.GetBufferForWriting(false) != -1;
+		usleep(200000);
+		_exit(ok ? 0 : 1);
+	}
+	usleep(100000);
+	child_id = -1;
+	for (auto const& report : man.GetBufferReport())
+	{
+		if (report.second == artdaq::SharedMemoryManager::BufferSemaphoreFlags::Writing) child_id = report.first;
+	}
+	BOOST_REQUIRE_GT(child_id, 0);
+	BOOST_REQUIRE_EQUAL(man.IsManagerAlive(child_id), true);  // Same PID and start time
+	BOOST_REQUIRE_EQUAL(waitpid(pid, &status, 0), pid);
+	BOOST_REQUIRE_EQUAL(WEXITSTATUS(status), 0);
+	usleep(2000);
+	BOOST_REQUIRE_EQUAL(man.GetBuffersForWriting(3, false).size(), 3);
+	TLOG(TLVL_DEBUG) << "END TEST DeadManagerRecovery";
+}
+
+BOOST_AUTO_TEST_CASE(SysVSegmentStatus)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST SysVSegmentStatus";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager man(key, 4, 0x1000, 0x10000);
+	artdaq::SharedMemoryManager man2(key);
+	BOOST_REQUIRE_EQUAL(man.GetAttachedCount(), 2);
+
+	// A process which crashes without holding any buffer still stops counting as attached
+	auto pid = fork();
+	BOOST_REQUIRE_NE(pid, -1);
+	if (pid == 0)
+	{
+		artdaq::SharedMemoryManager child(key);
+		_exit(child.IsValid() ? 0 : 1);
+	}
+	int status = 0;
+	BOOST_REQUIRE_EQUAL(waitpid(pid, &status, 0), pid);
+	BOOST_REQUIRE_EQUAL(WEXITSTATUS(status), 0);
+	BOOST_REQUIRE_EQUAL(man.GetAttachedCount(), 2);
+
+	// Removing the segment from outside (e.g. with ipcrm) is an end-of-data condition
+	BOOST_REQUIRE_EQUAL(man2.IsEndOfData(), false);
+	auto id = shmget(key, 0, 0);
+	BOOST_REQUIRE_NE(id, -1);
+	BOOST_REQUIRE_EQUAL(shmctl(id, IPC_RMID, nullptr), 0);
+	BOOST_REQUIRE_EQUAL(man2.IsEndOfData(), true);
+	TLOG(TLVL_DEBUG) << "END TEST SysVSegmentStatus";
+}
+
+BOOST_AUTO_TEST_CASE(PrefaultAndLock)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST PrefaultAndLock";
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryOptions options;
+	options.prefault = true;
+	options.prefault_threads = 4;
+	options.lock_memory = true;
+	artdaq::SharedMemoryManager man(key, 64, 0x100000, 0x10000, true, options);
+	artdaq::SharedMemoryManager man2(key);
+
+	BOOST_REQUIRE_EQUAL(man.IsValid(), true);
+	BOOST_REQUIRE_EQUAL(man2.IsValid(), true);
+	BOOST_REQUIRE_GT(man.GetPrefaultTime(), 0.0);
+	// The segment asks attachers to prefault too, but they choose their own threads and locking
+	BOOST_REQUIRE_GT(man2.GetPrefaultTime(), 0.0);
+	BOOST_REQUIRE_EQUAL(man2.IsMemoryLocked(), false);
+	BOOST_REQUIRE_EQUAL(man2.GetLockTime(), 0.0);
+	// mlock may be refused by RLIMIT_MEMLOCK, which only leaves the segment unlocked
+	BOOST_REQUIRE(man.IsMemoryLocked() || man.GetLockTime() == 0.0);
+
+	uint8_t n = 0;
+	std::vector<uint8_t> data(0x100000);
+	std::generate(data.begin(), data.end(), [&]() { return ++n; });
+	auto buf = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_NE(buf, -1);
+	man.Write(buf, data.data(), data.size());
+	man.MarkBufferFull(buf);
+
+	auto readbuf = man2.GetBufferForReading();
+	BOOST_REQUIRE_EQUAL(readbuf, buf);
+	std::vector<uint8_t> out(data.size());
+	BOOST_REQUIRE_EQUAL(man2.Read(readbuf, out.data(), out.size()), true);
+	BOOST_REQUIRE(data == out);
+	man2.MarkBufferEmpty(readbuf);
+
+	man.Detach();
+	BOOST_REQUIRE_EQUAL(man.IsMemoryLocked(), false);
+	TLOG(TLVL_DEBUG) << "END TEST PrefaultAndLock";
+}
+
+BOOST_AUTO_TEST_CASE(Telemetry)
+{
+	TLOG(TLVL_DEBUG) << "BEGIN TEST Telemetry";
+	using Flags = artdaq::SharedMemoryManager::BufferSemaphoreFlags;
+	auto count = [](uint64_t const(&histogram)[artdaq::SharedMemoryManager::telemetry_histogram_bins]) { return std::accumulate(std::begin(histogram), std::end(histogram), uint64_t{0}); };
+	uint32_t key = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager man(key, 2, 0x1000, 0x10000);
+	artdaq::SharedMemoryManager man2(key);
+
+	uint64_t data = 0x1234;
+	auto buf = man.GetBufferForWriting(false);
+	BOOST_REQUIRE_NE(buf, -1);
+	man.Write(buf, &data, sizeof(data));
+	man.MarkBufferFull(buf);
+	usleep(2000);
+	auto readbuf = man2.GetBufferForReading();
+	BOOST_REQUIRE_EQUAL(readbuf, buf);
+	BOOST_REQUIRE_EQUAL(man2.GetBufferForReading(), -1);
+	man2.MarkBufferEmpty(readbuf);
+
+	auto telemetry = man.GetTelemetry();
+	BOOST_REQUIRE_EQUAL(telemetry.transitions[static_cast<int>(Flags::Empty)][static_cast<int>(Flags::Writing)], 1);
+	BOOST_REQUIRE_EQUAL(telemetry.transitions[static_cast<int>(Flags::Writing)][static_cast<int>(Flags::Full)], 1);
+	BOOST_REQUIRE_EQUAL(telemetry.transitions[static_cast<int>(Flags::Full)][static_cast<int>(Flags::Reading)], 1);
+	BOOST_REQUIRE_EQUAL(telemetry.transitions[static_cast<int>(Flags::Reading)][static_cast<int>(Flags::Empty)], 1);
+	BOOST_REQUIRE_EQUAL(telemetry.failed_reads, 1);
+	BOOST_REQUIRE_EQUAL(telemetry.overwrites, 0);
+	BOOST_REQUIRE_EQUAL(count(telemetry.queue_time_us), 1);
+	BOOST_REQUIRE_EQUAL(count(telemetry.hold_time_us), 1);
+	// The buffer waited at least 2 ms, so its queue time is not in the bins below 1024 us
+	BOOST_REQUIRE_EQUAL(std::accumulate(telemetry.queue_time_us, telemetry.queue_time_us + 11, uint64_t{0}), 0);
+
+	BOOST_REQUIRE_EQUAL(telemetry.managers.size(), 2);
+	BOOST_REQUIRE_EQUAL(telemetry.managers[0].id, man.GetMyId());
+	BOOST_REQUIRE_EQUAL(telemetry.managers[0].writes, 1);
+	BOOST_REQUIRE_EQUAL(telemetry.managers[1].id, man2.GetMyId());
+	BOOST_REQUIRE_EQUAL(telemetry.managers[1].reads, 1);
+	BOOST_REQUIRE_EQUAL(telemetry.managers[1].failed_reads, 1);
+
+	// A monitoring tool sees the same counters without attaching
+	artdaq::SharedMemoryManager::SegmentTelemetry external{};
+	BOOST_REQUIRE_EQUAL(artdaq::SharedMemoryManager::ReadTelemetry(key, external), true);
+	BOOST_REQUIRE_EQUAL(external.failed_reads, telemetry.failed_reads);
+	BOOST_REQUIRE_EQUAL(external.managers.size(), telemetry.managers.size());
+	BOOST_REQUIRE_EQUAL(man.GetAttachedCount(), 2);
+	BOOST_REQUIRE_EQUAL(artdaq::SharedMemoryManager::ReadTelemetry(GetRandomKey(0x7357), external), false);
+
+	// Broadcast writers which run out of Empty buffers overwrite Full ones
+	uint32_t bkey = GetRandomKey(0x7357);
+	artdaq::SharedMemoryManager broadcast(bkey, 2, 0x1000, 0x10000, false);
+	for (int ii = 0; ii < 3; ++ii)
+	{
+		auto wbuf = broadcast.GetBufferForWriting(true);
+		BOOST_REQUIRE_NE(wbuf, -1);
+		broadcast.Write(wbuf, &data, sizeof(data));
+		broadcast.MarkBufferFull(wbuf);
+	}
+	BOOST_REQUIRE_EQUAL(broadcast.GetBufferForWriting(false), -1);
+	auto btelemetry = broadcast.GetTelemetry();
+	BOOST_REQUIRE_EQUAL(btelemetry.overwrites, 1);
+	BOOST_REQUIRE_EQUAL(btelemetry.failed_writes, 1);
+	BOOST_REQUIRE_EQUAL(btelemetry.reader_clobbers, 0);
+	TLOG(TLVL_DEBUG) << "END TEST Telemetry";
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,6 +1,7 @@
 #ifndef ARTDAQ_CORE_TEST_CORE_SHAREDMEMORYTESTSHIMS_HH
 #define ARTDAQ_CORE_TEST_CORE_SHAREDMEMORYTESTSHIMS_HH
 
+#include <unistd.h>
 #include <random>
 #include "artdaq-core/Utilities/TimeUtils.hh"
 